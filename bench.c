@@ -0,0 +1,98 @@
+/**
+ * @file    bench.c
+ * @author  qufeiyan
+ * @brief   dlc-bench, the cost of a lock and unlock of a mutex nobody else takes.
+ * @version 1.0.0
+ * @date    2026/10/19 00:12:45
+ * @version Copyright (c) 2026
+ */
+
+/* Includes --------------------------------------------------------------------------------*/
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef DLC_BENCH_STATIC
+#include "interface.h"
+#endif
+
+//! pairs locked in a row, their 96 events stay well below the 256 an event queue holds.
+#define PAIRS_OF_BATCH      (32)
+
+struct benchThread{
+    pthread_t tid;
+    int threads;
+    long pairs;
+    long long ns;   //! time spent on the pairs, the pauses between batches excluded.
+};
+
+static long long nowNs(void){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void *benchThread(void *arg){
+    struct benchThread *t = arg;
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    long long start;
+
+    for(long done = 0; done < t->pairs; done += PAIRS_OF_BATCH){
+        start = nowNs();
+        for(int j = 0; j < PAIRS_OF_BATCH; j++){
+            pthread_mutex_lock(&mutex);
+            pthread_mutex_unlock(&mutex);
+        }
+        t->ns += nowNs() - start;
+        //! let the checker drain the queue, it does every 1ms, but it may share the
+        //! cpu with every thread.
+        usleep(2000 * t->threads);
+    }
+    return NULL;
+}
+
+/**
+ * @note The same program is timed with the checker linked statically, and without it,
+ *       alone and with the checker preloaded:
+ *
+ *       ./dlc-bench-static [pairs [threads]]
+ *       ./dlc-bench [pairs [threads]]
+ *       LD_PRELOAD=./libdlChecker.so ./dlc-bench [pairs [threads]]
+ */
+int main(int argc, char **argv){
+    long pairs = 100000;
+    int threads = 1;
+    long long ns = 0;
+    struct benchThread *t;
+
+    if(argc >= 2) pairs = strtol(argv[1], NULL, 10);
+    if(argc >= 3) threads = atoi(argv[2]);
+    if(pairs < PAIRS_OF_BATCH || threads < 1){
+        fprintf(stderr, "usage: %s [pairs [threads]]\n", argv[0]);
+        return 2;
+    }
+
+#ifdef DLC_BENCH_STATIC
+    initDeadlockChecker(1);
+#endif
+    //! the checker starts draining the queues 100ms after it's initialised.
+    usleep(200 * 1000);
+    t = calloc(threads, sizeof(struct benchThread));
+    for(int i = 0; i < threads; i++){
+        t[i].threads = threads;
+        t[i].pairs = pairs;
+        pthread_create(&t[i].tid, NULL, benchThread, &t[i]);
+    }
+    for(int i = 0; i < threads; i++){
+        pthread_join(t[i].tid, NULL);
+        ns += t[i].ns;
+    }
+
+    pairs = (pairs + PAIRS_OF_BATCH - 1) / PAIRS_OF_BATCH * PAIRS_OF_BATCH;
+    printf("%d threads x %ld lock/unlock: %.1f ns a pair\n", threads, pairs,
+        (double)ns / ((double)pairs * threads));
+    free(t);
+    return 0;
+}
@@ -116,9 +116,20 @@ struct dlcTest {
     int failed;
 } dlcTests[] = {
     {"map", hashMapTest},
-    {"mpool", mPoolTest},
-    {"list", dclistTest},
-    {"mem", memTest}
+    {"fmap", flatMapTest},
+    {"shadow", shadowTest},
+    {"scc", sccTest},
+    {"retire", retireTest},
+    {"mpool", memPoolTest},
+    {"numa", numaTest},
+    {"mem", memTest},
+    {"spinlock", spinlockTest},
+    {"held", heldSetTest},
+    {"timer", timerTest},
+    {"period", periodTest},
+    {"log", logTest},
+    {"relock", relockTest},
+    {"lockorder", lockOrderTest}
 };
 dlcTestProc *getTestProcByName(const char *name) {
     int numtests = sizeof(dlcTests) / sizeof(struct dlcTest);
@@ -5,8 +5,21 @@
 #include <signal.h>
 #include <stdint.h>
 #include <stdlib.h>
-
-#define PERIOD_OF_DLCHECKER         (200)      //! uint:ms
+#include "log.h"
+
+#define PERIOD_OF_DLCHECKER         (200)      //! uint:ms, the baseline of detection period.
+#define PERIOD_OF_DLCHECKER_MIN     (PERIOD_OF_DLCHECKER / 4)   //! uint:ms
+#define PERIOD_OF_DLCHECKER_MAX     (PERIOD_OF_DLCHECKER * 32)  //! uint:ms
+#define PERIOD_OF_EVENTLOOP         (1)        //! uint:ms, upper bound of checker sleeping.
+#define PERIOD_OF_EVENTLOOP_MAX     (16)       //! uint:ms, upper bound of sleeping while quiescent.
+#define FACTOR_OF_GC_PERIOD         (100)      //! period of gc in units of the detection period.
+#define THRESHOLD_OF_LONG_WAIT      (PERIOD_OF_DLCHECKER * 2)   //! uint:ms
+#define THRESHOLD_OF_QUEUE_LAG      (50)       //! percent of a event queue in use.
+#define THRESHOLD_OF_PARALLEL_SSC   (1 << 16)  //! live vertices from which ssc are searched in parallel.
+#define NUMBER_OF_CHECK_WORKERS     (4)        //! workers of the parallel search, at most the cpus.
+#define SIZE_OF_HEAP_ARENA          (1 << 20)  //! default arena of the heap, reserved at runtime.
+#define SIZE_OF_MEMPOOL_ARENA       (1 << 24)  //! default arena of the first slabs of pools.
+#define NUMBER_OF_NUMA_NODES        (4)        //! NUMA nodes event queues are placed on, at most.
 
 #ifndef USER_BACKTRACE
 #define IS_USER_OVERWRITE_BACKTRACE (0)
@@ -15,7 +28,9 @@
 #endif
 
 #define IS_USE_HASHMAP              (1)
-#define IS_USE_ASSERT               (1)
+#ifndef IS_USE_ASSERT
+#define IS_USE_ASSERT               (1)  //! 0 in the release build, make RELEASE=yes.
+#endif
 #define IS_USE_HEAP                 (0)
 
 
@@ -23,7 +38,9 @@
  * IS_USE_MEM_LIBC_MALLOC == 1: Use malloc/free/realloc provided by C-library
  * instead of the internal allocator. 
  */
+#ifndef IS_USE_MEM_LIBC_MALLOC
 #define IS_USE_MEM_LIBC_MALLOC      (0)  //! whether use malloc function of libc or not.
+#endif
 
 //! options
 #define DEPTH_BACKTRACE             (5)
@@ -60,41 +77,47 @@
 #define LOG_CTRL_LEVEL_INFO  (3)
 #define LOG_CTRL_LEVEL_DEBUG (4)     
 
+//! messages above the level are compiled out, e.g. -DLOG_CTRL_LEVEL_BUILD=2.
+#ifndef LOG_CTRL_LEVEL_BUILD
+#define LOG_CTRL_LEVEL_BUILD LOG_CTRL_LEVEL_DEBUG
+#endif
+
 #define DEBUG_GRAPH
 
 #ifdef DEBUG_GRAPH
 extern int log_ctrl_level;
-#define dlc_dbg(format, ...)                                                      \
+
+/**
+ * @note info, warnings and debug messages are queued by their thread, and printed by
+ *       the drainer, see log.c, as they are written by the hooks and the handlers of
+ *       every event. Errors are printed right away, after the messages queued before
+ *       them, an abort() follows most of them.
+ */
+#define dlc_log(level, prefix, format, ...)                                       \
 do{                                                                               \
-    if(log_ctrl_level >= LOG_CTRL_LEVEL_DEBUG){                                   \
-        printf(LOG_COLOR_DEBUG "[DLC_DBG %s:%d](#%s) " format LOG_COLOR_NONE ,    \
-            __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__);                     \
+    if((level) <= LOG_CTRL_LEVEL_BUILD && log_ctrl_level >= (level)){             \
+        static dlcLogSite_t _site = DLC_LOG_SITE(prefix, format);                 \
+        dlcLogWrite(&_site, format, ##__VA_ARGS__);                               \
     }                                                                             \
 }while(0)
 
+#define dlc_dbg(format, ...)                                                      \
+    dlc_log(LOG_CTRL_LEVEL_DEBUG, LOG_COLOR_DEBUG "[DLC_DBG ", format, ##__VA_ARGS__)
+
 #define dlc_err(format, ...)                                                      \
 do{                                                                               \
     if(log_ctrl_level >= LOG_CTRL_LEVEL_ERROR){                                   \
+        dlcLogFlush();                                                            \
         printf(LOG_COLOR_ERROR "[DLC_ERR %s:%d](#%s) " format LOG_COLOR_NONE ,    \
             __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__);                     \
     }                                                                             \
 }while(0)
 
 #define dlc_warn(format, ...)                                                     \
-do{                                                                               \
-    if(log_ctrl_level >= LOG_CTRL_LEVEL_WARN){                                    \
-        printf(LOG_COLOR_WARN "[DLC_WARN %s:%d](#%s) " format LOG_COLOR_NONE ,    \
-            __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__);                     \
-    }                                                                             \
-}while(0)
+    dlc_log(LOG_CTRL_LEVEL_WARN, LOG_COLOR_WARN "[DLC_WARN ", format, ##__VA_ARGS__)
 
 #define dlc_info(format, ...)                                                     \
-do{                                                                               \
-    if(log_ctrl_level >= LOG_CTRL_LEVEL_INFO){                                    \
-        printf(LOG_COLOR_INFO "[DLC_INFO %s:%d](#%s) " format LOG_COLOR_NONE ,    \
-            __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__);                     \
-    }                                                                             \
-}while(0)
+    dlc_log(LOG_CTRL_LEVEL_INFO, LOG_COLOR_INFO "[DLC_INFO ", format, ##__VA_ARGS__)
 
 
 #define dlcPanic(fmt, ...)                                                        \
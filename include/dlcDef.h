@@ -28,6 +28,12 @@ extern "C" {
 #define __unused __attribute__ ((unused))
 #endif
 
+//! thread locals of the hooks, addressed by a fixed offset from the thread pointer
+//! rather than through __tls_get_addr() once the checker is a preloaded library.
+#ifndef __tlsInitialExec
+#define __tlsInitialExec __attribute__((tls_model("initial-exec")))
+#endif
+
 /* Indirect stringification.  Doing two levels allows the parameter to be a
  * macro itself.  For example, compile with -DFOO=bar, __stringify(FOO)
  * converts to "bar".
@@ -71,6 +77,8 @@ typedef int32_t err_t;
 
 #define MEM_ALIGNMENT    (sizeof(size_t))
 
+#define DLC_CACHE_LINE_SIZE  (64)
+
 /**
  * @ingroup BasicDef
  *
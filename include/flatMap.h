@@ -0,0 +1,69 @@
+/**
+ * @file    flatMap.h
+ * @author  qufeiyan
+ * @brief   open-addressing hash map specialised for integer and pointer keys.
+ * @version 1.0.0
+ * @date    2026/10/18 15:20:11
+ * @version Copyright (c) 2026
+ */
+
+/* Define to prevent recursive inclusion ---------------------------------------------------*/
+#ifndef FLATMAP_H
+#define FLATMAP_H
+/* Include ---------------------------------------------------------------------------------*/
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* define a element type including key and value. */
+typedef struct flatMapEntry{
+    size_t key;
+    void *value;
+}flatMapEntry_t;
+
+typedef struct flatMap{
+    flatMapEntry_t *entries;    //! slots of the table.
+    uint8_t *probes;            //! probe length of each slot plus one, 0 means the slot is empty.
+    size_t mask;                //! capacity - 1, the capacity is a power of 2.
+    size_t size;                //! number of stored elements.
+    size_t minCapacity;         //! the map never shrinks below its initial capacity.
+}flatMap_t;
+
+/* it is a non safe iterator, and only flatMapNext() and lookups
+ * should be called while iterating. */
+typedef struct flatMapIterator{
+    flatMap_t *map;
+    size_t index;
+}flatMapIterator_t;
+
+
+/*--=-=-=-=-=-- flat map interface -=-=-=-=-=-=-=-*/
+flatMap_t *flatMapCreate(size_t capacity);
+void flatMapDestroy(flatMap_t *map);
+int flatMapPut(flatMap_t *map, size_t key, void *value);
+flatMapEntry_t *flatMapFind(flatMap_t *map, size_t key);
+void *flatMapGet(flatMap_t *map, size_t key);
+int flatMapRemove(flatMap_t *map, size_t key);
+flatMapEntry_t *flatMapNext(flatMapIterator_t *iter);
+
+static inline size_t flatMapSize(flatMap_t *map){
+    return map->size;
+}
+
+static inline void flatMapIteratorInit(flatMapIterator_t *iter, flatMap_t *map){
+    iter->map = map;
+    iter->index = 0;
+}
+
+#define flatMapIteratorReset(iter) do{\
+    (iter)->index = 0;\
+}while(0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	//  FLATMAP_H
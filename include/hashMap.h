@@ -40,17 +40,21 @@ typedef struct ENTRY_INFO{
 
 struct HASH_MAP{
     HASH_MAP_OPS *type;
-    /* the bucket that will be used to store key-value data. */
-    ENTRY_INFO **table;
+    /* the bucket that will be used to store key-value data, 
+     * table[1] is only used while rehashing from table[0]. */
+    ENTRY_INFO **table[2];
+    long capacity[2];  /* capacity of the buckets, must be Nth power of 2. */
+    long rehashIndex;  /* next bucket of table[0] to migrate, -1 if not rehashing. */
     int size; /* indicate the size of current stored data. */
-    int capacity;  /* capacity of the buckets, must be Nth power of 2. */
+    int minCapacity;   /* the map never shrinks below its initial capacity. */
 };
 
-/* it is a non safe iterator, and only hashMapNext()
+/* it is a non safe iterator, and only hashMapNext() and lookups
  * should be called while iterating. */
 typedef struct HASH_MAP_ITERATOR {
     HASH_MAP *map;
-    int index;
+    int table;
+    long index;
     ENTRY_INFO *entry, *nextEntry;
 } HASH_MAP_ITERATOR;
 typedef struct HASH_MAP_ITERATOR HASH_MAP_ITERATOR;
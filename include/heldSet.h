@@ -0,0 +1,93 @@
+/**
+ * @file    heldSet.h
+ * @author  qufeiyan
+ * @brief   the mutexes held by a thread, kept by the hooks of the thread itself.
+ * @version 1.0.0
+ * @date    2026/10/19 01:48:26
+ * @version Copyright (c) 2026
+ */
+
+/* Define to prevent recursive inclusion ---------------------------------------------------*/
+#ifndef HELDSET_H
+#define HELDSET_H
+/* Include ---------------------------------------------------------------------------------*/
+#include <stddef.h>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SIZE_OF_HELD_SET        (16)    //! mutexes held in a row that are searched.
+
+/**
+ * @brief the mutexes held by a thread in the order they were locked, the last one locked
+ *        is on top. A mutex locked beyond the set is only counted, so that its unlock
+ *        isn't taken for the unlock of a mutex not held.
+ */
+struct heldSet{
+    size_t mid[SIZE_OF_HELD_SET] __attribute__((aligned(16)));
+    uint32_t count;         //! mutexes in the set.
+    uint32_t overflow;      //! mutexes held beyond the set.
+};
+typedef struct heldSet heldSet_t;
+
+/**
+ * @brief the slot of the mutex locked last, -1 if the thread doesn't hold it.
+ * @note  the mutex unlocked is mostly the one locked last, on top. The rest of the set
+ *        is searched four slots at a time, two of them in each 128-bit compare.
+ */
+static inline int heldSetFind(const heldSet_t *set, size_t mid){
+    int top = (int)set->count - 1;
+    uint32_t mask;
+
+    if(top >= 0 && set->mid[top] == mid){
+        return top;
+    }
+#if defined(__SSE2__) && defined(__x86_64__)
+    __m128i key = _mm_set1_epi64x((long long)mid), lo, hi;
+
+    for(int i = top & ~3; i >= 0; i -= 4){
+        lo = _mm_cmpeq_epi32(_mm_load_si128((const __m128i *)&set->mid[i]), key);
+        hi = _mm_cmpeq_epi32(_mm_load_si128((const __m128i *)&set->mid[i + 2]), key);
+        //! a slot is equal if both of its halves are.
+        lo = _mm_and_si128(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+        hi = _mm_and_si128(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 3, 0, 1)));
+        mask = _mm_movemask_pd(_mm_castsi128_pd(lo)) |
+            _mm_movemask_pd(_mm_castsi128_pd(hi)) << 2;
+        //! the slots above top are stale.
+        mask &= (2u << (top - i)) - 1;
+        if(mask != 0){
+            return 31 - __builtin_clz(mask) + i;
+        }
+    }
+#else
+    for(int i = top; i >= 0; i--){
+        mask = set->mid[i] == mid;
+        if(mask != 0){
+            return i;
+        }
+    }
+#endif
+    return -1;
+}
+
+static inline void heldSetPush(heldSet_t *set, size_t mid){
+    if(set->count == SIZE_OF_HELD_SET){
+        set->overflow++;
+        return;
+    }
+    set->mid[set->count++] = mid;
+}
+
+void heldSetRemove(heldSet_t *set, int slot);
+void heldSetPrint(const heldSet_t *set, const char *prefix);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	//  HELDSET_H
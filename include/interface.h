@@ -1,12 +1,86 @@
 #ifndef __INTERFACE_H_
 #define __INTERFACE_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief how the arenas of the checker are backed by huge pages.
+ */
+typedef enum{
+    DLC_HUGEPAGE_NONE,
+    DLC_HUGEPAGE_TRANSPARENT,   //! advised with MADV_HUGEPAGE.
+    DLC_HUGEPAGE_EXPLICIT       //! MAP_HUGETLB, transparent if none is reserved.
+}dlcHugePages_t;
+
+/**
+ * @brief configuration of the dlchecker, a field of 0 takes the default.
+ * @note  the limits of threads and mutexes are soft, the checker keeps tracking
+ *        beyond them and warns once. Only memoryLimit fails allocations, events
+ *        which can't be tracked any more are dropped then.
+ *        mutexMemoryLimit bounds the vertices of mutexes, the vertices of mutexes
+ *        neither held nor waited for are evicted to stay below it, the least
+ *        recently touched first, and are tracked again once their mutexes are.
+ */
+typedef struct dlcConfig{
+    int level;                  //! log level [1:error 2:warn 3:info: 4:debug]
+    uint32_t threads;           //! threads expected to be tracked.
+    uint32_t mutexes;           //! mutexes expected to be tracked.
+    size_t memoryLimit;         //! memory mapped beyond the arenas, uint:byte.
+    uint32_t checkWorkers;      //! workers searching large graphs for deadlocks, 1 keeps it serial.
+    uint32_t parallelVertices;  //! live vertices from which the search goes parallel.
+    size_t mutexMemoryLimit;    //! memory of the vertices of mutexes, uint:byte, 0 for no limit.
+    size_t heapSize;            //! arena of the internal heap, uint:byte.
+    size_t poolArenaSize;       //! arena of the first slabs of the pools, uint:byte.
+    dlcHugePages_t hugePages;   //! huge pages of both arenas.
+    const char *persistDir;     //! directory the graph is kept in for dlc-inspect, e.g. /dev/shm.
+    int lockOrder;              //! report the mutexes locked in both orders, before they deadlock.
+}dlcConfig_t;
+
+/**
+ * @brief the reason why the checker chose its current period.
+ */
+typedef enum{
+    DLC_PERIOD_BASELINE,    //! threads are waiting, but not for long.
+    DLC_PERIOD_QUIESCENT,   //! no event and no waiting thread, backing off.
+    DLC_PERIOD_WAKEUP,      //! a thread started waiting while backed off.
+    DLC_PERIOD_LONG_WAIT,   //! the oldest wait is growing long, tightening.
+    DLC_PERIOD_QUEUE_LAG,   //! the event queues are filling up, draining first.
+    DLC_PERIOD_DEADLOCK,    //! a deadlock is being reported, no need to hurry.
+    DLC_PERIOD_BUTT
+}dlcPeriodReason_t;
+
+/**
+ * @brief metrics of the checker, refreshed on every detection pass.
+ */
+typedef struct dlcCheckerMetrics{
+    uint32_t periodMs;          //! current detection period.
+    uint32_t gcPeriodMs;        //! current period of garbage collection.
+    uint32_t drainWaitMs;       //! current upper bound of sleeping between two drains.
+    dlcPeriodReason_t reason;   //! why periodMs was chosen.
+    uint32_t waitingThreads;    //! threads waiting for a lock at the last pass.
+    uint64_t oldestWaitMs;      //! age of the oldest wait edge at the last pass.
+    uint32_t queueFillPercent;  //! highest fill level of event queues since the last pass.
+    uint64_t events;            //! events processed since the last pass.
+    uint64_t checks;            //! detection passes so far.
+    uint64_t deadlocks;         //! passes which found a deadlock so far.
+    uint32_t mutexVertices;     //! vertices of mutexes resident at the last pass.
+    uint64_t evictions;         //! vertices of mutexes evicted so far.
+    size_t graphBytes;          //! memory mapped for the vertices at the last pass.
+}dlcCheckerMetrics_t;
+
 /**
  * @brief init the dlchecker.
  * @param set log level [1:error 2:warn 3:info: 4:debug] 
  */ 
 void initDeadlockChecker(int level);
 
+/**
+ * @brief init the dlchecker with a configuration.
+ * @param config the configuration, see dlcConfig_t.
+ */ 
+void initDeadlockCheckerEx(const dlcConfig_t *config);
+
 /**
  * @brief create dlc filter.
  * @param list  a set of mutex lock to be filter.
@@ -27,6 +101,18 @@ int isFilter(void *arg);
  */ 
 void dlcFilterDestroy(void);
 
+/**
+ * @brief take a snapshot of the checker metrics.
+ * @param metrics [out] the snapshot.
+ * @note  the checker keeps running meanwhile, fields may come from adjacent passes.
+ */ 
+void dlcGetCheckerMetrics(dlcCheckerMetrics_t *metrics);
+
+/**
+ * @brief the printable name of a period reason.
+ */ 
+const char *dlcPeriodReasonName(dlcPeriodReason_t reason);
+
 
 #endif
 
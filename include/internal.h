@@ -17,7 +17,9 @@
 #include "mempool.h"
 #include "spinlock.h"
 #include "vertex.h"
-#include "hashMap.h"
+#include "flatMap.h"
+#include "shadow.h"
+#include "mem.h"
 #include <signal.h>
 
 #ifdef __cplusplus
@@ -35,18 +37,18 @@ extern "C" {
 
 #define SIZE_OF_NAME                    (16)
 
-#define SIZE_OF_VERTEX_THREAD           (sizeof(vertex_t) + sizeof(threadInfo_t))       
-#define SIZE_OF_VERTEX_MUTEX            (sizeof(vertex_t) + sizeof(mutexInfo_t))
 #define NUMBER_OF_VERTEX_THREAD         NUMBER_OF_THREAD
 #define NUMBER_OF_VERTEX_MUTEX          NUMBER_OF_THREAD
 #define NUMBER_OF_VERTEX                (NUMBER_OF_VERTEX_THREAD + NUMBER_OF_VERTEX_MUTEX)
-#define NUMBER_OF_ARC                   (NUMBER_OF_THREAD * 2)
-#define SIZE_OF_ARC                     (sizeof(arc_t))
+
+#define SIZE_OF_MEMPOOL_SLAB            (1 << 18)   //! size of a slab mapped by a growing pool.
 
 enum eventType{
     EVENT_WAITLOCK,
     EVENT_HOLDLOCK,
     EVENT_RELEASELOCK,
+    EVENT_DESTROYLOCK,
+    EVENT_LOCKORDER,        //! a mutex is locked while another one is held.
     EVENT_BUTT
 };
 typedef enum eventType eventType_t;
@@ -55,6 +57,7 @@ struct event{
     eventType_t     type;
     threadInfo_t    threadInfo;
     mutexInfo_t     mutexInfo;
+    mutexInfo_t     heldInfo;   //! the mutex held while mutexInfo is locked, EVENT_LOCKORDER.
 };
 typedef struct event event_t;
 
@@ -67,49 +70,28 @@ struct dispatcher{
     long threadCount;     //! record current thread count. 
     size_t tid;           //! thread id.  
     eventQueue_t* eq;     //! messageQueue object for a thread.
-    int (*invoke)(struct dispatcher *);     //! dispatch a thread's event to specific event queue.  
     event_t ev;           //! event to be dispatched.
 };
 
-typedef struct HASH_MAP hashMap_t;
-typedef struct ENTRY_INFO entry_t;
-typedef struct HASH_MAP_ITERATOR hashMapIterator_t;
 typedef struct dispatcher dispatcher_t;
 
-extern __thread dispatcher_t dispatcher; //! define thread local dispatcher for each thread.
-extern hashMap_t *eventQueueMap;  //! record all eventqueue for each thread.
-extern hashMap_t *vertexThreadMap, *vertexMutexMap;
-extern hashMap_t *requestThreadMap;
-extern hashMap_t *residentThreadMap;  //! record resident threads.
+extern __thread dispatcher_t dispatcher __tlsInitialExec; //! define thread local dispatcher for each thread.
+extern flatMap_t *eventQueueMap;  //! record all eventqueue for each thread.
+extern flatMap_t *vertexThreadMap, *vertexMutexMap;
+extern shadowMap_t mutexShadowMap;  //! mutex vertices indexed by the address of mutex.
+extern flatMap_t *requestThreadMap;
+extern flatMap_t *residentThreadMap;  //! record resident threads.
+extern bool isEnabledLockOrder;     //! indicates whether to record the lock order.
+extern flatMap_t *lockOrderMap;     //! the acquisition of each order arc.
 
 //! get eventqueue memory frome pool.
-extern memPool_t *eventQueueMemPool, *eventQueueBufferMemPool;
-//! memory pool for vertex.
-extern memPool_t *threadVertexMemPool, *mutexVertexMemPool;
-//! memory pool for arc.
-extern memPool_t *arcMemPool;
+extern memPool_t *eventQueueMemPools[NUMBER_OF_NUMA_NODES];  //! indexed by NUMA node.
+extern memPool_t *eventQueueBufferMemPools[NUMBER_OF_NUMA_NODES];
 
-extern spinlock_t eventQueueMemPoolLock, eventQueueBufferMemPoolLock;
 extern atomic_long atomicThreadCounts;
 extern spinlock_t eventQueueMapLock;
 
 
-static inline void hashMapIteratorInit(hashMapIterator_t *iter, hashMap_t *map){
-    assert(iter != NULL && map != NULL);
-    iter->map = map;
-    iter->index = -1;
-    iter->entry = NULL;
-    iter->nextEntry = NULL;
-}
-
-#define hashMapIteratorReset(iter) do{\
-    hashMapIterator_t *_iter = (typeof(iter)) iter;\
-    assert(iter != NULL);\
-    _iter->index = -1;\
-    _iter->entry = NULL;\
-    _iter->nextEntry = NULL;\
-}while(0)
-
 #define eventQueueInit(eq, buffer)({\
     assert(eq && buffer);\
     lfqueueInit(eq, buffer, NUMBER_OF_EVENT, SIZE_OF_EVENT);\
@@ -117,8 +99,8 @@ static inline void hashMapIteratorInit(hashMapIterator_t *iter, hashMap_t *map){
 
 #define eventQueueDeInit(eq)({\
     assert(eq && ((eventQueue_t *)eq)->buffer);\
-    memPoolFreeLocked(eventQueueBufferMemPool, eq->buffer, &eventQueueBufferMemPoolLock);\
-    memPoolFreeLocked(eventQueueMemPool, eq, &eventQueueMemPoolLock);\
+    memPoolFreeShared(memPoolOwner(eq->buffer), eq->buffer);\
+    memPoolFreeShared(memPoolOwner(eq), eq);\
 })
 
 #define eventQueuePut(eq, ev) ({\
@@ -156,21 +138,40 @@ static inline eventQueue_t *eventQueueCurrent(){
     return dispatcher.eq;
 }
 
-#define hashMapInitLocked(type, capacity, lock) ({\
+/**
+ * @brief   dispatch the event of a thread to its event queue.
+ * @return  1 if it's put, 0 if the thread isn't dispatched, e.g. the memory pools were
+ *          exhausted when it was first dispatched, its events are not tracked then.
+ */
+static inline int dispatcherInvoke(dispatcher_t *dispatcher){
+    int ret = 0;
+    assert(NULL != dispatcher);
+
+    if(NULL == dispatcher->eq){
+        return ret;
+    }
+    assert(-1 != dispatcher->threadCount);
+
+    ret = eventQueuePut(dispatcher->eq, &dispatcher->ev);
+    assert(ret == 1); //! ret = 1 means put opretion is successful.
+    return ret;
+}
+
+#define flatMapInitLocked(capacity, lock) ({\
     spinlock_t *_lock = (typeof(lock)) lock;\
-    hashMap_t *map;\
-    map = hashMapCreate(type, capacity);\
+    flatMap_t *map;\
+    map = flatMapCreate(capacity);\
     spinlockInit(_lock, 2048); \
-    (void *)map;\
+    map;\
 })
 
-#define hashMapPutLocked(map, key, val, lock) ({\
+#define flatMapPutLocked(map, key, val, lock) ({\
     int ret;\
     spinlock_t *_lock = (typeof(lock))lock;\
     assert(_lock != NULL);  \
-    _lock->acquire(_lock);  \
-    ret = hashMapPut(map, key, val); \
-    _lock->release(_lock);  \
+    spinlockAcquire(_lock);  \
+    ret = flatMapPut(map, key, val); \
+    spinlockRelease(_lock);  \
     ret;\
 })
 
@@ -178,11 +179,11 @@ static inline eventQueue_t *eventQueueCurrent(){
     int ret;\
     spinlock_t *_lock = (typeof(lock))lock;\
     assert(_lock != NULL);  \
-    _lock->acquire(_lock);  \
+    spinlockAcquire(_lock);  \
     atomicThreadCounts++;   \
     dispatcher.threadCount = atomicThreadCounts;\
-    ret = hashMapPut(eventQueueMap, (void *)dispatcher.tid, dispatcher.eq); \
-    _lock->release(_lock);  \
+    ret = flatMapPut(eventQueueMap, dispatcher.tid, dispatcher.eq); \
+    spinlockRelease(_lock);  \
     ret;\
 })
 
@@ -192,12 +193,25 @@ size_t dlcGetThreadId(void);
 //! initial function.
 void mapAllInit();
 void memPoolAllInit();
+struct dlcConfig;
+void memPoolAllLimit(const struct dlcConfig *config);
 void dispatcherInit(dispatcher_t *dispatch);
 long long timeInMilliseconds(void);
 
 //！garbage collection.
 typedef void (*gcCallback_t)(void *arg);
 void gcDestroyedThreads(const pid_t pid, gcCallback_t cb);
+void gcForThread(void *args);
+
+//! adaptive cadence of the checker.
+struct dlcTimer;
+void checkPeriodInit(struct dlcTimer *check, struct dlcTimer *gc);
+void checkPeriodObserve(uint32_t drained, uint32_t fillPercent);
+void checkPeriodAdjust(int deadlocks);
+uint32_t checkPeriodDrainWait(void);
+
+//! parallel search of deadlocks on large graphs.
+void sscParallelConfigure(uint32_t workers, uint32_t threshold);
 
 #ifdef LOG_COLOR_OPEN   
 #define LOG_COLOR_START  LOG_COLOR_GREEN
@@ -207,18 +221,18 @@ void gcDestroyedThreads(const pid_t pid, gcCallback_t cb);
 #define LOG_COLOR_END    
 #endif
 static inline void eventQueuesInfo(){
-    hashMapIterator_t iter;
-    entry_t *entry;
+    flatMapIterator_t iter;
+    flatMapEntry_t *entry;
     long tc;
     eventQueue_t *eq;
     assert(eventQueueMap);
 
-    hashMapIteratorInit(&iter, eventQueueMap); 
-    fprintf(stderr, LOG_COLOR_START "\n--->>--------Event Queue Map, size: %d, total threads: %ld--------<<---\n" \
-        LOG_COLOR_END, eventQueueMap->size, atomicThreadCounts);
+    flatMapIteratorInit(&iter, eventQueueMap); 
+    fprintf(stderr, LOG_COLOR_START "\n--->>--------Event Queue Map, size: %lu, total threads: %ld--------<<---\n" \
+        LOG_COLOR_END, flatMapSize(eventQueueMap), atomicThreadCounts);
     fprintf(stderr, LOG_COLOR_START "%3s \t %20s \t %20s \t %5s \t %5s \t %5s \t %5s\n" \
         LOG_COLOR_END, "tc", "queue", "buffer", "size", "esize", "in", "out");
-    while((entry = hashMapNext(&iter)) != NULL){  
+    while((entry = flatMapNext(&iter)) != NULL){  
         tc = (long)entry->key;
         eq = entry->value;
         fprintf(stderr, LOG_COLOR_START "%3ld \t %20p \t %20p \t %5d \t %5d \t %5d \t %5d\n" \
@@ -0,0 +1,50 @@
+/**
+ * @file    log.h
+ * @author  qufeiyan
+ * @brief   binary log, the messages of a thread are queued and printed by a drainer.
+ * @version 1.0.0
+ * @date    2026/10/19 01:05:12
+ * @version Copyright (c) 2026
+ */
+
+/* Define to prevent recursive inclusion ---------------------------------------------------*/
+#ifndef LOG_H
+#define LOG_H
+/* Include ---------------------------------------------------------------------------------*/
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DLC_LOG_ARGS            (8)     //! arguments of a message queued, at most.
+#define DLC_LOG_UNPARSED        (-1)    //! the format of the site isn't parsed yet.
+#define DLC_LOG_UNQUEUED        (-2)    //! the message is printed by its thread.
+
+/**
+ * @brief a call of dlc_info() and the like. The site is the id of the message queued,
+ *        the drainer formats it from the site and the arguments of the call.
+ */
+typedef struct dlcLogSite{
+    const char *prefix;         //! color and tag, e.g. "[DLC_INFO ".
+    const char *file;
+    const char *func;
+    const char *format;
+    int line;
+    _Atomic int nargs;          //! DLC_LOG_xxx until the format is parsed.
+    uint8_t types[DLC_LOG_ARGS];
+}dlcLogSite_t;
+
+#define DLC_LOG_SITE(prefix, format) \
+    {prefix, __FILE__, __FUNCTION__, format, __LINE__, DLC_LOG_UNPARSED, {0}}
+
+void dlcLogWrite(dlcLogSite_t *site, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+void dlcLogStart(void);
+void dlcLogFlush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	//  LOG_H
@@ -13,6 +13,7 @@
 /* Include ---------------------------------------------------------------------------------*/
 
 #include <stddef.h>
+#include "interface.h"
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -20,6 +21,8 @@ extern "C" {
 //! small malloc.
 /*------------- mem --------------*/
 void memInit(void);
+void memConfigure(size_t size, dlcHugePages_t hugePages);
+void *memArenaReserve(size_t size, dlcHugePages_t hugePages);
 void* memAlloc(size_t size);
 void * memCalloc(size_t count, size_t size);
 void memFree(void* ptr);
@@ -13,6 +13,7 @@
 /* Include ---------------------------------------------------------------------------------*/
 #include "dlcDef.h"
 #include "spinlock.h"
+#include "interface.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -24,62 +25,26 @@ memPool_t *memPoolDefine(char* name, size_t block_count, size_t block_size);
 void *memPoolAlloc(memPool_t *mp);
 void memPoolFree(memPool_t *mp, void *ptr);
 void memPoolPrint(memPool_t *mp);
-
-
-/**
- * @brief  memPoolLockedDefine - macro to define and initialize a locked 
- *         memory pool
- * @param  name the name of the memPool.    
- * @param  block_count the count of memory block of the memPool.    
- * @param  block_size  the size of memory block of the memPool.  
- * @param  lock pointer to the spinlock.
- * @return  the memPool object which is created.
- * @note   the memPool object is a static memPool.
- *
- * Note: the macro can be used for global and local fifo data type variables.
- */
-#define memPoolLockedDefine(name, block_count, block_size, lock) ({ \
-    spinlock_t *_lock = (typeof(lock)) lock;\
-    memPool_t *mp;\
-    mp = memPoolDefine(name, block_count, block_size);\
-    spinlockInit(_lock, 2048); \
-    mp;\
-})
-
-/**
- * @brief   memPoolAllocLocked - macro to allocate a block of memory from a
- *          locked memory pool.
- * @param   mp is pointer to a memory pool.
- * @param   lock is pointer to a spinlock. 
- * @return  pointer to a block of memory.
- * @note    
- * @see     
- */
-#define memPoolAllocLocked(mp, lock) ({ \
-    void *res;\
-    spinlock_t *_lock = (typeof(lock)) lock;\
-    assert(_lock != NULL);  \
-    _lock->acquire(_lock);  \
-    res = memPoolAlloc(mp); \
-    _lock->release(_lock);  \
-    if(!res) memPoolInfo(mp);\
-    res;\
-})
-
-/**
- * @brief   memPoolFreeLocked - macro to free a block of memory to a 
- *          memory pool.          
- * @param   mp is pointer to a memory pool.
- * @param   ptr is pointer to a memory block.
- * @param   lock is pointer to a spinlock.
- */
-#define memPoolFreeLocked(mp, ptr, lock) ({  \
-    spinlock_t *_lock = (typeof(lock)) lock;\
-    assert(_lock != NULL);  \
-    _lock->acquire(_lock);  \
-    memPoolFree(mp, ptr);   \
-    _lock->release(_lock);  \
-})
+void memPoolSetLimit(memPool_t *mp, size_t block_count);
+void memPoolSetMemoryLimit(size_t size);
+void memPoolConfigure(size_t size, dlcHugePages_t hugePages);
+
+//! NUMA placement, a single node 0 without NUMA support.
+int memNumaNodes(void);
+int memNumaNode(void);
+void memNumaBind(void *addr, size_t size, int node);
+err_t memPoolCharge(size_t size);
+void memPoolRefund(size_t size);
+void memPoolPrintStats(const char *name, int32_t err, int32_t slabs, size_t size, 
+    size_t avail, size_t used, size_t max);
+
+//! pools shared by all threads.
+memPool_t *memPoolSharedDefine(char* name, size_t block_count, size_t block_size);
+memPool_t *memPoolNodeDefine(char* name, size_t block_count, size_t block_size, int node);
+memPool_t *memPoolOwner(void *ptr);
+void *memPoolAllocShared(memPool_t *mp);
+void memPoolFreeShared(memPool_t *mp, void *ptr);
+void memPoolDrain(memPool_t *mp);
 
 
 #define memPoolInfo(mp) ({\
@@ -0,0 +1,109 @@
+/**
+ * @file    shadow.h
+ * @author  qufeiyan
+ * @brief   direct-mapped shadow table indexed by user addresses.
+ * @version 1.0.0
+ * @date    2026/10/18 19:02:37
+ * @version Copyright (c) 2026
+ */
+
+/* Define to prevent recursive inclusion ---------------------------------------------------*/
+#ifndef SHADOW_H
+#define SHADOW_H
+/* Include ---------------------------------------------------------------------------------*/
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "dlcDef.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHADOW_APP_BITS         (47)    //! user address space covered by the shadow.
+#define SHADOW_GRANULE_SHIFT    (5)     //! a slot per 32 bytes, less than sizeof(pthread_mutex_t).
+#define SHADOW_SLOT_SHIFT       (3)     //! a slot holds a pointer.
+#define SIZE_OF_SHADOW          ((size_t)1 << (SHADOW_APP_BITS - SHADOW_GRANULE_SHIFT + SHADOW_SLOT_SHIFT))
+#define SIZE_OF_SHADOW_GENERATIONS  (SIZE_OF_SHADOW >> SHADOW_SLOT_SHIFT << 2)
+
+/**
+ * @note The slot of an address is found by shift-and-offset, as the shadow memory of
+ *       sanitizers. The whole table is reserved with MAP_NORESERVE, a page of it is only
+ *       backed by memory once a slot in it is set, and handed back once its slots are
+ *       all cleared again.
+ *
+ *       user address:  |<------------ 47 bits ------------>|
+ *                      addr >> 5 = index of the slot
+ *       shadow:        slots[index] = value
+ *       generations:   generations[index] = lives of the objects at the address
+ *
+ *       The generation of a slot is bumped by the threads of the application when the
+ *       object at the address starts or ends a life, e.g. a mutex is initialised or
+ *       destroyed, so that the owner of the map tells the lives apart. A page of the
+ *       generations is backed once a generation in it is bumped, and is never handed
+ *       back, it takes 4 bytes per 32 bytes of addresses of such objects.
+ */
+typedef struct shadowMap{
+    char name[DLC_NAME_SIZE];   //! name of the shadow map.
+    void **slots;               //! the reservation, NULL if it can't be reserved.
+    uint16_t *refs;             //! live slots of each page of the reservation.
+    _Atomic uint32_t *generations;  //! generation of each slot, NULL if it can't be reserved.
+    size_t pageShift;
+
+    int32_t err;                //! times a page can't be committed.
+    int32_t pages;              //! pages committed.
+    size_t spare;               //! a page emptied but kept committed, plus 1, 0 if none.
+    size_t used;                //! live slots.
+    size_t max;                 //! peak of memory committed.
+}shadowMap_t;
+
+
+/*--=-=-=-=-=-- shadow map interface -=-=-=-=-=-=-=-*/
+err_t shadowMapInit(shadowMap_t *map, const char *name);
+void shadowMapDeInit(shadowMap_t *map);
+err_t shadowMapSet(shadowMap_t *map, size_t addr, void *value);
+void shadowMapClear(shadowMap_t *map, size_t addr);
+void shadowMapPrint(shadowMap_t *map);
+
+/**
+ * @brief whether the address has a slot in the shadow map.
+ */
+static inline bool shadowMapCovers(shadowMap_t *map, size_t addr){
+    return map->slots != NULL && (addr >> SHADOW_APP_BITS) == 0;
+}
+
+/**
+ * @brief get the generation of the slot of a address, 0 if it has never been bumped.
+ */
+static inline uint32_t shadowMapGeneration(shadowMap_t *map, size_t addr){
+    if(!shadowMapCovers(map, addr) || map->generations == NULL) return 0;
+    return atomic_load_explicit(&map->generations[addr >> SHADOW_GRANULE_SHIFT],
+        memory_order_relaxed);
+}
+
+/**
+ * @brief bump the generation of the slot of a address.
+ * @return the new generation.
+ * @note  it may be called by any thread.
+ */
+static inline uint32_t shadowMapNextGeneration(shadowMap_t *map, size_t addr){
+    if(!shadowMapCovers(map, addr) || map->generations == NULL) return 0;
+    return atomic_fetch_add_explicit(&map->generations[addr >> SHADOW_GRANULE_SHIFT], 1,
+        memory_order_relaxed) + 1;
+}
+
+/**
+ * @brief get the value of the slot of a address.
+ * @return the value, NULL if the slot is empty or the address isn't covered.
+ * @note  a single load, the page is the shared zero page if nothing is set in it.
+ */
+static inline void *shadowMapGet(shadowMap_t *map, size_t addr){
+    if(!shadowMapCovers(map, addr)) return NULL;
+    return map->slots[addr >> SHADOW_GRANULE_SHIFT];
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	//  SHADOW_H
@@ -18,60 +18,76 @@
 extern "C" {
 #endif
 
-#ifndef __sevl
-#define __sevl() __asm__ volatile("sevl");
-#endif
-
-#ifndef __wfe
-#define __wfe()  __asm__ volatile("wfe":::"memory") 
-#endif
-
 #ifndef __prefetchw
 #define __prefetchw(addr) __builtin_prefetch(addr, 1) 
 #endif
 
-#ifndef __nop
-#define __nop __asm__ volatile("nop")
+//! tell the cpu the thread is spinning, so that it yields to its sibling thread.
+#ifndef __cpuRelax
+#if defined(__x86_64__) || defined(__i386__)
+#define __cpuRelax()  __asm__ volatile("pause" ::: "memory")
+#elif defined(__aarch64__) || defined(__arm__)
+#define __cpuRelax()  __asm__ volatile("yield" ::: "memory")
+#else
+#define __cpuRelax()  __asm__ volatile("" ::: "memory")
 #endif
-
-#ifndef __doSpins
-#define __doSpins(times) do{    \
-    __asm__ volatile(           \
-        ".rept " #times "\n"    \
-        "nop\n"                 \
-        ".endr\n"               \
-    );                          \
-}while(0)
 #endif
 
-#ifndef __yield
-#define __yield()  do{\
-    __asm__ volatile( \
-        "yield"       \
-    );                \
-}while(0)
-#endif
+/**
+ * @brief a queued spinlock. The waiters queue up on nodes of their own, each spins on
+ *        its own node, and a waiter sleeps on a futex once it has spun for long.
+ */
+struct spinNode{
+    struct spinNode *_Atomic next;
+    _Atomic uint32_t wait;          //! SPIN_WAIT_xxx.
+};
 
 struct spinlock{
-    union{
-        atomic_flag lock;
-        struct{
-            uint16_t current;
-            uint16_t next;
-        } ticket;  
-    };
-    
-    uint32_t spin;
+    _Atomic uint32_t locked;        //! SPIN_xxx.
+    struct spinNode *_Atomic tail;  //! the last waiter queued, NULL if none.
+
+    uint32_t spin;                  //! spins of a waiter before it sleeps.
     void (*acquire)(struct spinlock *);
     void (*release)(struct spinlock *);
 };
 
+//! a lock defined statically, spinlockInit() must be called before it's used.
+#define SPINLOCK_INITIALIZER    {.locked = 0, .tail = NULL}
+
+enum{
+    SPIN_UNLOCKED,
+    SPIN_LOCKED,
+    SPIN_LOCKED_SLEEPERS,           //! locked, and the head of the queue may sleep.
+};
+
 typedef struct spinlock spinlock_t;
 __weak void __lock(spinlock_t *spinlock);
 __weak void __unlock(spinlock_t *spinlock);
+void __spinlockWake(spinlock_t *spinlock);
 
 void spinlockInit(spinlock_t *spinlock, int32_t spin);
 
+/**
+ * @brief take the lock, the lock word is taken inline if it's free, __lock() queues up
+ *        otherwise. acquire and release of the lock are the same functions, they are
+ *        kept for the lock to be passed around, e.g. to flatMapPutLocked().
+ */
+static inline void spinlockAcquire(spinlock_t *spinlock){
+    uint32_t expected = SPIN_UNLOCKED;
+
+    if(!atomic_compare_exchange_strong_explicit(&spinlock->locked, &expected,
+        SPIN_LOCKED, memory_order_acquire, memory_order_relaxed)){
+        __lock(spinlock);
+    }
+}
+
+static inline void spinlockRelease(spinlock_t *spinlock){
+    if(atomic_exchange_explicit(&spinlock->locked, SPIN_UNLOCKED, memory_order_release)
+        == SPIN_LOCKED_SLEEPERS){
+        __spinlockWake(spinlock);
+    }
+}
+
 
 #ifdef __cplusplus
 }
@@ -20,4 +20,22 @@ extern int __test_num;
     } \
 } while(0)
 
+long long timeInMilliseconds(void);
+
+int hashMapTest(int argc, char **argv, int flags);
+int flatMapTest(int argc, char **argv, int flags);
+int shadowTest(int argc, char **argv, int flags);
+int sccTest(int argc, char **argv, int flags);
+int retireTest(int argc, char **argv, int flags);
+int memPoolTest(int argc, char **argv, int flags);
+int numaTest(int argc, char **argv, int flags);
+int memTest(int argc, char **argv, int flags);
+int spinlockTest(int argc, char **argv, int flags);
+int heldSetTest(int argc, char **argv, int flags);
+int timerTest(int argc, char **argv, int flags);
+int periodTest(int argc, char **argv, int flags);
+int logTest(int argc, char **argv, int flags);
+int relockTest(int argc, char **argv, int flags);
+int lockOrderTest(int argc, char **argv, int flags);
+
 #endif
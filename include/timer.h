@@ -26,11 +26,14 @@ typedef void (*timerCallback_t)(void *);
 
 typedef struct dlcTimer{
     uint64_t period;
-    uint64_t whenMs;
+    uint64_t whenMs;            //! absolute expiry on the monotonic clock, uint:ms.
     timerCallback_t timerFunc;
     void *args;
     timerCycle_t cycle;
-    struct dlcTimer *next; 
+    uint16_t slot;              //! slot of the timing wheel the timer is linked into.
+    uint16_t flags;
+    struct dlcTimer *prev;      //! intrusive links of the slot list.
+    struct dlcTimer *next;
 }dlcTimer_t;
 
 typedef struct dlcTimerConfig{
@@ -43,7 +46,10 @@ typedef struct dlcTimerConfig{
 
 dlcTimer_t *dlcTimerCreate(dlcTimerConfig_t *config);
 void dlcTimerDestroy(dlcTimer_t *timer);
+void dlcTimerReset(dlcTimer_t *timer, uint64_t whenMs, uint64_t period);
 void dlcTimerProc(void);
+uint64_t dlcTimerNearest(void);
+void dlcTimerWait(uint64_t maxWaitMs);
 
 
 
@@ -51,4 +57,4 @@ void dlcTimerProc(void);
 }
 #endif
 
-#endif	//  __TIMER_H
\ No newline at end of file
+#endif	//  __TIMER_H
@@ -1,7 +1,7 @@
 /**
  * @file    vertex.h
  * @author  qufeiyan
- * @brief   
+ * @brief
  * @version 1.0.0
  * @date    2023/05/15 23:50:32
  * @version Copyright (c) 2023
@@ -13,92 +13,253 @@
 /* Include ---------------------------------------------------------------------------------*/
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include "common.h"
+#include "dlcDef.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-#undef SIZE_OF_NAME 
+#undef SIZE_OF_NAME
 #define SIZE_OF_NAME (16)
 
 enum vertexType{
     VERTEX_THREAD,
-    VERTEX_MUTEX
+    VERTEX_MUTEX,
+    VERTEX_BUTT
 };
 
 typedef enum vertexType vertexType_t;
 
+/**
+ * @brief mutex info.
+ */
+struct mutexInfo{
+    size_t mid; /* mutex id */
+    uint32_t generation;    /* life of the mutex at the address, see shadowMapGeneration() */
+};
 
-struct vertexOperation{
-    vertexType_t (*getType)();
-    int (*getIndegree)();
-    int (*getOutdegree)();
-
-    void (*addEdge)();
-    void (*deleteEdge)();
+typedef struct mutexInfo mutexInfo_t;
 
+struct threadInfo{
+    char name[SIZE_OF_NAME];
+    size_t tid; /* thread id */
+    void *backtrace[DEPTH_BACKTRACE];
 };
-typedef struct vertexOperation vertexOperation_t;
 
-struct arc{
-    struct vertex *tail;       //! pointer to the tail of a edge.
-    struct arc *next;   
+typedef struct threadInfo threadInfo_t;
+
+/**
+ * @brief a vertex is a 32-bit id, the top bit is its type, the rest is its slot in
+ *        the vertex set of the type. Slot 0 is never used, so that 0 means no vertex.
+ */
+typedef uint32_t vid_t;
+
+#define VID_NONE                (0)
+#define VID_TYPE_SHIFT          (31)
+#define VID_INDEX_MASK          (((vid_t)1 << VID_TYPE_SHIFT) - 1)
+
+#define vidType(vid)            ((vertexType_t)((vid) >> VID_TYPE_SHIFT))
+#define vidIndex(vid)           ((vid) & VID_INDEX_MASK)
+#define vidMake(type, index)    (((vid_t)(type) << VID_TYPE_SHIFT) | (vid_t)(index))
+
+#define SIZE_OF_ADJACENCY_INLINE    (2)
+
+/**
+ * @brief the generic arcs of a mutex to the holders other than its owner, a small vector.
+ *        They are only taken by multi-owner locks, and by a lock acquired again while
+ *        its owner never released it, e.g. it was released by other threads.
+ */
+struct adjacency{
+    uint16_t count;
+    uint16_t capacity;      //! 0 while the arcs are inline.
+    union{
+        vid_t inlined[SIZE_OF_ADJACENCY_INLINE];
+        vid_t *heap;
+    };
 };
-typedef struct arc arc_t;
+typedef struct adjacency adjacency_t;
 
-/** notes that vertex is abstract class and 
- *  must be implemented as a concrete subclass.
+/**
+ * @brief the vertices of a type, one dense array for each field, so that tarjan only
+ *        touches the cache lines of the fields it uses. The arrays of the fields of 
+ *        the other type are left unmapped.
+ *
+ *        A thread waits for one mutex at most, and a mutex has one owner, so the wait
+ *        and the ownership are a field of each vertex, and the mutexes held by a thread
+ *        are linked through the mutexes into a list:
+ *
+ *        thread:  waitingOn ---> mutex          held ---> m1 <--> m2 <--> m3
+ *        mutex:   owner -------> thread                   heldPrev / heldNext
  */
-struct vertex{
+struct vertexSet{
+    char name[DLC_NAME_SIZE];
     vertexType_t type;
-    struct {
-        short dfn;
-        short low;
+    uint32_t capacity;      //! slots of each array.
+    uint32_t top;           //! slots ever used, including slot 0.
+    uint32_t live;          //! vertices in use.
+    uint32_t max;           //! high-water mark of live.
+    uint32_t limit;         //! count of vertices beyond which a warning is issued.
+    uint32_t cap;           //! count of vertices never exceeded, 0 if unbounded.
+    uint32_t hand;          //! the slot the clock hand points to.
+    uint64_t evicted;       //! vertices evicted to stay below the cap or the memory limit.
+    uint32_t freeList;      //! the first free slot below top, 0 if none, linked through dfn.
+    int32_t err;
+    size_t size;            //! memory mapped for the arrays.
+    size_t infoSize;
 
-        bool inStack;
-    };
-    short indegree;
-    short outdegree;
-    arc_t *arcList;  
+    //! hot fields, the traversal state is only valid while epoch is the pass running.
+    uint32_t *epoch;
+    uint32_t *dfn;
+    uint32_t *low;
+    bool *inStack;
+    uint32_t *indegree;     //! wait edges into the vertex, a mutex may be waited by every thread.
 
-    vertexOperation_t *ops;
-    char private[0];
+    //! fields of threads.
+    vid_t *waitingOn;       //! the mutex waited for, VID_NONE if none.
+    vid_t *held;            //! the first mutex owned, VID_NONE if none.
+
+    //! fields of mutexes.
+    vid_t *owner;           //! the thread owning it, VID_NONE if none.
+    vid_t *heldNext;        //! the next and the previous mutex owned by the owner.
+    vid_t *heldPrev;
+    adjacency_t *adj;       //! the other holders, empty while there is no owner.
+    uint8_t *clock;         //! CLOCK_FREE, CLOCK_COLD or CLOCK_REFERENCED.
+    adjacency_t *order;     //! the mutexes locked while holding it, see lockOrderHandler().
+    adjacency_t *orderIn;   //! the mutexes held while locking it, the order arcs reversed.
+
+    //! cold field, threadInfo_t or mutexInfo_t.
+    uint8_t *info;
 };
-typedef struct vertex vertex_t;
+typedef struct vertexSet vertexSet_t;
 
 /**
- * @brief mutex info.
+ * @brief the state of a mutex vertex on the clock. A vertex is referenced whenever its
+ *        mutex is touched, and turns cold as the hand passes it. A cold vertex without
+ *        any arc is evicted, and is created again when its mutex is touched again.
  */
-struct mutexInfo{
-    size_t mid; /* mutex id */
+enum{
+    CLOCK_FREE,
+    CLOCK_COLD,
+    CLOCK_REFERENCED
 };
 
-typedef struct mutexInfo mutexInfo_t;
+typedef struct graph{
+    vertexSet_t set[VERTEX_BUTT];
+    uint32_t epoch;         //! the pass of traversal running, 0 is never used.
+}graph_t;
 
-struct threadInfo{
-    char name[SIZE_OF_NAME];
-    size_t tid; /* thread id */
-    void *backtrace[DEPTH_BACKTRACE];
-};
+extern graph_t graph;
 
-typedef struct threadInfo threadInfo_t;
+//! a field of a vertex, e.g. vertexField(v, dfn).
+#define vertexField(vid, field)  (graph.set[vidType(vid)].field[vidIndex(vid)])
+
+//! whether a vertex has been visited by the pass running.
+#define vertexVisited(vid)       (vertexField(vid, epoch) == graph.epoch)
+
+err_t graphInit(uint32_t threads, uint32_t mutexes);
+err_t graphPersist(const char *dir);
+void graphSync(void);
+err_t graphLoad(const char *path);
+void graphSetLimit(vertexType_t type, uint32_t count);
+void graphSetMemoryLimit(vertexType_t type, size_t size);
+void graphPrint(vertexType_t type);
+uint32_t graphNextEpoch(void);
+
+vid_t vertexCreate(vertexType_t type);
+void vertexDestroy(vid_t vertex);
+void vertexSetInfo(vid_t vertex, void *info);
+vid_t vertexClockVictim(vertexType_t type);
+
+void vertexWait(vid_t thread, vid_t mutex);
+err_t vertexUnwait(vid_t thread, vid_t mutex);  //! DLC_ERR if it isn't waiting for it.
+err_t vertexHold(vid_t mutex, vid_t thread);    //! DLC_ERR if the generic arcs can't grow.
+err_t vertexRelease(vid_t mutex, vid_t thread); //! DLC_ERR if it isn't held by it.
+
+//! generic arcs of multi-owner locks.
+int vertexAddEdge(vid_t u, vid_t v);    //! DLC_ERR if the arcs can't grow.
+int vertexDeleteEdge(vid_t u, vid_t v); //! DLC_ERR if there is no such edge.
+
+//! order arcs between mutexes, they aren't arcs of the wait-for graph.
+err_t vertexAddOrder(vid_t u, vid_t v);     //! DLC_ERR if the arcs can't grow.
+err_t vertexDeleteOrder(vid_t u, vid_t v);  //! DLC_ERR if there is no such arc.
+
+static inline vertexType_t vertexType(vid_t vertex){
+    return vidType(vertex);
+}
+
+static inline threadInfo_t *vertexThreadInfo(vid_t vertex){
+    return (threadInfo_t *)graph.set[VERTEX_THREAD].info + vidIndex(vertex);
+}
+
+static inline mutexInfo_t *vertexMutexInfo(vid_t vertex){
+    return (mutexInfo_t *)graph.set[VERTEX_MUTEX].info + vidIndex(vertex);
+}
 
+//! mark a mutex vertex as referenced, so that it isn't evicted by the next sweep.
+static inline void vertexTouch(vid_t vertex){
+    vertexField(vertex, clock) = CLOCK_REFERENCED;
+}
+
+static inline int vertexIndegree(vid_t vertex){
+    return vertexField(vertex, indegree);
+}
+
+static inline int vertexOutdegree(vid_t vertex){
+    if(vidType(vertex) == VERTEX_THREAD){
+        return vertexField(vertex, waitingOn) != VID_NONE;
+    }
+    return (vertexField(vertex, owner) != VID_NONE) + vertexField(vertex, adj).count;
+}
+
+/**
+ * @brief the generic arcs of a mutex.
+ * @note  the arcs move as the mutex gains arcs, don't keep them across vertexAddEdge().
+ */
+static inline vid_t *vertexArcs(vid_t vertex, int *count){
+    adjacency_t *adj = &vertexField(vertex, adj);
 
-vertex_t *vertexCreate(vertexType_t type, vertexOperation_t *ops);
-void vertexDestroy(vertexType_t type, vertex_t *vertex);
-void vertexSetInfo(vertex_t *vertex, void *info);
+    *count = adj->count;
+    return adj->capacity == 0 ? adj->inlined : adj->heap;
+}
+
+//! the order arcs of a mutex, they move as vertexArcs() do.
+static inline vid_t *vertexOrderArcs(vid_t vertex, int *count){
+    adjacency_t *adj = &vertexField(vertex, order);
+
+    *count = adj->count;
+    return adj->capacity == 0 ? adj->inlined : adj->heap;
+}
 
+//! the order arcs into a mutex, from the mutexes they start from.
+static inline vid_t *vertexOrderInArcs(vid_t vertex, int *count){
+    adjacency_t *adj = &vertexField(vertex, orderIn);
 
-arc_t *arcCreate(vertex_t *tail, arc_t *next);
-void arcDestroy(arc_t *arc);
+    *count = adj->count;
+    return adj->capacity == 0 ? adj->inlined : adj->heap;
+}
 
+/**
+ * @brief the i-th out arc of a vertex, i is below vertexOutdegree().
+ * @note  the first arc of a mutex is its owner, then the generic arcs follow.
+ */
+static inline vid_t vertexArc(vid_t vertex, int i){
+    vid_t *arcs;
+    int count;
 
-//! declaration for common operations.
-extern vertexOperation_t ops;
+    if(vidType(vertex) == VERTEX_THREAD){
+        return vertexField(vertex, waitingOn);
+    }
+    if(i == 0){
+        return vertexField(vertex, owner);
+    }
+    arcs = vertexArcs(vertex, &count);
+    return arcs[i - 1];
+}
 
 #ifdef __cplusplus
 }
 #endif
 
-#endif	//  VERTEX_H
\ No newline at end of file
+#endif	//  VERTEX_H
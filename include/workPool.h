@@ -0,0 +1,70 @@
+/**
+ * @file    workPool.h
+ * @author  qufeiyan
+ * @brief   small pool of worker threads running parallel loops with work stealing.
+ * @version 1.0.0
+ * @date    2026/10/18 21:40:12
+ * @version Copyright (c) 2026
+ */
+
+/* Define to prevent recursive inclusion ---------------------------------------------------*/
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+/* Include ---------------------------------------------------------------------------------*/
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "dlcDef.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NUMBER_OF_WORKER_MAX    (64)
+
+/**
+ * @brief a loop body, called with the range of items [begin, end) of a chunk.
+ */
+typedef void (*workPoolFunc_t)(void *arg, uint32_t begin, uint32_t end);
+
+/**
+ * @note Each worker owns a deque of the chunks of a loop, packed in a single word, so
+ *       that both ends move with one compare-and-swap. The owner takes chunks from the
+ *       head, and a worker whose deque runs dry steals from the tail of the others.
+ *
+ *       deque:  | head ........ tail |     owner -> head++, thief -> tail--
+ */
+typedef struct workDeque{
+    _Atomic uint64_t range;     //! head in the low half, tail in the high half.
+    struct workPool *pool;      //! the pool of the owner.
+    int id;                     //! the owner.
+    char pad[DLC_CACHE_LINE_SIZE - sizeof(uint64_t) - sizeof(void *) - sizeof(int)];
+}workDeque_t;
+
+typedef struct workPool{
+    int workers;                //! workers of the pool, including the caller of a loop.
+    pthread_t threads[NUMBER_OF_WORKER_MAX];
+    workDeque_t deques[NUMBER_OF_WORKER_MAX];
+
+    _Atomic uint32_t generation;    //! bumped to start a loop, the futex workers wait on.
+    atomic_int running;             //! workers still busy with the loop.
+    atomic_bool quit;
+
+    //! the loop running.
+    workPoolFunc_t func;
+    void *arg;
+    uint32_t count;
+    uint32_t grain;             //! items of a chunk.
+}workPool_t;
+
+
+/*--=-=-=-=-=-- work pool interface -=-=-=-=-=-=-=-*/
+workPool_t *workPoolCreate(int workers);
+void workPoolDestroy(workPool_t *pool);
+void workPoolFor(workPool_t *pool, uint32_t count, uint32_t grain, workPoolFunc_t func, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	//  WORKPOOL_H
@@ -0,0 +1,57 @@
+/**
+ * @file    inspect.c
+ * @author  qufeiyan
+ * @brief   dlc-inspect, search the graph kept by a killed process for deadlocks.
+ * @version 1.0.0
+ * @date    2026/10/18 23:41:07
+ * @version Copyright (c) 2026
+ */
+
+/* Includes --------------------------------------------------------------------------------*/
+#include <stdio.h>
+#include "common.h"
+#include "flatMap.h"
+#include "internal.h"
+#include "mem.h"
+#include "vertex.h"
+
+extern int strongConnectedComponent();
+
+/**
+ * @note The graph is kept in a file by a process whose DLC_PERSIST_DIR is set, see
+ *       graphPersist(). The threads waiting for a mutex when the process stopped are
+ *       searched, with the same search and report as the checker.
+ *
+ *       ./dlc-inspect /dev/shm/dlc-<pid>.graph
+ */
+int main(int argc, char **argv){
+    vertexSet_t *threads;
+    int waiting = 0, deadlocks;
+
+    if(argc != 2){
+        fprintf(stderr, "usage: %s <dir>/dlc-<pid>.graph\n", argv[0]);
+        return 2;
+    }
+
+    log_ctrl_level = LOG_CTRL_LEVEL_WARN;
+    memInit();
+    requestThreadMap = flatMapCreate(NUMBER_OF_THREAD);
+    if(graphLoad(argv[1]) != DLC_OK){
+        fprintf(stderr, "%s isn't a graph of this version of the checker\n", argv[1]);
+        return 2;
+    }
+
+    threads = &graph.set[VERTEX_THREAD];
+    for(uint32_t index = 1; index < threads->top; index++){
+        if(threads->waitingOn[index] != VID_NONE){
+            flatMapPut(requestThreadMap, vidMake(VERTEX_THREAD, index), NULL);
+            waiting++;
+        }
+    }
+
+    printf("%s: %u threads, %u mutexes, %d threads waiting\n", argv[1], threads->live,
+        graph.set[VERTEX_MUTEX].live, waiting);
+    deadlocks = strongConnectedComponent();
+    printf("%d deadlocks\n", deadlocks);
+    return deadlocks > 0 ? 1 : 0;
+}
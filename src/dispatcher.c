@@ -13,23 +13,11 @@
 #include "mempool.h"
 
 
-static int dispatcherInvoke(dispatcher_t *dispatcher){
-    int ret = 0;
-    assert(NULL != dispatcher && NULL != dispatcher->eq);
-    assert(-1 != dispatcher->threadCount);
-
-    ret = eventQueuePut(dispatcher->eq, &dispatcher->ev);
-    assert(ret == 1); //! ret = 1 means put opretion is successful.
-    return ret;
-}
-
-
-__thread dispatcher_t dispatcher = {
+__thread dispatcher_t dispatcher __tlsInitialExec = {
     .threadCount = -1, //! -1 means current thread have not been scheduled yet. 
     .tid = 0,
     .eq = NULL,
-    .ev = {0},
-    .invoke = NULL
+    .ev = {0}
 }; //! define thread local dispatcher for each thread.
 
 
@@ -38,27 +26,37 @@ __thread dispatcher_t dispatcher = {
  *          eq in the global map. 
  * @param   
  * @note    This function should be called only in the time a thread is first dispatched.
+ *          If the memory pools are exhausted, the thread is left undispatched and its
+ *          events are dropped, the next event tries again.
  * @see     
  */
 void dispatcherInit(dispatcher_t *dispatch){
-    int ret;
+    int ret, node;
     uint8_t *buffer;
     //! eventQueueMap must be initialised before enter this function.
     assert(eventQueueMap != NULL);
     assert(dispatch != NULL);
 
     if(dispatch->eq == NULL){
-        dispatch->eq = (eventQueue_t *)memPoolAllocLocked(eventQueueMemPool, &eventQueueMemPoolLock);
+        //! the queue is written by the thread, so it's taken from the node of the thread.
+        node = memNumaNode();
+        eventQueue_t *eq = (eventQueue_t *)memPoolAllocShared(eventQueueMemPools[node]);
+        buffer = (uint8_t *)memPoolAllocShared(eventQueueBufferMemPools[node]);
+        if(eq == NULL || buffer == NULL){
+            if(eq) memPoolFreeShared(eventQueueMemPools[node], eq);
+            if(buffer) memPoolFreeShared(eventQueueBufferMemPools[node], buffer);
+            return;
+        }
 
         //! initialise eq for the dispatcher.
-        buffer = (uint8_t *)memPoolAllocLocked(eventQueueBufferMemPool, &eventQueueBufferMemPoolLock);
+        dispatch->eq = eq;
         eventQueueInit(dispatch->eq, buffer);
         
         /** @brief shared variable {@code atomicThreadCounts} is in danger of concurrency.
         atomicThreadCounts++;
         dispatch->threadCount = atomicThreadCounts;
         
-        ret = hashMapPutLocked(eventQueueMap, (void *)dispatch->threadCount, 
+        ret = flatMapPutLocked(eventQueueMap, dispatch->threadCount, 
             dispatch->eq, &eventQueueMapLock);
         */
 
@@ -69,14 +67,17 @@ void dispatcherInit(dispatcher_t *dispatch){
         //! record the eventqueue. 
         ret = eventQueueMapPutLocked(dispatcher, &eventQueueMapLock); 
 
+        //! the map can not grow, the thread goes unchecked.
+        if(ret < 0){
+            eventQueueDeInit(dispatch->eq);
+            dispatch->eq = NULL;
+            return;
+        }
+
         //! ret == 1 means that there is no such key in the map before we put it.
         if(ret != 1){
             dlc_err("tc %ld\n", dispatch->threadCount);
         } 
         assert(ret == 1);
     }
-
-    if(dispatch->invoke == NULL){
-        dispatch->invoke = dispatcherInvoke;
-    }
 }
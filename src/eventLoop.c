@@ -12,34 +12,53 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 #include "common.h"
 #include "dlcDef.h"
 #include "internal.h"
 #include "vertex.h"
+#include "workPool.h"
 
 typedef int eventError_t;
 
-struct sscImpl{
-    vertex_t **ssc;
-    int step;
+//! a vertex being visited by tarjan, along with the next arc to follow.
+struct tarjanFrame{
+    vid_t vertex;
+    uint32_t arc;
 };
-typedef struct sscImpl sscImpl_t;
-struct sscCountImpl{
-    int *sscCount;
-    int step;
-};
-typedef struct sscCountImpl sscCountImpl_t;
-struct stackImpl{
-    vertex_t **stack;
-    int top;
+typedef struct tarjanFrame tarjanFrame_t;
+
+/**
+ * @brief scratch buffers of tarjan, grown to the count of vertices and reused across
+ *        passes. A vertex is pushed to each of them once a pass at most.
+ */
+struct tarjanImpl{
+    tarjanFrame_t *frames;  //! the explicit call stack.
+    vid_t *stack;           //! vertices whose ssc isn't complete yet.
+    vid_t *ssc;             //! vertices of the ssc found, one after another.
+    int *sscCount;          //! count of vertices of each ssc.
+    uint32_t capacity;
+
+    uint32_t time;
+    int top;                //! top of stack.
+    int step;               //! vertices in ssc.
+    int count;              //! ssc found.
 };
-typedef struct stackImpl stackImpl_t;
+typedef struct tarjanImpl tarjanImpl_t;
+
+static tarjanImpl_t tarjanImpl;
+static err_t tarjanReserve(tarjanImpl_t *impl, uint32_t count);
 
 
 static __attribute__ ((unused))  eventError_t eventError = 0;
 
-void displayInfo(vertex_t **ssc, int *sscCount, int num);
-void clearTarjanStatus(hashMapIterator_t *iter);
+//! time of the current drain, uint:ms.
+static long long loopTimeMs;
+
+void displayInfo(vid_t *ssc, int *sscCount, int num);
+void reportLockOrder(vid_t *cycle, int num);
+static void lockOrderRetire(vid_t mv);
+static void lockOrderEvict(vid_t mv);
 
 
 #if IS_USE_ASSERT
@@ -62,9 +81,124 @@ enum eventType{
     EVENT_WAITLOCK,
     EVENT_HOLDLOCK,
     EVENT_RELEASELOCK,
+    EVENT_DESTROYLOCK,
     EVENT_BUTT
 }; */
 
+/**
+ * @brief   look up the vertex of a mutex.
+ * @note    the slot of the mutex may hold a stale vertex of a mutex destroyed
+ *          at a nearby address, then the mutex lives in vertexMutexMap.
+ */
+static inline vid_t mutexVertexLookup(size_t mid){
+    vid_t mv = (vid_t)(size_t)shadowMapGet(&mutexShadowMap, mid);
+
+    if(mv != VID_NONE && vertexMutexInfo(mv)->mid == mid){
+        return mv;
+    }
+    return flatMapSize(vertexMutexMap) > 0 ? (vid_t)(size_t)flatMapGet(vertexMutexMap, mid) : VID_NONE;
+}
+
+/**
+ * @brief   record the vertex of a mutex.
+ * @return  DLC_OK, or DLC_ERR if there is no memory to record it.
+ */
+static inline err_t mutexVertexRecord(size_t mid, vid_t mv){
+    if(shadowMapSet(&mutexShadowMap, mid, (void *)(size_t)mv) == DLC_OK){
+        return DLC_OK;
+    }
+    return flatMapPut(vertexMutexMap, mid, (void *)(size_t)mv) < 0 ? DLC_ERR : DLC_OK;
+}
+
+/**
+ * @brief   free the vertex of a mutex which ended its life, along with its arcs.
+ * @note    a mutex is destroyed unlocked and without waiters, unless it's misused, so
+ *          the arcs are rarely there.
+ */
+static void mutexVertexRetire(vid_t mv){
+    size_t mid = vertexMutexInfo(mv)->mid;
+    flatMapIterator_t iter;
+    flatMapEntry_t *entry;
+    vid_t tv;
+
+    //! the owner, and the holders the ownership passes to.
+    while((tv = vertexField(mv, owner)) != VID_NONE){
+        vertexRelease(mv, tv);
+    }
+
+    //! the waiters are found among the requesting threads.
+    while(vertexIndegree(mv) > 0){
+        flatMapIteratorInit(&iter, requestThreadMap);
+        while((entry = flatMapNext(&iter)) != NULL){
+            if(vertexField((vid_t)entry->key, waitingOn) == mv) break;
+        }
+        if(entry == NULL) break;
+
+        tv = (vid_t)entry->key;
+        vertexUnwait(tv, mv);
+        flatMapRemove(requestThreadMap, (size_t)tv);
+    }
+
+    lockOrderRetire(mv);
+    if((vid_t)(size_t)shadowMapGet(&mutexShadowMap, mid) == mv){
+        shadowMapClear(&mutexShadowMap, mid);
+    }else{
+        flatMapRemove(vertexMutexMap, mid);
+    }
+    vertexDestroy(mv);
+}
+
+/**
+ * @brief   find the vertex of the mutex of an event.
+ * @param   stale [out] whether the event belongs to an earlier life of the mutex than
+ *          its vertex, which happens as the event queues of threads are drained one
+ *          after another. The event is dropped then.
+ * @return  the vertex, VID_NONE if there is none. The vertex of an earlier life of the
+ *          mutex is retired, it was freed without being destroyed, or the event of its
+ *          destruction is still queued.
+ */
+static vid_t mutexVertexFind(const mutexInfo_t *info, bool *stale){
+    vid_t mv = mutexVertexLookup(info->mid);
+    int32_t age;
+
+    *stale = false;
+    if(mv == VID_NONE) return VID_NONE;
+
+    age = (int32_t)(info->generation - vertexMutexInfo(mv)->generation);
+    if(age == 0){
+        vertexTouch(mv);
+        return mv;
+    }
+
+    if(age < 0){
+        *stale = true;
+    }else{
+        mutexVertexRetire(mv);
+    }
+    return VID_NONE;
+}
+
+/**
+ * @brief   create a vertex for a mutex, evicting a cold one if the vertices of mutexes
+ *          reach their cap or the memory runs out.
+ * @return  the vertex, VID_NONE if every vertex of mutex takes part in the graph.
+ */
+static vid_t mutexVertexCreate(void){
+    vid_t mv = vertexCreate(VERTEX_MUTEX);
+
+    if(mv == VID_NONE){
+        mv = vertexClockVictim(VERTEX_MUTEX);
+        if(mv == VID_NONE) return VID_NONE;
+
+        //! the vertex has no arc of the graph, it's made again once its mutex is touched.
+        lockOrderEvict(mv);
+        mutexVertexRetire(mv);
+        graph.set[VERTEX_MUTEX].evicted++;
+        mv = vertexCreate(VERTEX_MUTEX);
+    }
+    return mv;
+}
+
 /**
  * @brief   event handler for waiting lock.
  *
@@ -74,9 +208,10 @@ enum eventType{
  * @see     
  */
 static void waitLockHandler(event_t *ev){
-    vertex_t *tv, *mv;
+    vid_t tv, mv;
     threadInfo_t *threadInfo;
     mutexInfo_t *mutexInfo;
+    bool stale;
     
     assert(ev->type == EVENT_WAITLOCK);
     assert(vertexThreadMap != NULL);
@@ -85,39 +220,61 @@ static void waitLockHandler(event_t *ev){
     threadInfo = &ev->threadInfo;
     mutexInfo = &ev->mutexInfo;
     //! find or create tv and mv from ev.tid and ev.mid.
-    tv = hashMapGet(vertexThreadMap, (void *)threadInfo->tid);
-    if(tv == NULL){
+    //! if a memory pool is exhausted, the event is dropped, and so are 
+    //! the events of the same thread and mutex that follow it.
+    tv = (vid_t)(size_t)flatMapGet(vertexThreadMap, threadInfo->tid);
+    if(tv == VID_NONE){
         //! create a vertex for thread.
-        assert(threadVertexMemPool != NULL);
-        tv = vertexCreate(VERTEX_THREAD, &ops);
-        assert(tv);
-        hashMapPut(vertexThreadMap, (void *)threadInfo->tid, tv);
+        tv = vertexCreate(VERTEX_THREAD);
+        if(tv == VID_NONE){
+            dlc_dbg("drop event of tid %ld\n", threadInfo->tid);
+            return;
+        }
+        if(flatMapPut(vertexThreadMap, threadInfo->tid, (void *)(size_t)tv) < 0){
+            dlc_dbg("drop event of tid %ld\n", threadInfo->tid);
+            vertexDestroy(tv);
+            return;
+        }
     }
 
-    assert(tv->type == VERTEX_THREAD);
+    assert(vertexType(tv) == VERTEX_THREAD);
     //! set tv's status.
     vertexSetInfo(tv, threadInfo);
 
-    mv = hashMapGet(vertexMutexMap, (void *)mutexInfo->mid);
-    if(mv == NULL){
+    mv = mutexVertexFind(mutexInfo, &stale);
+    if(stale){
+        dlc_dbg("drop stale event of mid %#lx\n", mutexInfo->mid);
+        return;
+    }
+    if(mv == VID_NONE){
         //! create a vertex for mutex.
-        assert(mutexVertexMemPool != NULL);
-        mv = vertexCreate(VERTEX_MUTEX, &ops);
-        assert(mv);
-        hashMapPut(vertexMutexMap, (void *)mutexInfo->mid, mv);
+        mv = mutexVertexCreate();
+        if(mv == VID_NONE){
+            dlc_dbg("drop event of mid %#lx\n", mutexInfo->mid);
+            return;
+        }
+        if(mutexVertexRecord(mutexInfo->mid, mv) != DLC_OK){
+            dlc_dbg("drop event of mid %#lx\n", mutexInfo->mid);
+            vertexDestroy(mv);
+            return;
+        }
     }
 
-    assert(mv->type == VERTEX_MUTEX);
+    assert(vertexType(mv) == VERTEX_MUTEX);
     //! set mv's status.
     vertexSetInfo(mv, mutexInfo);
 
-    //! add edge from tv to mv.
-    tv->ops->addEdge(tv, mv);
+    //! tv waits for mv, in place of a wait whose event of holding was lost.
+    vertexWait(tv, mv);
 
-    //! record thread to request map.    
+    //! record thread to request map, along with the time it starts waiting.    
     assert(requestThreadMap != NULL);
-    __unused int ret = hashMapPut(requestThreadMap, (void *)tv, (void *)1);
-    assert(ret == 1);
+    int ret = flatMapPut(requestThreadMap, (size_t)tv, (void *)loopTimeMs);
+    if(ret < 0){
+        dlc_dbg("drop event of tid %ld\n", threadInfo->tid);
+        vertexUnwait(tv, mv);
+        return;
+    }
 }
 
 /**
@@ -128,9 +285,10 @@ static void waitLockHandler(event_t *ev){
  * @see     
  */
 static void holdLockHandler(event_t *ev){
-    vertex_t *tv, *mv;
+    vid_t tv, mv;
     threadInfo_t *threadInfo;
     mutexInfo_t *mutexInfo;
+    bool stale;
 
     assert(ev->type == EVENT_HOLDLOCK);
     assert(vertexThreadMap != NULL);
@@ -139,38 +297,35 @@ static void holdLockHandler(event_t *ev){
     threadInfo = &ev->threadInfo;
     mutexInfo = &ev->mutexInfo;
     //! find tv and mv from ev.tid and ev.mid.
-    tv = hashMapGet(vertexThreadMap, (void *)threadInfo->tid);
-    if(tv == NULL){
-        //! record error.
-        abort();
-        return;
-    }
-
-    mv = hashMapGet(vertexMutexMap, (void *)mutexInfo->mid);
-    if(mv == NULL){
-        //! record error.
-        abort();
+    tv = (vid_t)(size_t)flatMapGet(vertexThreadMap, threadInfo->tid);
+    mv = mutexVertexFind(mutexInfo, &stale);
+    if(tv == VID_NONE || mv == VID_NONE){
+        //! the event of waiting was dropped.
+        dlc_dbg("drop event of tid %ld\n", threadInfo->tid);
         return;
     }
 
-    assert(tv->type == VERTEX_THREAD);
+    assert(vertexType(tv) == VERTEX_THREAD);
     //! set tv's status.
     vertexSetInfo(tv, threadInfo);
 
-    assert(mv->type == VERTEX_MUTEX);
+    assert(vertexType(mv) == VERTEX_MUTEX);
     //! set mv's status.
     vertexSetInfo(mv, mutexInfo);
 
-    //! delete tv --> mv. 
-    tv->ops->deleteEdge(tv, mv);
+    //! tv stops waiting for mv, and is removed from the request map.
+    if(vertexUnwait(tv, mv) == DLC_OK){
+        __unused int ret = flatMapRemove(requestThreadMap, (size_t)tv);
+        assert(ret == 0);
+    }
 
-    //! add mv --> tv.
-    mv->ops->addEdge(mv, tv);
+    //! tv holds mv.
+    if(vertexHold(mv, tv) != DLC_OK){
+        dlc_dbg("drop event of tid %ld\n", threadInfo->tid);
+        return;
+    }
     
     dlc_warn("mv :%#lx holds by tv :%ld\n", mutexInfo->mid, threadInfo->tid);
-    //! remove tv from the request map.
-    int ret = hashMapRemove(requestThreadMap, tv);
-    assert(ret == 0);
 }
 
 /**
@@ -185,9 +340,10 @@ static void releaseLockHandler(event_t *ev){
     assert(vertexThreadMap != NULL);
     assert(vertexMutexMap != NULL);
 
-    vertex_t *tv, *mv;
+    vid_t tv, mv;
     threadInfo_t *threadInfo;
     mutexInfo_t *mutexInfo;
+    bool stale;
 
     assert(vertexThreadMap != NULL);
     assert(vertexMutexMap != NULL);
@@ -195,55 +351,305 @@ static void releaseLockHandler(event_t *ev){
     threadInfo = &ev->threadInfo;
     mutexInfo = &ev->mutexInfo;
     //! find tv and mv from ev.tid and ev.mid.
-    tv = hashMapGet(vertexThreadMap, (void *)threadInfo->tid);
-    if(tv == NULL){
-        //! record error.
-        abort();
-        return;
-    }
-
-    mv = hashMapGet(vertexMutexMap, (void *)mutexInfo->mid);
-    if(mv == NULL){
-        abort();
+    tv = (vid_t)(size_t)flatMapGet(vertexThreadMap, threadInfo->tid);
+    mv = mutexVertexFind(mutexInfo, &stale);
+    if(tv == VID_NONE || mv == VID_NONE){
+        //! the event of waiting was dropped.
+        dlc_dbg("drop event of tid %ld\n", threadInfo->tid);
         return;
     }
 
-    assert(tv->type == VERTEX_THREAD);
+    assert(vertexType(tv) == VERTEX_THREAD);
     //! set tv's status.
     vertexSetInfo(tv, threadInfo);
 
-    assert(mv->type == VERTEX_MUTEX);
+    assert(vertexType(mv) == VERTEX_MUTEX);
     //! set mv's status.
     vertexSetInfo(mv, mutexInfo);
 
-    //! delete mv --> tv.
-    mv->ops->deleteEdge(mv, tv);
+    //! tv releases mv.
+    vertexRelease(mv, tv);
 }
 
-static void (*handler[])(event_t *ev) = {
-    waitLockHandler,
-    holdLockHandler,
-    releaseLockHandler
-};
+/**
+ * @brief   event handler for destroying lock.
+ * @param   ev is pointer to event.
+ * @note    the generation of the event is that of the next life of the mutex, so the
+ *          vertex of the life ended is retired on finding it.
+ */
+static void destroyLockHandler(event_t *ev){
+    bool stale;
+
+    assert(ev->type == EVENT_DESTROYLOCK);
+    mutexVertexFind(&ev->mutexInfo, &stale);
+}
+
+/**
+ * @note In the lock-order mode, a mutex v locked while the mutex u is held takes an order
+ *       arc u -> v, whichever thread locked them. The arcs are kept as long as both
+ *       mutexes live and stay resident under the memory cap, so a cycle of them means two
+ *       threads may lock the mutexes in opposite orders, and deadlock with the right
+ *       interleaving, even if they never did so far. The acquisition of each arc is kept in lockOrderMap:
+ *
+ *       A -> B    thread 1 locks B while holding A [backtrace]
+ *       B -> A    thread 2 locks A while holding B [backtrace]
+ *
+ *       A new arc closes a cycle only if u is reached from v, so a cycle is reported
+ *       once, when its last arc is added, and the search only starts from v.
+ */
+#define lockOrderKey(u, v)      (((size_t)(u) << 32) | (size_t)(v))
+
+static void lockOrderDelete(vid_t u, vid_t v){
+    threadInfo_t *info = flatMapGet(lockOrderMap, lockOrderKey(u, v));
+
+    vertexDeleteOrder(u, v);
+    flatMapRemove(lockOrderMap, lockOrderKey(u, v));
+    zfree(info);
+}
+
+/**
+ * @brief   drop the order arcs of a mutex which ended its life.
+ * @note    the arcs into it are kept reversed too, so that a short-lived mutex locked
+ *          while others are held only touches its own arcs.
+ */
+static void lockOrderRetire(vid_t mv){
+    vid_t *arcs;
+    int count;
+
+    arcs = vertexOrderArcs(mv, &count);
+    while(count > 0){
+        lockOrderDelete(mv, arcs[count - 1]);
+        arcs = vertexOrderArcs(mv, &count);
+    }
+
+    arcs = vertexOrderInArcs(mv, &count);
+    while(count > 0){
+        lockOrderDelete(arcs[count - 1], mv);
+        arcs = vertexOrderInArcs(mv, &count);
+    }
+}
+
+static uint64_t lockOrderDropped;   //! order arcs dropped so far, their cycles are missed.
+static bool lockOrderWarned;
+
+/**
+ * @brief   drop the order arc of an event, it's warned once as the cycles it closes are
+ *          missed, e.g. a mutex locked while thousands of others are held.
+ */
+static void lockOrderDrop(event_t *ev){
+    lockOrderDropped++;
+    if(!lockOrderWarned){
+        lockOrderWarned = true;
+        dlc_warn("drop order of mid %#lx while holding mid %#lx, the arcs of a mutex are "
+            "full or out of memory, lock order cycles may be missed\n",
+            ev->mutexInfo.mid, ev->heldInfo.mid);
+        return;
+    }
+    dlc_dbg("drop order of mid %#lx, %lu dropped\n", ev->mutexInfo.mid, lockOrderDropped);
+}
+
+/**
+ * @brief   count the order arcs of a cold mutex evicted under the memory cap as dropped,
+ *          they are deleted by lockOrderRetire() along with the vertex.
+ */
+static void lockOrderEvict(vid_t mv){
+    int out, in;
+
+    vertexOrderArcs(mv, &out);
+    vertexOrderInArcs(mv, &in);
+    if(out + in == 0) return;
+
+    lockOrderDropped += out + in;
+    if(!lockOrderWarned){
+        lockOrderWarned = true;
+        dlc_warn("drop %d orders of mid %#lx evicted under the memory cap, lock order "
+            "cycles may be missed\n", out + in, vertexMutexInfo(mv)->mid);
+        return;
+    }
+    dlc_dbg("drop %d orders of mid %#lx, %lu dropped\n", out + in,
+        vertexMutexInfo(mv)->mid, lockOrderDropped);
+}
+
+/**
+ * @brief   search a path of order arcs from a mutex to another.
+ * @return  the count of mutexes of the path left in tarjanImpl.ssc, from first to last,
+ *          0 if there is none, -1 if there is no memory for the search.
+ * @note    the depth first search of tarjan, on its call stack and its stamps.
+ */
+static int lockOrderSearch(tarjanImpl_t *impl, vid_t from, vid_t to){
+    vid_t u, v, *arcs;
+    int depth = 0, count;
+
+    if(tarjanReserve(impl, graph.set[VERTEX_MUTEX].live) != DLC_OK){
+        return -1;
+    }
+    graphNextEpoch();
+
+    vertexField(from, epoch) = graph.epoch;
+    impl->frames[depth].vertex = from;
+    impl->frames[depth++].arc = 0;
+    while(depth > 0){
+        u = impl->frames[depth - 1].vertex;
+        arcs = vertexOrderArcs(u, &count);
+        if(impl->frames[depth - 1].arc == count){
+            depth--;
+            continue;
+        }
+
+        v = arcs[impl->frames[depth - 1].arc++];
+        if(v == to){
+            for(int i = 0; i < depth; i++){
+                impl->ssc[i] = impl->frames[i].vertex;
+            }
+            impl->ssc[depth] = to;
+            return depth + 1;
+        }
+        if(!vertexVisited(v)){
+            vertexField(v, epoch) = graph.epoch;
+            impl->frames[depth].vertex = v;
+            impl->frames[depth++].arc = 0;
+        }
+    }
+    return 0;
+}
+
+#ifdef DLC_TEST
+static uint32_t lockOrderReports;   //! cycles of orders reported.
+#endif
+
+/**
+ * @brief   event handler for locking a mutex while holding another one.
+ * @param   ev is pointer to event.
+ * @note    the arc is dropped if either mutex isn't tracked, e.g. it was locked by
+ *          pthread_mutex_trylock(), which sends no event.
+ */
+static void lockOrderHandler(event_t *ev){
+    vid_t u, v;
+    threadInfo_t *info;
+    bool stale;
+    int count;
+
+    assert(ev->type == EVENT_LOCKORDER);
+    assert(lockOrderMap != NULL);
+
+    u = mutexVertexFind(&ev->heldInfo, &stale);
+    if(u == VID_NONE || stale) return;
+    v = mutexVertexFind(&ev->mutexInfo, &stale);
+    if(v == VID_NONE || stale || u == v) return;
+
+    //! sent by another thread, or again by a thread whose cache dropped it.
+    if(flatMapGet(lockOrderMap, lockOrderKey(u, v)) != NULL) return;
+
+    info = ztrymalloc(sizeof(threadInfo_t));
+    if(info == NULL){
+        lockOrderDrop(ev);
+        return;
+    }
+    memcpy(info, &ev->threadInfo, sizeof(threadInfo_t));
+    if(flatMapPut(lockOrderMap, lockOrderKey(u, v), info) < 0){
+        lockOrderDrop(ev);
+        zfree(info);
+        return;
+    }
+    if(vertexAddOrder(u, v) != DLC_OK){
+        lockOrderDrop(ev);
+        flatMapRemove(lockOrderMap, lockOrderKey(u, v));
+        zfree(info);
+        return;
+    }
+
+    //! the new arc u -> v closes a cycle v -> ... -> u.
+    count = lockOrderSearch(&tarjanImpl, v, u);
+    if(count > 0){
+#ifdef DLC_TEST
+        lockOrderReports++;
+#endif
+        reportLockOrder(tarjanImpl.ssc, count);
+    }
+}
+
+/**
+ * @brief   the acquisition of the order arc from the mutex u to the mutex v.
+ */
+threadInfo_t *lockOrderInfo(vid_t u, vid_t v){
+    return flatMapGet(lockOrderMap, lockOrderKey(u, v));
+}
 
 void eventHandler(event_t *ev){
     assert(ev != NULL && ev->type < EVENT_BUTT);
-    handler[ev->type](ev);
-};
+    //! a switch rather than a table of handlers, so that they are inlined.
+    switch(ev->type){
+    case EVENT_WAITLOCK:
+        waitLockHandler(ev);
+        break;
+    case EVENT_HOLDLOCK:
+        holdLockHandler(ev);
+        break;
+    case EVENT_RELEASELOCK:
+        releaseLockHandler(ev);
+        break;
+    case EVENT_DESTROYLOCK:
+        destroyLockHandler(ev);
+        break;
+    case EVENT_LOCKORDER:
+        lockOrderHandler(ev);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief   take a snapshot of all event queues.
+ * @param   count [out] the number of event queues.
+ * @return  the event queues.
+ * @note    eventQueueMap is modified by the threads being dispatched, and may be rehashed
+ *          meanwhile, so it's only iterated under its lock. The event queues themselves
+ *          are released by the checker only.
+ */
+static eventQueue_t **eventQueueSnapshot(int *count){
+    static eventQueue_t **snapshot = NULL;
+    static int capacity = 0;
+    flatMapIterator_t iter;
+    flatMapEntry_t *entry;
+    int num = 0;
+
+    spinlockAcquire(&eventQueueMapLock);
+    if(flatMapSize(eventQueueMap) > capacity){
+        eventQueue_t **grown = ztrymalloc(2 * flatMapSize(eventQueueMap) * sizeof(eventQueue_t *));
+        if(grown != NULL){
+            zfree(snapshot);
+            snapshot = grown;
+            capacity = 2 * flatMapSize(eventQueueMap);
+        }
+    }
+
+    flatMapIteratorInit(&iter, eventQueueMap);
+    while((entry = flatMapNext(&iter)) != NULL && num < capacity){ 
+        snapshot[num++] = (eventQueue_t *)entry->value;
+    }
+    spinlockRelease(&eventQueueMapLock);
+
+    *count = num;
+    return snapshot;
+}
 
 void eventLoopEnter(){
-    hashMapIterator_t iter;
-    entry_t *entry;
+    eventQueue_t **eqs;
     eventQueue_t *eq;
     long loops = atomicThreadCounts;
-    int i = 0;
+    int i, count;
+    uint32_t drained = 0, fillPercent = 0;
     // dlc_warn("loops %ld\n", loops);
-    hashMapIteratorInit(&iter, eventQueueMap);
-    while((entry = hashMapNext(&iter)) != NULL){ 
-        eq = (eventQueue_t *)hashMapGet(eventQueueMap, (void *)entry->key);
+    loopTimeMs = timeInMilliseconds();
+    eqs = eventQueueSnapshot(&count);
+    for(i = 0; i < count; i++){ 
+        eq = eqs[i];
         if(eq == NULL) continue;
         int num = eventQueueUsed(eq);
         dlc_dbg("count %ld i %d, num %d\n", loops, i, num);
+        fillPercent = DLC_MAX(fillPercent, num * 100 / eq->size);
+        drained += num;
         while (num > 0) {
             event_t ev;
         
@@ -252,117 +658,591 @@ void eventLoopEnter(){
             num--;
         }
     }
+
+    checkPeriodObserve(drained, fillPercent);
+    graphSync();
 }
 
 /**
- * @brief   tarjan algorithm to find ssc.
+ * @brief   make the buffers of tarjan hold a number of vertices.
+ * @return  DLC_OK, or DLC_ERR if there is no memory.
+ */
+static err_t tarjanReserve(tarjanImpl_t *impl, uint32_t count){
+    tarjanFrame_t *frames;
+    vid_t *stack, *ssc;
+    int *sscCount;
+    uint32_t capacity;
+
+    if(count <= impl->capacity) return DLC_OK;
+
+    capacity = DLC_MAX(count, impl->capacity * 2);
+    frames = ztrymalloc(capacity * sizeof(tarjanFrame_t));
+    stack = ztrymalloc(capacity * sizeof(vid_t));
+    ssc = ztrymalloc(capacity * sizeof(vid_t));
+    sscCount = ztrymalloc(capacity * sizeof(int));
+    if(frames == NULL || stack == NULL || ssc == NULL || sscCount == NULL){
+        zfree(frames);
+        zfree(stack);
+        zfree(ssc);
+        zfree(sscCount);
+        return DLC_ERR;
+    }
+
+    zfree(impl->frames);
+    zfree(impl->stack);
+    zfree(impl->ssc);
+    zfree(impl->sscCount);
+    impl->frames = frames;
+    impl->stack = stack;
+    impl->ssc = ssc;
+    impl->sscCount = sscCount;
+    impl->capacity = capacity;
+    return DLC_OK;
+}
+
+static inline void tarjanVisit(tarjanImpl_t *impl, vid_t u, int depth){
+    vertexField(u, epoch) = graph.epoch;
+    vertexField(u, dfn) = vertexField(u, low) = ++impl->time;
+    vertexField(u, inStack) = true;
+    impl->stack[++impl->top] = u;
+    impl->frames[depth].vertex = u;
+    impl->frames[depth].arc = 0;
+}
+
+/**
+ * @brief   tarjan algorithm to find ssc, with an explicit call stack, so that a long 
+ *          chain of waits can't overflow the stack of the checker.
  *
- * @param   u is current vertex.  
- * @param   stack is stack used for tarjan.
- * @param   top is top of stack.
- * @param   ssc is tripule 
+ * @param   impl is the scratch buffers, which receive the ssc found.
+ * @param   root is the vertex to start from.
+ * @param   stopAtFirst is whether to stop at the first ssc of more than one vertex.
+ * @return  true if it stopped at a ssc of more than one vertex.
+ */
+static bool tarjan(tarjanImpl_t *impl, vid_t root, bool stopAtFirst){
+    vid_t u, v, w;
+    int depth = 0, count;
+
+    tarjanVisit(impl, root, depth++);
+    while(depth > 0){
+        u = impl->frames[depth - 1].vertex;
+
+        //! follow the next arc of u.
+        if(impl->frames[depth - 1].arc < vertexOutdegree(u)){
+            v = vertexArc(u, impl->frames[depth - 1].arc++);
+            if(!vertexVisited(v)){
+                tarjanVisit(impl, v, depth++);
+            }else if(vertexField(v, inStack)){
+                vertexField(u, low) = DLC_MIN(vertexField(u, low), vertexField(v, dfn));
+            }
+            continue;
+        }
+
+        //! all arcs of u are followed, return to its caller.
+        if(vertexField(u, dfn) == vertexField(u, low)){
+            count = 0;
+            do{
+                w = impl->stack[impl->top--];
+                vertexField(w, inStack) = false;
+                impl->ssc[impl->step++] = w;
+                count++;
+            }while(w != u);
+            impl->sscCount[impl->count++] = count;
+
+            //! a cycle of the wait-for graph always goes through a requesting thread.
+            if(stopAtFirst && count > 1) return true;
+        }
+
+        if(--depth > 0){
+            v = impl->frames[depth - 1].vertex;
+            vertexField(v, low) = DLC_MIN(vertexField(v, low), vertexField(u, low));
+        }
+    }
+    return false;
+}
+
+/**
+ * @note Above a count of live vertices, the ssc are searched by a pool of workers, in
+ *       phases separated by the end of each parallel loop:
+ *
+ *       1. count:   count the arcs into each vertex, and lay out the reversed arcs.
+ *       2. trim:    drop the vertices without arcs in or out, cascading to the arcs of
+ *                   their neighbours, none of them is on a cycle.
+ *       3. union:   union the vertices left along their arcs into weakly connected
+ *                   components, a ssc never spans two components.
+ *       4. group:   lay out the vertices of each component one after another.
+ *       5. tarjan:  search each component on its own, with the slices of tarjanImpl
+ *                   at the offset of the component.
+ *
+ *       The vertices are numbered densely for the scratch arrays, threads first, then
+ *       mutexes. The trimmed vertices are stamped as visited by the pass, so tarjan 
+ *       skips them and never leaves the component it starts in.
+ */
+struct sscParallel{
+    workPool_t *pool;
+    int workers;                //! workers configured, 1 keeps the search serial.
+    uint32_t threshold;         //! live vertices from which the search goes parallel.
+
+    uint32_t threads;           //! dense numbers below it are threads.
+    uint32_t count;             //! vertices numbered.
+    uint32_t capacity;          //! vertices the arrays hold.
+    uint32_t arcCapacity;       //! reversed arcs rev holds.
+    uint32_t components;
+
+    _Atomic uint32_t *in;       //! arcs from the vertices not trimmed.
+    _Atomic uint32_t *out;      //! arcs to the vertices not trimmed.
+    uint32_t *revStart;         //! first reversed arc of each vertex, count + 1 entries.
+    uint32_t *rev;              //! tails of the reversed arcs.
+    _Atomic uint32_t *cursor;   //! next reversed arc to fill, then next member to place.
+    _Atomic uint8_t *trimmed;
+    uint32_t *next;             //! links of the stacks of vertices being trimmed.
+    _Atomic uint32_t *parent;   //! union-find of the components.
+    uint32_t *members;          //! vertices of the components, one after another.
+    struct sscComponent{
+        uint32_t start;         //! offset in members, and in the buffers of tarjanImpl.
+        uint32_t size;
+        uint32_t count;         //! ssc found in the component.
+    } *comps;
+};
+
+static struct sscParallel sscParallel = {
+    .workers = NUMBER_OF_CHECK_WORKERS,
+    .threshold = THRESHOLD_OF_PARALLEL_SSC,
+};
+
+#define SSC_PARALLEL_GRAIN      (4096)  //! vertices handed to a worker at a time.
+#define SSC_NONE                UINT32_MAX
+
+#define sscDense(p, vid)        (vidType(vid) == VERTEX_THREAD ? \
+    vidIndex(vid) : (p)->threads + vidIndex(vid))
+#define sscVertex(p, d)         ((d) < (p)->threads ? \
+    vidMake(VERTEX_THREAD, d) : vidMake(VERTEX_MUTEX, (d) - (p)->threads))
+#define sscTrimmed(p, d)        atomic_load_explicit(&(p)->trimmed[d], memory_order_relaxed)
+
+/**
+ * @brief   configure the parallel search.
+ * @param   workers is the count of workers, 0 takes the default and 1 keeps it serial.
+ * @param   threshold is the count of live vertices from which it goes parallel.
+ * @note    the workers are only created by the first parallel pass.
  */
-void tarjan(vertex_t *u, short *time, 
-            stackImpl_t *stackImpl, sscImpl_t *sscImpl, sscCountImpl_t *sscCountImpl){ 
-    vertex_t *v = NULL;
-    u->dfn = u->low = ++(*time);
-    assert(u->dfn == u->low);
-    vertex_t **stack = stackImpl->stack;
-    int *top = &stackImpl->top;
-    stack[++(*top)] = u;
-    u->inStack = true;
-
-    arc_t *head = u->arcList;
-    if(head == NULL){
-        dlc_warn("u.type %d, top %d\n", u->type, *top);
-        goto skip;
-    }
-
-    while(head){
-        v = head->tail;
-        if(v->dfn == 0){
-            tarjan(v, time, stackImpl, sscImpl, sscCountImpl);
-            u->low = DLC_MIN(u->low, v->low);
-        }else if(v->inStack){
-            u->low = DLC_MIN(u->low, v->dfn);
-        }
-        head = head->next;
-    }
-
-skip:
-    if(u->dfn == u->low){
-        vertex_t *w;
-        int count = 0;
-        vertex_t **ssc;
-        int *sscCount;
-        do{
-            w = stack[(*top)--];
-            w->inStack = false;
-            ssc = sscImpl->ssc + sscImpl->step;
-            sscCount = sscCountImpl->sscCount + sscCountImpl->step;
-            *ssc = w;
-            sscImpl->step++;
-            count++;
-        }while(w != u);
-        *sscCount = count;
-        sscCountImpl->step++;
-    }
-}
-
-void strongConnectedComponent(){
-    hashMapIterator_t iter;
-    entry_t *entry;
-    vertex_t *u;
+void sscParallelConfigure(uint32_t workers, uint32_t threshold){
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if(workers == 0){
+        workers = DLC_MIN(NUMBER_OF_CHECK_WORKERS, cpus > 0 ? (uint32_t)cpus : 1);
+    }
+    sscParallel.workers = DLC_MAX(1, DLC_MIN(workers, NUMBER_OF_WORKER_MAX));
+    sscParallel.threshold = threshold ? threshold : THRESHOLD_OF_PARALLEL_SSC;
+}
+
+/**
+ * @brief   make the scratch arrays hold the vertices and the arcs of the graph.
+ * @return  DLC_OK, or DLC_ERR if there is no memory.
+ */
+static err_t sscParallelReserve(struct sscParallel *p, uint32_t count){
+    void **arrays[] = {
+        (void **)&p->in, (void **)&p->out, (void **)&p->revStart, (void **)&p->cursor,
+        (void **)&p->trimmed, (void **)&p->next, (void **)&p->parent, (void **)&p->members,
+        (void **)&p->comps,
+    };
+    size_t sizes[] = {
+        sizeof(uint32_t), sizeof(uint32_t), sizeof(uint32_t), sizeof(uint32_t),
+        sizeof(uint8_t), sizeof(uint32_t), sizeof(uint32_t), sizeof(uint32_t),
+        sizeof(struct sscComponent),
+    };
+    int num = sizeof(arrays) / sizeof(arrays[0]);
+    void *fresh[sizeof(arrays) / sizeof(arrays[0])];
+    uint32_t capacity;
+    int i;
+
+    if(count <= p->capacity) return DLC_OK;
+
+    //! revStart has an entry past the last vertex.
+    capacity = DLC_MAX(count, p->capacity * 2) + 1;
+    for(i = 0; i < num; i++){
+        fresh[i] = ztrymalloc(capacity * sizes[i]);
+        if(fresh[i] == NULL) break;
+    }
+    if(i < num){
+        while(--i >= 0) zfree(fresh[i]);
+        return DLC_ERR;
+    }
+
+    for(i = 0; i < num; i++){
+        zfree(*arrays[i]);
+        *arrays[i] = fresh[i];
+    }
+    p->capacity = capacity - 1;
+    return DLC_OK;
+}
+
+static err_t sscParallelReserveArcs(struct sscParallel *p, uint32_t count){
+    uint32_t *rev;
+
+    if(count <= p->arcCapacity) return DLC_OK;
+
+    rev = ztrymalloc(DLC_MAX(count, p->arcCapacity * 2) * sizeof(uint32_t));
+    if(rev == NULL) return DLC_ERR;
+
+    zfree(p->rev);
+    p->rev = rev;
+    p->arcCapacity = DLC_MAX(count, p->arcCapacity * 2);
+    return DLC_OK;
+}
+
+static void sscParallelCount(void *arg, uint32_t begin, uint32_t end){
+    struct sscParallel *p = arg;
+    vid_t u;
+    int count;
+
+    for(uint32_t d = begin; d < end; d++){
+        u = sscVertex(p, d);
+        count = vertexOutdegree(u);
+        atomic_store_explicit(&p->out[d], count, memory_order_relaxed);
+        for(int i = 0; i < count; i++){
+            atomic_fetch_add_explicit(&p->in[sscDense(p, vertexArc(u, i))], 1,
+                memory_order_relaxed);
+        }
+    }
+}
+
+static void sscParallelReverse(void *arg, uint32_t begin, uint32_t end){
+    struct sscParallel *p = arg;
+    vid_t u;
+    int count;
+
+    for(uint32_t d = begin; d < end; d++){
+        u = sscVertex(p, d);
+        count = vertexOutdegree(u);
+        for(int i = 0; i < count; i++){
+            p->rev[atomic_fetch_add_explicit(&p->cursor[sscDense(p, vertexArc(u, i))], 1,
+                memory_order_relaxed)] = d;
+        }
+    }
+}
+
+//! claim a vertex to be trimmed, a vertex is trimmed by one worker only.
+static inline bool sscTrimClaim(struct sscParallel *p, uint32_t d){
+    uint8_t expected = 0;
+    return atomic_compare_exchange_strong_explicit(&p->trimmed[d], &expected, 1,
+        memory_order_relaxed, memory_order_relaxed);
+}
+
+/**
+ * @brief   trim a vertex, and the neighbours left without arcs in or out by it.
+ */
+static void sscTrim(struct sscParallel *p, uint32_t d){
+    uint32_t head = d, w;
+    vid_t u;
+    int count;
+
+    p->next[d] = SSC_NONE;
+    while(head != SSC_NONE){
+        d = head;
+        head = p->next[d];
+
+        //! finished by the pass, as a ssc of its own.
+        u = sscVertex(p, d);
+        vertexField(u, epoch) = graph.epoch;
+        vertexField(u, inStack) = false;
+
+        count = vertexOutdegree(u);
+        for(int i = 0; i < count; i++){
+            w = sscDense(p, vertexArc(u, i));
+            if(atomic_fetch_sub_explicit(&p->in[w], 1, memory_order_relaxed) == 1
+                && sscTrimClaim(p, w)){
+                p->next[w] = head;
+                head = w;
+            }
+        }
+
+        for(uint32_t i = p->revStart[d]; i < p->revStart[d + 1]; i++){
+            w = p->rev[i];
+            if(atomic_fetch_sub_explicit(&p->out[w], 1, memory_order_relaxed) == 1
+                && sscTrimClaim(p, w)){
+                p->next[w] = head;
+                head = w;
+            }
+        }
+    }
+}
+
+static void sscParallelTrim(void *arg, uint32_t begin, uint32_t end){
+    struct sscParallel *p = arg;
+
+    for(uint32_t d = begin; d < end; d++){
+        atomic_store_explicit(&p->parent[d], d, memory_order_relaxed);
+        if((atomic_load_explicit(&p->in[d], memory_order_relaxed) == 0
+            || atomic_load_explicit(&p->out[d], memory_order_relaxed) == 0)
+            && sscTrimClaim(p, d)){
+            sscTrim(p, d);
+        }
+    }
+}
+
+//! find the root of a component, halving the path on the way.
+static uint32_t sscFind(struct sscParallel *p, uint32_t d){
+    uint32_t parent, grand;
+
+    for(;;){
+        parent = atomic_load_explicit(&p->parent[d], memory_order_relaxed);
+        if(parent == d) return d;
+
+        grand = atomic_load_explicit(&p->parent[parent], memory_order_relaxed);
+        if(parent != grand){
+            atomic_compare_exchange_weak_explicit(&p->parent[d], &parent, grand,
+                memory_order_relaxed, memory_order_relaxed);
+        }
+        d = grand;
+    }
+}
+
+//! union two components, the root of larger number is linked to the other.
+static void sscUnion(struct sscParallel *p, uint32_t a, uint32_t b){
+    uint32_t t;
+
+    for(;;){
+        a = sscFind(p, a);
+        b = sscFind(p, b);
+        if(a == b) return;
+        if(a < b){
+            t = a;
+            a = b;
+            b = t;
+        }
+
+        t = a;
+        if(atomic_compare_exchange_strong_explicit(&p->parent[a], &t, b,
+            memory_order_relaxed, memory_order_relaxed)){
+            return;
+        }
+    }
+}
+
+static void sscParallelUnion(void *arg, uint32_t begin, uint32_t end){
+    struct sscParallel *p = arg;
+    vid_t u;
+    uint32_t w;
+    int count;
+
+    for(uint32_t d = begin; d < end; d++){
+        atomic_store_explicit(&p->cursor[d], 0, memory_order_relaxed);
+        if(sscTrimmed(p, d)) continue;
+
+        u = sscVertex(p, d);
+        count = vertexOutdegree(u);
+        for(int i = 0; i < count; i++){
+            w = sscDense(p, vertexArc(u, i));
+            if(!sscTrimmed(p, w)) sscUnion(p, d, w);
+        }
+    }
+}
+
+static void sscParallelMeasure(void *arg, uint32_t begin, uint32_t end){
+    struct sscParallel *p = arg;
+    uint32_t root;
+
+    for(uint32_t d = begin; d < end; d++){
+        if(sscTrimmed(p, d)) continue;
+
+        root = sscFind(p, d);
+        atomic_store_explicit(&p->parent[d], root, memory_order_relaxed);
+        atomic_fetch_add_explicit(&p->cursor[root], 1, memory_order_relaxed);
+    }
+}
+
+static void sscParallelPlace(void *arg, uint32_t begin, uint32_t end){
+    struct sscParallel *p = arg;
+    uint32_t root;
+
+    for(uint32_t d = begin; d < end; d++){
+        if(sscTrimmed(p, d)) continue;
+
+        root = atomic_load_explicit(&p->parent[d], memory_order_relaxed);
+        p->members[atomic_fetch_add_explicit(&p->cursor[root], 1, memory_order_relaxed)] = d;
+    }
+}
+
+static void sscParallelTarjan(void *arg, uint32_t begin, uint32_t end){
+    struct sscParallel *p = arg;
+    struct sscComponent *comp;
+    tarjanImpl_t impl;
+    vid_t u;
+
+    for(uint32_t c = begin; c < end; c++){
+        comp = &p->comps[c];
+        impl.frames = tarjanImpl.frames + comp->start;
+        impl.stack = tarjanImpl.stack + comp->start;
+        impl.ssc = tarjanImpl.ssc + comp->start;
+        impl.sscCount = tarjanImpl.sscCount + comp->start;
+        impl.capacity = comp->size;
+        impl.time = 0;
+        impl.top = -1;
+        impl.step = 0;
+        impl.count = 0;
+
+        for(uint32_t i = 0; i < comp->size; i++){
+            u = sscVertex(p, p->members[comp->start + i]);
+            if(!vertexVisited(u)) tarjan(&impl, u, false);
+        }
+        assert(impl.step == comp->size);
+        comp->count = impl.count;
+    }
+}
+
+/**
+ * @brief   find all ssc of the graph with the pool of workers.
+ * @return  the number of ssc of more than one vertex, -1 if there is no memory.
+ * @note    the ssc of more than one vertex are the same as those of the serial search,
+ *          as every cycle goes through a requesting thread. The ssc left in tarjanImpl
+ *          are those of the components, vertices trimmed have none.
+ */
+static int sscParallelSearch(void){
+    struct sscParallel *p = &sscParallel;
+    tarjanImpl_t *impl = &tarjanImpl;
+    uint32_t offset, arcs, size;
+    int deadlocks = 0;
+
+    if(p->pool == NULL){
+        p->pool = workPoolCreate(p->workers);
+        if(p->pool == NULL){
+            dlc_warn("no worker for the parallel search, it goes serial\n");
+            p->workers = 1;
+            return -1;
+        }
+    }
+
+    p->threads = graph.set[VERTEX_THREAD].top;
+    p->count = p->threads + graph.set[VERTEX_MUTEX].top;
+    if(sscParallelReserve(p, p->count) != DLC_OK) return -1;
+
+    //! 1. count the arcs, and lay the reversed arcs out.
+    memset(p->in, 0, p->count * sizeof(uint32_t));
+    memset(p->trimmed, 0, p->count * sizeof(uint8_t));
+    workPoolFor(p->pool, p->count, SSC_PARALLEL_GRAIN, sscParallelCount, p);
+
+    arcs = 0;
+    for(uint32_t d = 0; d < p->count; d++){
+        p->revStart[d] = arcs;
+        atomic_store_explicit(&p->cursor[d], arcs, memory_order_relaxed);
+        arcs += atomic_load_explicit(&p->in[d], memory_order_relaxed);
+    }
+    p->revStart[p->count] = arcs;
+    if(sscParallelReserveArcs(p, arcs) != DLC_OK) return -1;
+    workPoolFor(p->pool, p->count, SSC_PARALLEL_GRAIN, sscParallelReverse, p);
+
+    //! 2. trim, 3. union the rest into components.
+    workPoolFor(p->pool, p->count, SSC_PARALLEL_GRAIN, sscParallelTrim, p);
+    workPoolFor(p->pool, p->count, SSC_PARALLEL_GRAIN, sscParallelUnion, p);
+    workPoolFor(p->pool, p->count, SSC_PARALLEL_GRAIN, sscParallelMeasure, p);
+
+    //! 4. give each component its slice, and place its vertices.
+    offset = 0;
+    p->components = 0;
+    for(uint32_t d = 0; d < p->count; d++){
+        size = atomic_load_explicit(&p->cursor[d], memory_order_relaxed);
+        if(size == 0) continue;
+
+        p->comps[p->components].start = offset;
+        p->comps[p->components].size = size;
+        p->components++;
+        atomic_store_explicit(&p->cursor[d], offset, memory_order_relaxed);
+        offset += size;
+    }
+    workPoolFor(p->pool, p->count, SSC_PARALLEL_GRAIN, sscParallelPlace, p);
+
+    //! 5. search the components, and pack the counts of their ssc together.
+    workPoolFor(p->pool, p->components, 1, sscParallelTarjan, p);
+
+    impl->count = 0;
+    for(uint32_t c = 0; c < p->components; c++){
+        memmove(&impl->sscCount[impl->count], &impl->sscCount[p->comps[c].start],
+            p->comps[c].count * sizeof(int));
+        impl->count += p->comps[c].count;
+    }
+    impl->step = offset;
+
+    for (int i = 0; i < impl->count; ++i) {
+        if(impl->sscCount[i] > 1) deadlocks++;
+    }
+    return deadlocks;
+}
+
+/**
+ * @brief   find the ssc reachable from the threads requesting locks.
+ * @param   stopAtFirst is whether to stop at the first ssc of more than one vertex.
+ * @return  the number of ssc of more than one vertex, -1 if there is no memory.
+ * @note    the traversal state left by the last pass turns stale with a new epoch,
+ *          so nothing is reset, and a pass only touches the vertices it visits.
+ *          The ssc found are left in tarjanImpl. A full search of a large graph
+ *          runs on the pool of workers, see sscParallel.
+ */
+static int sscSearch(bool stopAtFirst){
+    tarjanImpl_t *impl = &tarjanImpl;
+    flatMapIterator_t iter;
+    flatMapEntry_t *entry;
+    int deadlocks = 0;
+    vid_t u;
 
     assert(requestThreadMap != NULL);
+    if(tarjanReserve(impl, graph.set[VERTEX_THREAD].live + graph.set[VERTEX_MUTEX].live) != DLC_OK){
+        return -1;
+    }
+    graphNextEpoch();
+    impl->time = 0;
+    impl->top = -1;
+    impl->step = 0;
+    impl->count = 0;
+
+    //! it only fails before any vertex is visited, then the search goes on serially.
+    if(!stopAtFirst && sscParallel.workers > 1 && graph.set[VERTEX_THREAD].live
+        + graph.set[VERTEX_MUTEX].live >= sscParallel.threshold){
+        deadlocks = sscParallelSearch();
+        if(deadlocks >= 0) return deadlocks;
+        deadlocks = 0;
+    }
+
+    flatMapIteratorInit(&iter, requestThreadMap);
+    while((entry = flatMapNext(&iter)) != NULL){  
+        u = (vid_t)entry->key;
+        if(!vertexVisited(u) && tarjan(impl, u, stopAtFirst)){
+            break;
+        }
+    }
+
+    for (int i = 0; i < impl->count; ++i) {
+        if(impl->sscCount[i] > 1) deadlocks++;
+    }
+    return deadlocks;
+}
+
+/**
+ * @brief   detect deadlocks among the threads requesting locks.
+ * @return  the number of deadlocks found.
+ * @note    all deadlocks are reported, so the search doesn't stop at the first.
+ */
+int strongConnectedComponent(){
+    int deadlocks;
+    int size = flatMapSize(requestThreadMap);
 
-    int size = hashMapSize(requestThreadMap);
     if(size == 0) {
         dlc_dbg("size == 0\n");
-        return;  //! return if there is no thread requesting lock.
-    }
-    static vertex_t *stack[NUMBER_OF_VERTEX];
-    static vertex_t *ssc[NUMBER_OF_VERTEX];
-    static int sscCount[NUMBER_OF_VERTEX];
-    static short time = 0;
-    //! initialise all variables used by the tarjan.
-    memset(sscCount, 0, sizeof(sscCount));
-    memset(stack, 0, sizeof(stack));
-    memset(ssc, 0, sizeof(ssc));
-    time = 0;
-
-    sscImpl_t sscImpl = {
-        .ssc = ssc,
-        .step = 0
-    };
-    sscCountImpl_t sscCountImpl = {
-        .sscCount = sscCount,
-        .step = 0
-    };
-    stackImpl_t stackImpl = {
-        .stack = stack,
-        .top = -1
-    };
+        return 0;  //! return if there is no thread requesting lock.
+    }
 
     dlc_warn("the number of request thread is %d\n", size);
-    hashMapIteratorInit(&iter, requestThreadMap);
-    while((entry = hashMapNext(&iter)) != NULL){  
-        u = entry->key;
-        threadInfo_t *ti = (threadInfo_t *)&u->private[0];
-        dlc_dbg("ti.name %s, ti.tid %ld\n", ti->name, ti->tid);
-        if(u->dfn == 0){
-            tarjan(u, &time, &stackImpl, &sscImpl, &sscCountImpl);
-        }
+    deadlocks = sscSearch(false);
+    if(deadlocks < 0){
+        dlc_warn("skip the pass, no memory for %d request threads\n", size);
+        return 0;
     }
 
-    dlc_warn("sscCount :%p sscCount[0] %d\n", sscCount, sscCount[0]);
-    if(sscCount[0] > 1){
-        displayInfo(ssc, sscCount, sizeof(sscCount) / sizeof(sscCount[0]));
+    if(deadlocks > 0){
+        displayInfo(tarjanImpl.ssc, tarjanImpl.sscCount, tarjanImpl.count);
         // extern long long start;
         // dlc_err("start %lld, resume %lld ms\n", start, (timeInMilliseconds() - start));
         // abort();
     }
-    clearTarjanStatus(&iter);
+    return deadlocks;
 }
 
 int getSSCCount(int *sscCount, int num){
@@ -378,9 +1258,9 @@ int getSSCCount(int *sscCount, int num){
     }
     return ret;
 }
-void reportDeadLock(vertex_t **ssc, int num);
+void reportDeadLock(vid_t *ssc, int num);
 
-void displayInfo(vertex_t **ssc, int *sscCount, int num){
+void displayInfo(vid_t *ssc, int *sscCount, int num){
     assert(ssc != NULL);
     assert(sscCount != NULL && num > 0);
 
@@ -397,29 +1277,395 @@ void displayInfo(vertex_t **ssc, int *sscCount, int num){
     }
 }
 
-void clearTarjanStatus(hashMapIterator_t *iter){
-    entry_t *entry;
-    vertex_t *u;
-    arc_t *head;
-    assert(iter);
-    hashMapIteratorReset(iter);
-    while((entry = hashMapNext(iter)) != NULL){  
-        u = entry->key;
-        u->dfn = 0;
-        u->low = 0;
-        u->inStack = false;
+/*--------------test for tarjan algorithm */
+//! test program
+// #define DLC_TEST
+#ifdef DLC_TEST
+#include "testhelp.h"
+
+/**
+ * @brief build a synthetic wait-for graph of threads and the mutexes they hold.
+ * @param chain is the count of threads of a chain of waits, a thread waits for the
+ *        mutex held by the next thread of its chain. The last chain is closed into
+ *        a cycle, and it's one ring of all threads if chain is the count of threads.
+ * @param closed is whether to close every chain into a cycle.
+ */
+static void sccTestBuild(vid_t *tvs, vid_t *mvs, long threads, long chain, bool closed){
+    long i, next;
+
+    for(i = 0; i < threads; i++){
+        tvs[i] = vertexCreate(VERTEX_THREAD);
+        mvs[i] = vertexCreate(VERTEX_MUTEX);
+        assert(tvs[i] != VID_NONE && mvs[i] != VID_NONE);
+        assert(vertexHold(mvs[i], tvs[i]) == DLC_OK);
+    }
+
+    for(i = 0; i < threads; i++){
+        if(i == threads - 1 || (closed && i % chain == chain - 1)){
+            next = i - i % chain;   //! close the chain.
+        }else if(i % chain != chain - 1){
+            next = i + 1;
+        }else{
+            continue;
+        }
+        vertexWait(tvs[i], mvs[next]);
+        assert(flatMapPut(requestThreadMap, tvs[i], NULL) == 1);
+    }
+}
+
+static void sccTestDestroy(vid_t *tvs, vid_t *mvs, long threads){
+    vid_t mv;
 
-        head = u->arcList;
-        while(head){
-            head->tail->dfn = 0;
-            head->tail->low = 0;
-            head->tail->inStack = false;
-            head = head->next;
+    for(long i = 0; i < threads; i++){
+        mv = vertexField(tvs[i], waitingOn);
+        if(mv != VID_NONE){
+            vertexUnwait(tvs[i], mv);
+            flatMapRemove(requestThreadMap, tvs[i]);
         }
+        vertexRelease(mvs[i], tvs[i]);
+    }
+    for(long i = 0; i < threads; i++){
+        vertexDestroy(tvs[i]);
+        vertexDestroy(mvs[i]);
     }
 }
 
+//! map each vertex of the ssc of more than one vertex to the least vertex of its ssc.
+static long sccTestSnapshot(flatMap_t *map){
+    vid_t *ssc = tarjanImpl.ssc, least;
+    long vertices = 0;
 
-/*--------------test for tarjan algorithm */
+    for(int i = 0; i < tarjanImpl.count; ssc += tarjanImpl.sscCount[i++]){
+        if(tarjanImpl.sscCount[i] < 2) continue;
 
+        least = ssc[0];
+        for(int j = 1; j < tarjanImpl.sscCount[i]; j++) least = DLC_MIN(least, ssc[j]);
+        for(int j = 0; j < tarjanImpl.sscCount[i]; j++){
+            flatMapPut(map, ssc[j], (void *)(size_t)least);
+        }
+        vertices += tarjanImpl.sscCount[i];
+    }
+    return vertices;
+}
+
+/**
+ * @brief whether the ssc found are those of a snapshot. As many ssc and vertices are
+ *        found, and each ssc lies in a ssc of the snapshot, so they are the same.
+ */
+static bool sccTestSame(flatMap_t *map, long vertices){
+    vid_t *ssc = tarjanImpl.ssc;
+    void *least;
+
+    for(int i = 0; i < tarjanImpl.count; ssc += tarjanImpl.sscCount[i++]){
+        if(tarjanImpl.sscCount[i] < 2) continue;
+
+        least = flatMapGet(map, ssc[0]);
+        for(int j = 0; j < tarjanImpl.sscCount[i]; j++){
+            if(least == NULL || flatMapGet(map, ssc[j]) != least) return false;
+        }
+        vertices -= tarjanImpl.sscCount[i];
+    }
+    return vertices == 0;
+}
+
+static void sccTestRun(const char *shape, long vertices, long chain, bool closed, int passes){
+    long threads = vertices / 2, found;
+    long long start, full, first, parallel;
+    int deadlocks, expected, workers;
+    vid_t *tvs, *mvs;
+    flatMap_t *map;
+
+    if(chain == 0) chain = threads;
+    expected = closed ? (threads - 1) / chain + 1 : 1;
+    tvs = zmalloc(threads * sizeof(vid_t));
+    mvs = zmalloc(threads * sizeof(vid_t));
+    sccTestBuild(tvs, mvs, threads, chain, closed);
+
+    //! serial first.
+    workers = sscParallel.workers;
+    sscParallel.workers = 1;
+    start = timeInMilliseconds();
+    for(int i = 0; i < passes; i++){
+        deadlocks = sscSearch(false);
+        assert(deadlocks == expected);
+    }
+    full = timeInMilliseconds() - start;
+    //! the ring is a single ssc of all vertices.
+    assert(chain != threads || tarjanImpl.step == threads * 2);
+
+    map = flatMapCreate(vertices);
+    found = sccTestSnapshot(map);
+
+    start = timeInMilliseconds();
+    for(int i = 0; i < passes; i++){
+        deadlocks = sscSearch(true);
+        assert(deadlocks == 1);
+    }
+    first = timeInMilliseconds() - start;
+
+    sscParallel.workers = workers;
+    start = timeInMilliseconds();
+    for(int i = 0; i < passes; i++){
+        deadlocks = sscSearch(false);
+        assert(deadlocks == expected);
+    }
+    parallel = timeInMilliseconds() - start;
+    assert(sccTestSame(map, found));
+
+    printf("%-6s %8ld vertices: full %9.3f, stop at first %9.3f, %d workers %9.3f ms/pass\n",
+        shape, vertices, (double)full / passes, (double)first / passes,
+        sscParallel.pool->workers, (double)parallel / passes);
+
+    flatMapDestroy(map);
+    sccTestDestroy(tvs, mvs, threads);
+    zfree(tvs);
+    zfree(mvs);
+}
+
+/* ./demo test scc [<vertices> [<workers>]], by default 10k, 100k and 1M vertices. */
+int sccTest(int argc, char **argv, int flags){
+    long sizes[] = {10000, 100000, 1000000};
+    int num = sizeof(sizes) / sizeof(sizes[0]);
+    int workers = 0;
+
+    if(argc >= 4){
+        sizes[0] = DLC_MAX(2, strtol(argv[3], NULL, 10));
+        num = 1;
+    }
+    if(argc >= 5) workers = atoi(argv[4]);
+
+    memInit();
+    mapAllInit();
+    assert(graphInit(NUMBER_OF_VERTEX_THREAD, NUMBER_OF_VERTEX_MUTEX) == DLC_OK);
+
+    //! the parallel search is timed at every size.
+    sscParallelConfigure(workers ? workers : NUMBER_OF_CHECK_WORKERS, 1);
+    assert(sscParallel.workers > 1);
+
+    for(int i = 0; i < num; i++){
+        int passes = DLC_MAX(1, 1000000 / sizes[i]);
+        sccTestRun("ring", sizes[i], 0, false, passes);
+        sccTestRun("chains", sizes[i], 16, false, passes);
+        sccTestRun("cycles", sizes[i], 16, true, passes);
+    }
+    return 0;
+}
 
+/**
+ * @brief play the events of a life of a mutex, as pthread_mutex_init(), lock(), unlock()
+ *        and, if destroyed, pthread_mutex_destroy() would generate them.
+ */
+static void retireTestLife(event_t *ev, size_t mid, bool destroyed){
+    ev->mutexInfo.mid = mid;
+    ev->mutexInfo.generation = shadowMapNextGeneration(&mutexShadowMap, mid);
+    for(int type = EVENT_WAITLOCK; type <= EVENT_RELEASELOCK; type++){
+        ev->type = type;
+        eventHandler(ev);
+    }
+    if(destroyed){
+        ev->type = EVENT_DESTROYLOCK;
+        ev->mutexInfo.generation = shadowMapNextGeneration(&mutexShadowMap, mid);
+        eventHandler(ev);
+    }
+}
+
+/* ./demo test retire [<lives>], mutexes created and dropped at a few recycled addresses,
+ * then mutexes never dropped, under a cap of as many vertices. */
+int retireTest(int argc, char **argv, int flags){
+    vertexSet_t *mutexes = &graph.set[VERTEX_MUTEX];
+    long j, lives = 1000000, slots = 1024;
+    long long start, elapsed;
+    event_t ev = {0};
+
+    if(argc >= 4) lives = DLC_MAX(slots, strtol(argv[3], NULL, 10));
+    memInit();
+    mapAllInit();
+    assert(graphInit(NUMBER_OF_VERTEX_THREAD, NUMBER_OF_VERTEX_MUTEX) == DLC_OK);
+    assert(mutexShadowMap.generations != NULL);
+    ev.threadInfo.tid = 1;
+
+    //! the mutexes look like pthread_mutex_t objects of a heap reusing its chunks.
+    for(int destroyed = 1; destroyed >= 0; destroyed--){
+        start = timeInMilliseconds();
+        for(j = 0; j < lives; j++){
+            retireTestLife(&ev, 0x7f0000001000UL + (j % slots) * 40, destroyed);
+            //! the memory stays flat as the lives go by.
+            assert(mutexes->live <= (size_t)slots && mutexShadowMap.used <= (size_t)slots);
+        }
+        elapsed = timeInMilliseconds() - start;
+        printf("%-10s %8ld lives in %8lld ms, mutex vertices %u, max %u\n",
+            destroyed ? "destroyed" : "reused", lives, elapsed, mutexes->live, mutexes->max);
+    }
+    shadowMapPrint(&mutexShadowMap);
+
+    //! the events of a life already ended are dropped.
+    ev.mutexInfo.mid = 0x7f0000001000UL;
+    ev.mutexInfo.generation = shadowMapGeneration(&mutexShadowMap, ev.mutexInfo.mid) - 1;
+    ev.type = EVENT_WAITLOCK;
+    eventHandler(&ev);
+    assert(flatMapSize(requestThreadMap) == 0);
+
+    //! mutexes never destroyed nor reused, cold vertices are evicted beyond the cap.
+    mutexes->cap = slots;
+    start = timeInMilliseconds();
+    for(j = 0; j < lives; j++){
+        retireTestLife(&ev, 0x7e0000001000UL + j * 40, false);
+        assert(mutexes->live <= (size_t)slots);
+    }
+    elapsed = timeInMilliseconds() - start;
+    printf("%-10s %8ld lives in %8lld ms, mutex vertices %u, evicted %lu\n",
+        "evicted", lives, elapsed, mutexes->live, mutexes->evicted);
+    assert(mutexes->evicted >= lives - slots);
+    graphPrint(VERTEX_MUTEX);
+    graphSetMemoryLimit(VERTEX_MUTEX, 0);
+    return 0;
+}
+
+enum{LOCK_ORDER_A, LOCK_ORDER_B, LOCK_ORDER_C, LOCK_ORDER_D, LOCK_ORDER_E, LOCK_ORDER_MUTEXES};
+
+static pthread_mutex_t lockOrderTestMutexes[LOCK_ORDER_MUTEXES];
+
+struct lockOrderTestNest{
+    const int *order;
+    int count;
+};
+
+static void *lockOrderTestLock(void *arg){
+    struct lockOrderTestNest *nest = (struct lockOrderTestNest *)arg;
+
+    for(int i = 0; i < nest->count; i++){
+        pthread_mutex_lock(&lockOrderTestMutexes[nest->order[i]]);
+    }
+    for(int i = nest->count - 1; i >= 0; i--){
+        pthread_mutex_unlock(&lockOrderTestMutexes[nest->order[i]]);
+    }
+    return NULL;
+}
+
+//! lock the mutexes one within another, by the test thread or by a thread of its own.
+static void lockOrderTestNest(const int *order, int count, bool thread){
+    struct lockOrderTestNest nest = {order, count};
+    pthread_t tid;
+
+    if(thread){
+        assert(pthread_create(&tid, NULL, lockOrderTestLock, &nest) == 0);
+        pthread_join(tid, NULL);
+    }else{
+        lockOrderTestLock(&nest);
+    }
+    eventLoopEnter();
+}
+
+//! lock the mutex u and then v.
+static void lockOrderTestRun(int u, int v, bool thread){
+    int order[] = {u, v};
+
+    lockOrderTestNest(order, 2, thread);
+}
+
+static bool lockOrderTestHas(int u, int v){
+    vid_t mu = mutexVertexLookup((size_t)&lockOrderTestMutexes[u]);
+    vid_t mv = mutexVertexLookup((size_t)&lockOrderTestMutexes[v]);
+
+    return mu != VID_NONE && mv != VID_NONE && lockOrderInfo(mu, mv) != NULL;
+}
+
+static void lockOrderTestDestroy(int u){
+    pthread_mutex_destroy(&lockOrderTestMutexes[u]);
+    eventLoopEnter();
+    assert(mutexVertexLookup((size_t)&lockOrderTestMutexes[u]) == VID_NONE);
+    pthread_mutex_init(&lockOrderTestMutexes[u], NULL);
+}
+
+/* ./demo test lockorder, threads one after another lock mutexes in orders which close a
+   cycle without ever deadlocking, the events are drained by the test in place of the
+   checker thread. Run it last, the hooks send events from then on. */
+int lockOrderTest(int argc, char **argv, int flags){
+    enum{A = LOCK_ORDER_A, B = LOCK_ORDER_B, C = LOCK_ORDER_C, D = LOCK_ORDER_D,
+        E = LOCK_ORDER_E};
+
+    //! the heap is reset, the maps and buffers the tests run before left on it are dropped.
+    memInit();
+    eventQueueMap = requestThreadMap = residentThreadMap = NULL;
+    vertexThreadMap = vertexMutexMap = lockOrderMap = NULL;
+    tarjanImpl.capacity = 0;
+    isEnabledLockOrder = true;
+    mapAllInit();
+    memPoolAllInit();
+    for(int i = 0; i < LOCK_ORDER_MUTEXES; i++){
+        pthread_mutex_init(&lockOrderTestMutexes[i], NULL);
+    }
+    lockOrderReports = 0;
+    assert(flatMapSize(lockOrderMap) == 0);
+
+    //! A -> B, B -> C, C -> A, a cycle closed by its last arc.
+    lockOrderTestRun(A, B, false);
+    assert(lockOrderTestHas(A, B) && lockOrderReports == 0);
+    lockOrderTestRun(B, C, true);
+    assert(lockOrderTestHas(B, C) && lockOrderReports == 0);
+    lockOrderTestRun(C, A, true);
+    assert(lockOrderTestHas(C, A) && lockOrderReports == 1);
+    printf("a cycle of orders by three threads in a row: reported\n");
+
+    //! the same orders again and orders consistent with them aren't reported.
+    for(int i = 0; i < 3; i++){
+        lockOrderTestRun(A, B, true);
+        lockOrderTestRun(B, C, true);
+        lockOrderTestRun(A, D, true);
+        lockOrderTestRun(B, D, i == 0);
+        lockOrderTestRun(C, D, true);
+    }
+    assert(lockOrderReports == 1 && flatMapSize(lockOrderMap) == 6);
+    printf("orders consistent with the arcs: not reported\n");
+
+    //! the arcs of a mutex destroyed are dropped, both from and into it.
+    lockOrderTestDestroy(B);
+    assert(flatMapSize(lockOrderMap) == 3);
+    assert(lockOrderTestHas(C, A) && lockOrderTestHas(A, D) && lockOrderTestHas(C, D));
+    printf("the arcs of a mutex destroyed: dropped\n");
+
+    //! the test thread cached A -> B, but it's an arc of the new life of B.
+    lockOrderTestRun(A, B, false);
+    assert(lockOrderTestHas(A, B) && flatMapSize(lockOrderMap) == 4);
+    lockOrderTestRun(B, C, true);
+    assert(lockOrderReports == 2);
+    printf("the order cache of a thread follows the lives of the mutexes: ok\n");
+
+    lockOrderTestDestroy(A);
+    assert(flatMapSize(lockOrderMap) == 2);
+    assert(lockOrderTestHas(B, C) && lockOrderTestHas(C, D));
+
+    //! holding A and B while locking D orders A before D too, which outlives B.
+    lockOrderTestNest((int []){A, B, D}, 3, true);
+    assert(lockOrderTestHas(A, B) && lockOrderTestHas(B, D) && lockOrderTestHas(A, D));
+    assert(flatMapSize(lockOrderMap) == 5 && lockOrderReports == 2);
+    lockOrderTestDestroy(B);
+    assert(flatMapSize(lockOrderMap) == 2 && lockOrderTestHas(A, D));
+    lockOrderTestRun(D, A, true);
+    assert(lockOrderReports == 3);
+    printf("the order of mutexes locked around a mutex destroyed: reported\n");
+
+    //! A turns cold under the hand, it's evicted under the cap along with A -> D, D -> A.
+    vertexSet_t *mutexes = &graph.set[VERTEX_MUTEX];
+    vid_t ma = mutexVertexLookup((size_t)&lockOrderTestMutexes[A]);
+    uint64_t evicted = mutexes->evicted, dropped = lockOrderDropped;
+    mutexes->hand = vidIndex(ma);
+    vertexField(ma, clock) = CLOCK_COLD;
+    mutexes->cap = mutexes->live;
+    lockOrderTestNest((int []){E}, 1, false);
+    mutexes->cap = 0;
+    assert(mutexes->evicted == evicted + 1 && lockOrderDropped == dropped + 2);
+    assert(mutexVertexLookup((size_t)&lockOrderTestMutexes[A]) == VID_NONE);
+    assert(flatMapSize(lockOrderMap) == 1 && lockOrderTestHas(C, D));
+    printf("the arcs of a cold mutex evicted: dropped\n");
+
+    for(int i = 0; i < LOCK_ORDER_MUTEXES; i++){
+        lockOrderTestDestroy(i);
+        pthread_mutex_destroy(&lockOrderTestMutexes[i]);
+    }
+    eventLoopEnter();
+    assert(flatMapSize(lockOrderMap) == 0 && lockOrderReports == 3);
+    isEnabledLockOrder = false;
+    return 0;
+}
+#endif
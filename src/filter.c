@@ -1,24 +1,9 @@
 #include "internal.h"
 #include "interface.h"
 
-static hashMap_t *filters;
+static flatMap_t *filters;
 bool isEnabledFilter = false;
 
-//! hash function for long.
-static uint64_t hashCallback(const void *key) {
-    extern size_t _hashCodeOfInteger(size_t key);
-    return _hashCodeOfInteger((size_t)key);
-}
-
-static HASH_MAP_OPS IntegerDictType = {
-    hashCallback,
-    NULL,
-    NULL,
-    NULL,
-    NULL,
-    NULL
-};
-
 /**
  * @brief create dlc filter.
  * @param list  a set of mutex lock to be filter.
@@ -27,11 +12,11 @@ static HASH_MAP_OPS IntegerDictType = {
  */ 
 void dlcFilterCreate(void **list, int size){
     assert(list && size > 0);
-    filters = hashMapCreate(&IntegerDictType, 1 >> 4);
+    filters = flatMapCreate(size);
     size_t i;
     for ( i = 0; i < size; i++)
     {   
-        hashMapPut(filters, list[i], (void *)i);
+        flatMapPut(filters, (size_t)list[i], (void *)i);
     }
 
     isEnabledFilter = true;
@@ -44,8 +29,8 @@ void dlcFilterCreate(void **list, int size){
  */ 
 void setFilter(void *arg){
     assert(filters && arg);
-    size_t val = hashMapSize(filters);
-    hashMapPut(filters, arg, (void *)val);
+    size_t val = flatMapSize(filters);
+    flatMapPut(filters, (size_t)arg, (void *)val);
 }
 
 /**
@@ -55,14 +40,14 @@ void setFilter(void *arg){
  */ 
 BOOL isFilter(void *arg){
     assert(arg); 
-    return hashMapFind(filters, arg) ? TRUE : FALSE;
+    return flatMapFind(filters, (size_t)arg) ? TRUE : FALSE;
 }
 
 /**
  * @brief destroy dlc filter.
  */ 
 void dlcFilterDestroy(){
-    hashMapDestroy(filters);
+    flatMapDestroy(filters);
 }
 
 
@@ -0,0 +1,430 @@
+/**
+ * @file    flatMap.c
+ * @author  qufeiyan
+ * @brief   open-addressing hash map specialised for integer and pointer keys.
+ * @version 1.0.0
+ * @date    2026/10/18 15:20:11
+ * @version Copyright (c) 2026
+ */
+
+/* Includes --------------------------------------------------------------------------------*/
+#include <string.h>
+#include "common.h"
+#include "dlcDef.h"
+#include "flatMap.h"
+#include "mem.h"
+
+/**
+ * @note A Robin Hood hash table with linear probing. An element is stored in a flat array
+ *       of slots, and the probe length of every slot is kept in a separate array of bytes,
+ *       so that a lookup mostly touches one or two cache lines and never allocates.
+ *
+ *       1. On insertion, an element which has probed further than the resident of a slot
+ *          takes the slot, and the resident moves on. It keeps the probe lengths short
+ *          and even, and a lookup stops as soon as it meets a slot probed less than itself.
+ *       2. On removal, the following elements are shifted back by one slot, so there are
+ *          no tombstones.
+ *       3. Keys are mixed by the finaliser of splitmix64, since the low bits of mutex
+ *          addresses are all zero and the high bits barely change.
+ *
+ * @attention 1. The map must not be modified while iterating it, a removal shifts elements.
+ *            2. All the operation is not thread-safed, we should be careful in the scenario of muilt-thread.
+ */
+
+#define FLATMAP_MIN_CAPACITY        (1 << 4)    //! aka 16
+#define FLATMAP_LOAD_FACTOR         (7)         //! grow when 7/8 of slots are used.
+#define FLATMAP_RATIO_OF_SHRINK     (8)         //! shrink when less than 1/8 of slots are used.
+#define FLATMAP_MAX_PROBE           (UINT8_MAX - 1)
+
+/**
+ * @brief the finaliser of splitmix64.
+ */
+static inline uint64_t flatMapHash(uint64_t key){
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ULL;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebULL;
+    key ^= key >> 31;
+    return key;
+}
+
+static size_t flatMapNextPower(size_t size){
+    size_t i = FLATMAP_MIN_CAPACITY;
+
+    while(i < size) i <<= 1;
+    return i;
+}
+
+/**
+ * @brief   allocate the slots of a map.
+ * @return  DLC_OK on success, DLC_ERR if there is no memory.
+ */
+static int flatMapAllocate(flatMap_t *map, size_t capacity){
+    uint8_t *buffer;
+
+    //! slots and probe lengths share a single allocation.
+    buffer = ztrycalloc(capacity * (sizeof(flatMapEntry_t) + sizeof(uint8_t)));
+    if(buffer == NULL) return DLC_ERR;
+
+    map->entries = (flatMapEntry_t *)buffer;
+    map->probes = buffer + capacity * sizeof(flatMapEntry_t);
+    map->mask = capacity - 1;
+    map->size = 0;
+    return DLC_OK;
+}
+
+/**
+ * @brief   store an element which is known to be absent.
+ * @param   entry [in/out] the element, which is replaced by the element left out on failure.
+ * @return  DLC_OK on success, DLC_ERR if an element probes too far. The element left out
+ *          is not counted in the size of the map then.
+ */
+static int flatMapInsert(flatMap_t *map, flatMapEntry_t *entry){
+    flatMapEntry_t swap;
+    size_t pos = flatMapHash(entry->key) & map->mask;
+    uint8_t probe = 1, tmp;
+
+    while(map->probes[pos] != 0){
+        //! the resident is richer than us, take its slot and move it on.
+        if(map->probes[pos] < probe){
+            swap = map->entries[pos];
+            map->entries[pos] = *entry;
+            *entry = swap;
+
+            tmp = map->probes[pos];
+            map->probes[pos] = probe;
+            probe = tmp;
+        }
+
+        pos = (pos + 1) & map->mask;
+        if(++probe > FLATMAP_MAX_PROBE){
+            return DLC_ERR;
+        }
+    }
+
+    map->entries[pos] = *entry;
+    map->probes[pos] = probe;
+    map->size++;
+    return DLC_OK;
+}
+
+/**
+ * @brief   move all elements into a table of the given capacity.
+ * @return  DLC_OK on success, DLC_ERR if there is no memory, the map is unchanged then.
+ */
+static int flatMapResize(flatMap_t *map, size_t capacity){
+    flatMap_t old = *map;
+    size_t i;
+
+    capacity = flatMapNextPower(DLC_MAX(capacity, map->minCapacity));
+    if(capacity == map->mask + 1) return DLC_OK;
+
+    while(1){
+        if(flatMapAllocate(map, capacity) != DLC_OK){
+            *map = old;
+            return DLC_ERR;
+        }
+
+        for(i = 0; i <= old.mask; i++){
+            flatMapEntry_t entry = old.entries[i];
+            if(old.probes[i] == 0) continue;
+            if(flatMapInsert(map, &entry) != DLC_OK) break;
+        }
+        if(i > old.mask) break;
+
+        //! a probe is too long for the capacity, which is unlikely with a good mixer.
+        zfree(map->entries);
+        capacity <<= 1;
+    }
+
+    zfree(old.entries);
+    return DLC_OK;
+}
+
+/**
+ * @brief create a map.
+ * @param capacity [in] the initial number of slots, the map never shrinks below it.
+ * @return the map, NULL if there is no memory.
+ */
+flatMap_t *flatMapCreate(size_t capacity){
+    flatMap_t *map = zmalloc(sizeof(flatMap_t));
+
+    map->minCapacity = flatMapNextPower(capacity);
+    if(flatMapAllocate(map, map->minCapacity) != DLC_OK){
+        zfree(map);
+        return NULL;
+    }
+    return map;
+}
+
+void flatMapDestroy(flatMap_t *map){
+    if(map == NULL) return;
+
+    zfree(map->entries);
+    zfree(map);
+}
+
+/**
+ * @brief find the slot of a key.
+ * @return the slot, NULL if the key is absent.
+ */
+flatMapEntry_t *flatMapFind(flatMap_t *map, size_t key){
+    size_t pos = flatMapHash(key) & map->mask;
+    uint8_t probe = 1;
+
+    //! stop at an empty slot, or at a slot richer than the key would be.
+    while(map->probes[pos] >= probe){
+        if(map->entries[pos].key == key){
+            return &map->entries[pos];
+        }
+        pos = (pos + 1) & map->mask;
+        probe++;
+    }
+    return NULL;
+}
+
+/**
+ * @brief get the value of a key.
+ * @return the value, NULL if the key is absent.
+ */
+void *flatMapGet(flatMap_t *map, size_t key){
+    flatMapEntry_t *entry = flatMapFind(map, key);
+    return entry ? entry->value : NULL;
+}
+
+/**
+ * @brief Add or Overwrite:
+ *        Add an element, discarding the old value if the key already exists.
+ * @return 1 if the key was added from scratch, 0 if there was already an element with
+ *         such key, -1 if there is no memory to add it.
+ */
+int flatMapPut(flatMap_t *map, size_t key, void *value){
+    flatMapEntry_t *found = flatMapFind(map, key);
+    flatMapEntry_t entry = {key, value};
+
+    if(found != NULL){
+        found->value = value;
+        return 0;
+    }
+
+    //! grow ahead, but the table still takes elements until it's full if it can't grow.
+    if((map->size + 1) * 8 > (map->mask + 1) * FLATMAP_LOAD_FACTOR){
+        if(flatMapResize(map, (map->mask + 1) << 1) != DLC_OK && map->size > map->mask){
+            return -1;
+        }
+    }
+
+    //! the element left out is another one once the key is stored, 
+    //! so it has to be stored anyway.
+    while(flatMapInsert(map, &entry) != DLC_OK){
+        if(flatMapResize(map, (map->mask + 1) << 1) != DLC_OK){
+            dlc_err("flatMap drops key %#lx\n", entry.key);
+            return entry.key == key ? -1 : 1;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief remove the k-v pair from the map.
+ * @return 0 on success or -1 if the element was not found.
+ */
+int flatMapRemove(flatMap_t *map, size_t key){
+    flatMapEntry_t *entry = flatMapFind(map, key);
+    size_t pos, next;
+
+    if(entry == NULL) return -1;
+
+    //! shift the following elements back, until an empty slot or an element in its home slot.
+    pos = entry - map->entries;
+    next = (pos + 1) & map->mask;
+    while(map->probes[next] > 1){
+        map->entries[pos] = map->entries[next];
+        map->probes[pos] = map->probes[next] - 1;
+        pos = next;
+        next = (next + 1) & map->mask;
+    }
+    map->probes[pos] = 0;
+    map->size--;
+
+    if(map->mask + 1 > map->minCapacity &&
+        map->size * FLATMAP_RATIO_OF_SHRINK < map->mask + 1){
+        //! it doesn't matter if it fails.
+        flatMapResize(map, map->size * 2);
+    }
+    return 0;
+}
+
+/**
+ * @brief get the next element of an iterator.
+ * @return the element, NULL if there are no more elements.
+ */
+flatMapEntry_t *flatMapNext(flatMapIterator_t *iter){
+    flatMap_t *map = iter->map;
+
+    while(iter->index <= map->mask){
+        if(map->probes[iter->index++] != 0){
+            return &map->entries[iter->index - 1];
+        }
+    }
+    return NULL;
+}
+
+/*------ test -------*/
+/* ------------------------------- Benchmark ---------------------------------*/
+
+#ifdef DLC_TEST
+#include <time.h>
+#include "hashMap.h"
+#include "testhelp.h"
+
+static uint64_t benchmarkHash(const void *key) {
+    extern size_t _hashCodeOfInteger(size_t key);
+    return _hashCodeOfInteger((size_t)key);
+}
+
+static HASH_MAP_OPS BenchmarkMapType = {
+    benchmarkHash,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+};
+
+static long long timeInNanoseconds(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+#define start_benchmark() start = timeInNanoseconds()
+#define end_benchmark(name, msg) do { \
+    elapsed = timeInNanoseconds() - start; \
+    printf("%-8s %-8s: %8ld items in %8.3f ms, %6.1f ns/op\n", name, msg, count, \
+        elapsed / 1e6, (double)elapsed / count); \
+} while(0)
+
+/**
+ * @brief   keys look like the addresses of mutexes in an array, which
+ *          are 8 bytes aligned and 40 bytes apart.
+ */
+static size_t *benchmarkKeys(long count, int shuffle){
+    size_t *keys = zmalloc(count * sizeof(size_t));
+    long j;
+
+    for (j = 0; j < count; j++) {
+        keys[j] = 0x7f0000001000UL + j * 40;
+    }
+
+    for (j = count - 1; shuffle && j > 0; j--) {
+        long k = rand() % (j + 1);
+        size_t tmp = keys[j];
+        keys[j] = keys[k];
+        keys[k] = tmp;
+    }
+    return keys;
+}
+
+static int flatMapBenchmark(long count){
+    long j;
+    long long start, elapsed;
+    size_t *keys = benchmarkKeys(count, 0);
+    size_t *lookups = benchmarkKeys(count, 1);
+    flatMap_t *map = flatMapCreate(FLATMAP_MIN_CAPACITY);
+
+    start_benchmark();
+    for (j = 0; j < count; j++) {
+        flatMapPut(map, keys[j], (void *)j);
+    }
+    end_benchmark("flatMap", "insert");
+    assert((long)flatMapSize(map) == count);
+
+    start_benchmark();
+    for (j = 0; j < count; j++) {
+        flatMapEntry_t *entry = flatMapFind(map, lookups[j]);
+        assert(entry != NULL && keys[(long)entry->value] == lookups[j]);
+    }
+    end_benchmark("flatMap", "lookup");
+
+    start_benchmark();
+    for (j = 0; j < count; j++) {
+        int retval = flatMapRemove(map, lookups[j]);
+        assert(retval == 0);
+    }
+    end_benchmark("flatMap", "remove");
+    assert(flatMapSize(map) == 0 && map->mask + 1 == FLATMAP_MIN_CAPACITY);
+
+    flatMapDestroy(map);
+    zfree(keys);
+    zfree(lookups);
+    return 0;
+}
+
+static int hashMapBenchmark(long count){
+    long j;
+    long long start, elapsed;
+    size_t *keys = benchmarkKeys(count, 0);
+    size_t *lookups = benchmarkKeys(count, 1);
+    HASH_MAP *map = hashMapCreate(&BenchmarkMapType, FLATMAP_MIN_CAPACITY);
+
+    start_benchmark();
+    for (j = 0; j < count; j++) {
+        hashMapPut(map, (void *)keys[j], (void *)j);
+    }
+    end_benchmark("hashMap", "insert");
+
+    start_benchmark();
+    for (j = 0; j < count; j++) {
+        ENTRY_INFO *entry = hashMapFind(map, (void *)lookups[j]);
+        assert(entry != NULL);
+    }
+    end_benchmark("hashMap", "lookup");
+
+    start_benchmark();
+    for (j = 0; j < count; j++) {
+        int retval = hashMapRemove(map, (void *)lookups[j]);
+        assert(retval == 0);
+    }
+    end_benchmark("hashMap", "remove");
+
+    hashMapDestroy(map);
+    zfree(keys);
+    zfree(lookups);
+    return 0;
+}
+
+/**
+ * ./demo test fmap [<count>]
+ *
+ * Compare with hashMap at 1k, 100k and 1M keys, or at the given count. hashMap allocates
+ * an entry per key from the heap, which is reserved large enough for 1M of them.
+ */
+#define SIZE_OF_FLATMAP_TEST_HEAP   ((size_t)128 << 20)
+
+int flatMapTest(int argc, char **argv, int flags) {
+    long counts[] = {1000, 100000, 1000000};
+    int i, num = sizeof(counts) / sizeof(counts[0]);
+    long count;
+
+    #if !IS_USE_MEM_LIBC_MALLOC
+    memConfigure(SIZE_OF_FLATMAP_TEST_HEAP, DLC_HUGEPAGE_NONE);
+    memInit();
+    #endif
+
+    if (argc == 4) {
+        counts[0] = strtol(argv[3], NULL, 10);
+        num = 1;
+    }
+
+    for (i = 0; i < num; i++) {
+        count = counts[i];
+        if (flatMapBenchmark(count) != 0) return 1;
+        if (hashMapBenchmark(count) != 0) return 1;
+    }
+
+    //! the tests after it take the default heap again.
+    memConfigure(0, DLC_HUGEPAGE_NONE);
+    return 0;
+}
+#endif
@@ -6,16 +6,23 @@
 #include "hashMap.h"
 #include "common.h"
 /**
- * @note A simple hash table that does not have the ability to dynamically change its size.
+ * @note A simple hash table which grows and shrinks with the number of its elements.
+ *       The table is resized incrementally: while rehashing, the map has two tables, 
+ *       and each write operation migrates a few buckets from the old table to the new
+ *       one, so that no single operation pays for the whole migration.
  * 
- * @attention 1. The usage scenario must be explicit when using it because we fixed the capacity 
- *            of table.
+ * @attention 1. Lookups never migrate buckets, so it's safe to look up a map while iterating it,
+ *            but the map must not be modified while iterating it.
  *            2. All the operation is not thread-safed, we should be careful in the scenario of muilt-thread.
  */ 
 
 #define TABLE_DEFAULT_CAPACITY          (1 << 7)   //! aka 128
 
-#define TABLE_DEFAULT_MIN_CAPACITY      (1 << 4)   //! aka 128
+#define TABLE_DEFAULT_MIN_CAPACITY      (1 << 4)   //! aka 16
+
+#define TABLE_RATIO_OF_SHRINK           (8)        //! shrink when less than 1/8 of buckets are used.
+
+#define TABLE_REHASH_STEP               (1)        //! buckets migrated by a write operation.
 
 // #define KEY_VALUE_INVAILID_INTEGER  (const void *)(-(1 << (sizeof(void *) - 1)) - 1)
 
@@ -54,6 +61,7 @@
 #define mapGetEntryKey(entry) ((entry)->key)
 #define mapGetEntryVal(entry) ((entry)->value)
 #define mapSize(map) ((map)->size)
+#define mapIsRehashing(map) ((map)->rehashIndex != -1)
 
 
 /* global sigleton in this module. */
@@ -85,6 +93,105 @@ static unsigned long _mapNextPower(unsigned long size)
     }
 }
 
+/* Performs N steps of incremental rehashing. Returns 1 if there are still
+ * keys to move from the old to the new hash table, otherwise 0 is returned.
+ *
+ * Note that a rehashing step consists in moving a bucket (that may have more
+ * than one key as we use chaining) from the old to the new hash table, however
+ * since part of the hash table may be composed of empty spaces, it is not
+ * guaranteed that this function will rehash even a single bucket, since it
+ * will visit at max N*10 empty buckets in total, otherwise the amount of
+ * work it does would be unbound and the function may block for a long time. */
+static int _mapRehash(HASH_MAP *map, int n)
+{
+    int emptyVisits = n * 10; /* Max number of empty buckets to visit. */
+    if (!mapIsRehashing(map)) return 0;
+
+    while (n-- && map->rehashIndex < map->capacity[0]) {
+        ENTRY_INFO *entry, *nextEntry;
+
+        while (map->table[0][map->rehashIndex] == NULL) {
+            map->rehashIndex++;
+            if (map->rehashIndex >= map->capacity[0] || --emptyVisits == 0) break;
+        }
+        if (map->rehashIndex >= map->capacity[0]) break;
+        if (map->table[0][map->rehashIndex] == NULL) return 1;
+
+        /* Move all the keys in this bucket from the old to the new hash table */
+        entry = map->table[0][map->rehashIndex];
+        while (entry) {
+            uint64_t idx;
+
+            nextEntry = entry->next;
+            idx = mapHashKey(map, entry->key) & (map->capacity[1] - 1);
+            entry->next = map->table[1][idx];
+            map->table[1][idx] = entry;
+            entry = nextEntry;
+        }
+        map->table[0][map->rehashIndex] = NULL;
+        map->rehashIndex++;
+    }
+
+    /* Check if we already rehashed the whole table... */
+    if (map->rehashIndex >= map->capacity[0]) {
+        zfree(map->table[0]);
+        map->table[0] = map->table[1];
+        map->capacity[0] = map->capacity[1];
+        map->table[1] = NULL;
+        map->capacity[1] = 0;
+        map->rehashIndex = -1;
+        return 0;
+    }
+
+    /* More to rehash... */
+    return 1;
+}
+
+/* Start to migrate the map into a table of the given capacity, which is
+ * rounded up to a power of two. Nothing is done while the map is rehashing,
+ * or if the capacity doesn't change. */
+static void _mapResize(HASH_MAP *map, unsigned long capacity)
+{
+    ENTRY_INFO **table;
+
+    if (capacity < (unsigned long)map->minCapacity) capacity = map->minCapacity;
+    capacity = _mapNextPower(capacity);
+    if (mapIsRehashing(map) || (long)capacity == map->capacity[0]) return;
+
+    table = ztrycalloc(sizeof(ENTRY_INFO *) * capacity);
+    /* Keep the current table if there is no memory for a new one, the map
+     * still works, just with longer chains. */
+    if (table == NULL) return;
+
+    /* An empty map has nothing to migrate. */
+    if (mapSize(map) == 0) {
+        zfree(map->table[0]);
+        map->table[0] = table;
+        map->capacity[0] = capacity;
+        return;
+    }
+
+    map->table[1] = table;
+    map->capacity[1] = capacity;
+    map->rehashIndex = 0;
+}
+
+/* Grow the map when the number of elements reaches the number of buckets. */
+static void _mapExpandIfNeeded(HASH_MAP *map)
+{
+    if (!mapIsRehashing(map) && mapSize(map) >= map->capacity[0])
+        _mapResize(map, mapSize(map) * 2);
+}
+
+/* Shrink the map when most buckets are empty, but never below the capacity
+ * it was created with. */
+static void _mapShrinkIfNeeded(HASH_MAP *map)
+{
+    if (!mapIsRehashing(map) && map->capacity[0] > map->minCapacity &&
+        mapSize(map) * TABLE_RATIO_OF_SHRINK <= map->capacity[0])
+        _mapResize(map, mapSize(map) * 2);
+}
+
 /* Returns the index of a free slot that can be populated with
  * a hash entry for the given 'key'.
  * If the key already exists, -1 is returned
@@ -94,20 +201,23 @@ static unsigned long _mapNextPower(unsigned long size)
  * index is always returned in the context of the second (new) hash table. */
 static long _mapKeyIndex(HASH_MAP *map, const void *key, uint64_t hash, ENTRY_INFO **existing)
 {
-    unsigned long idx;
+    unsigned long idx = 0;
+    int table;
     ENTRY_INFO *he;
     if (existing) *existing = NULL;
 
-    idx = hash & (map->capacity - 1);
-    // dlc_dbg("key %lu, hash %llu, idx %ld\n", (size_t)key, hash, idx);
-    /* Search if this slot does not already contain the given key */
-    he = map->table[idx];
-    while(he) {
-        if (key == he->key || mapCompareKeys(map, key, he->key)) {
-            if (existing) *existing = he;
-            return -1;
+    for (table = 0; table <= 1; table++) {
+        idx = hash & (map->capacity[table] - 1);
+        /* Search if this slot does not already contain the given key */
+        he = map->table[table][idx];
+        while(he) {
+            if (key == he->key || mapCompareKeys(map, key, he->key)) {
+                if (existing) *existing = he;
+                return -1;
+            }
+            he = he->next;
         }
-        he = he->next;
+        if (!mapIsRehashing(map)) break;
     }
     return idx;
 }
@@ -134,6 +244,10 @@ ENTRY_INFO *hashMapAddRaw(HASH_MAP *map, void *key, ENTRY_INFO **existing)
 {
     long index;
     ENTRY_INFO *entry;
+
+    _mapRehash(map, TABLE_REHASH_STEP);
+    _mapExpandIfNeeded(map);
+
     /* Get the index of the new element, or -1 if
      * the element already exists. */
     if ((index = _mapKeyIndex(map, key, mapHashKey(map, key), existing)) == -1)
@@ -141,8 +255,10 @@ ENTRY_INFO *hashMapAddRaw(HASH_MAP *map, void *key, ENTRY_INFO **existing)
     // dlc_info("key %ld, index %lu\n", (long)key, index);
     entry = zmalloc(sizeof(*entry));
 
-    entry->next = map->table[index];
-    map->table[index] = entry;
+    /* Insert the element in the new table while rehashing. */
+    ENTRY_INFO **table = map->table[mapIsRehashing(map) ? 1 : 0];
+    entry->next = table[index];
+    table[index] = entry;
     map->size++;
 
     /* Set the hash entry fields. */
@@ -184,7 +300,7 @@ int hashMapPut(HASH_MAP *map, void *key, void *val)
  * @param map  [in] hash map to be initialised.
  * @param type [in] type of key-value pair. 
  * @param table [in] the bucket that will be used to store key-value data.
- * @param capacity [in] the size of bucket.
+ * @param capacity [in] the initial size of bucket, the map never shrinks below it.
  */
 void* hashMapCreate(HASH_MAP_OPS* type, size_t capacity){
     dlc_isInvalid(type == NULL);
@@ -194,66 +310,34 @@ void* hashMapCreate(HASH_MAP_OPS* type, size_t capacity){
     map->type = type; 
 
     capacity = _mapNextPower(capacity);
-    map->table = zmalloc(sizeof(ENTRY_INFO *) * capacity);
-    memset(map->table, 0, sizeof(ENTRY_INFO *) * capacity);
-    map->capacity = capacity;
+    map->table[0] = zcalloc(sizeof(ENTRY_INFO *) * capacity);
+    map->capacity[0] = capacity;
+    map->table[1] = NULL;
+    map->capacity[1] = 0;
+    map->minCapacity = capacity;
+    map->rehashIndex = -1;
     map->size = 0;
     return map;
 }
 
-#if 0
-/**
- * @brief put key-val into map. add or replace.
- * @param type  [in] type of key to be insert.
- * @param key   [in]
- * @param value [in]
- */
-void hashMapPut(HASH_MAP* map, const void* key, const void* value){
-    dlc_isInvalid(map == NULL || key == NULL || value == NULL);    
-    
-    int index = map->hashCode(type,  key) & (TABLE_DEFAULT_CAPACITY - 1);
-    ENTRY_INFO *table = map->table;
-    if(type == TYPE_ENTRY_INTERGER && key == KEY_VALUE_INVAILID_INTEGER){ 
-        table[index].key = key;
-        table[index].value = value;    
-        table[index].next = NULL;
-        map->size++;
-    }else{
-        ENTRY_INFO *head = map->table[index];
-
-        while (head){
-            if(map->equal(type, head->key, key)){
-                head->value = value;
-                return;
-            }
-            head = head->next;
-        }
-
-        ENTRY_INFO *cur = allocFromPool(TYPE_ENTRY_INFO);
-        assert(cur == NULL);
-        cur->key = key;
-        cur->value = value;
-        /* head-insert */
-        cur->next = map->table[index].next;
-        map->table[index].next = cur;
-        map->size++;
-    }
-}
-#endif 
-
 ENTRY_INFO *hashMapFind(HASH_MAP *map, const void *key)
 {
     ENTRY_INFO *entry;
-    uint64_t idx;
+    uint64_t hash, idx;
+    int table;
 
     if (mapSize(map) == 0) return NULL; /* dict is empty */
 
-    idx = mapHashKey(map, key) & (map->capacity - 1);
-    entry = map->table[idx];
-    while(entry) {
-        if (key == entry->key || mapCompareKeys(map, key, entry->key))
-            return entry;
-        entry = entry->next;
+    hash = mapHashKey(map, key);
+    for (table = 0; table <= 1; table++) {
+        idx = hash & (map->capacity[table] - 1);
+        entry = map->table[table][idx];
+        while(entry) {
+            if (key == entry->key || mapCompareKeys(map, key, entry->key))
+                return entry;
+            entry = entry->next;
+        }
+        if (!mapIsRehashing(map)) break;
     }
     
     return NULL;
@@ -282,24 +366,36 @@ void* hashMapGet(HASH_MAP *map, const void* key){
  */ 
 int hashMapRemove(HASH_MAP *map, const void* key){
     dlc_isInvalid(map == NULL);
-    int index = mapHashKey(map,  key) & (map->capacity - 1);
-    ENTRY_INFO *cur = map->table[index];
-    ENTRY_INFO *pre = NULL;
-    while(cur){
-        if(key == cur->key || mapCompareKeys(map, key, cur->key)){
-            /* Unlink the element from the list */
-            if (pre)
-                pre->next = cur->next;
-            else
-                map->table[index] = cur->next;
-            mapFreeEntryKey(map, cur);
-            mapFreeEntryVal(map, cur);
-            zfree(cur);
-            map->size--;
-            return 0;
+    uint64_t hash, idx;
+    int table;
+
+    if (mapSize(map) == 0) return -1;
+
+    _mapRehash(map, TABLE_REHASH_STEP);
+
+    hash = mapHashKey(map, key);
+    for (table = 0; table <= 1; table++) {
+        idx = hash & (map->capacity[table] - 1);
+        ENTRY_INFO *cur = map->table[table][idx];
+        ENTRY_INFO *pre = NULL;
+        while(cur){
+            if(key == cur->key || mapCompareKeys(map, key, cur->key)){
+                /* Unlink the element from the list */
+                if (pre)
+                    pre->next = cur->next;
+                else
+                    map->table[table][idx] = cur->next;
+                mapFreeEntryKey(map, cur);
+                mapFreeEntryVal(map, cur);
+                zfree(cur);
+                map->size--;
+                _mapShrinkIfNeeded(map);
+                return 0;
+            }
+            pre = cur;
+            cur = cur->next;
         }
-        pre = cur;
-        cur = cur->next;
+        if (!mapIsRehashing(map)) break;
     }
     return -1;
 }
@@ -314,24 +410,27 @@ inline int hashMapSize(HASH_MAP *map){
 
 void hashMapDestroy(HASH_MAP* map){
     dlc_isInvalid(map == NULL);
-    if (mapSize(map) == 0) return ; /* dict is empty */
 
-    int i;
+    long i;
+    int table;
     /* Free all the elements */
-    for (i = 0; i < map->capacity && map->size > 0; i++) {
-        ENTRY_INFO *he, *nextHe;
-        if ((he = map->table[i]) == NULL) continue;
-        while(he) {
-            nextHe = he->next;
-            mapFreeEntryKey(map, he);
-            mapFreeEntryVal(map, he);
-            zfree(he);
-            map->size--;
-            he = nextHe;
+    for (table = 0; table <= 1; table++) {
+        for (i = 0; i < map->capacity[table] && map->size > 0; i++) {
+            ENTRY_INFO *he, *nextHe;
+            if ((he = map->table[table][i]) == NULL) continue;
+            while(he) {
+                nextHe = he->next;
+                mapFreeEntryKey(map, he);
+                mapFreeEntryVal(map, he);
+                zfree(he);
+                map->size--;
+                he = nextHe;
+            }
         }
+        /* Free the table */
+        zfree(map->table[table]);
     }
-    /* Free the table and the allocated cache structure */
-    zfree(map->table);
+    /* Free the allocated cache structure */
     zfree(map);
 }
 
@@ -346,6 +445,7 @@ void *hashMapGetIterator(HASH_MAP *map)
     HASH_MAP_ITERATOR *iter = zmalloc(sizeof(*iter));
 
     iter->map = map;
+    iter->table = 0;
     iter->index = -1;
     iter->entry = NULL;
     iter->nextEntry = NULL;
@@ -357,10 +457,16 @@ ENTRY_INFO *hashMapNext(HASH_MAP_ITERATOR *iter)
     while (1) {
         if (iter->entry == NULL) {
             iter->index++;
-            if (iter->index >= iter->map->capacity) {
-                break;
+            if (iter->index >= iter->map->capacity[iter->table]) {
+                /* Go on with the new table while rehashing. */
+                if (iter->table == 0 && mapIsRehashing(iter->map)) {
+                    iter->table++;
+                    iter->index = 0;
+                } else {
+                    break;
+                }
             }
-            iter->entry = iter->map->table[iter->index];
+            iter->entry = iter->map->table[iter->table][iter->index];
         } else {
             iter->entry = iter->nextEntry;
         }
@@ -439,7 +545,8 @@ int hashMapTest(int argc, char **argv, int flags) {
     long j;
     long long start, elapsed;
     HASH_MAP *map;
-    map = hashMapCreate(&BenchmarkDictType, TABLE_DEFAULT_CAPACITY);
+    memInit();
+    map = hashMapCreate(&BenchmarkDictType, TABLE_DEFAULT_MIN_CAPACITY);
     long count = 0;
     int accurate = (flags & DLC_TEST_ACCURATE);
 
@@ -461,6 +568,7 @@ int hashMapTest(int argc, char **argv, int flags) {
     }
     end_benchmark("Inserting");
     assert((long)mapSize(map) == count);
+    printf("capacity %ld, rehashing %d\n", map->capacity[0], mapIsRehashing(map));
 
     start_benchmark();
     for (j = 0; j < count; j++) {
@@ -503,6 +611,14 @@ int hashMapTest(int argc, char **argv, int flags) {
     }
     end_benchmark("Removing and adding");
 
+    start_benchmark();
+    for (j = 0; j < count + 17; j++) {
+        hashMapRemove(map, (void *)j);
+    }
+    end_benchmark("Removing");
+    assert(mapSize(map) == 0);
+    printf("capacity %ld, rehashing %d\n", map->capacity[0], mapIsRehashing(map));
+
     start_benchmark();
     hashMapDestroy(map);
     end_benchmark("Destroy map");
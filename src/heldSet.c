@@ -0,0 +1,104 @@
+/**
+ * @file    heldSet.c
+ * @author  qufeiyan
+ * @brief   the mutexes held by a thread, kept by the hooks of the thread itself.
+ * @version 1.0.0
+ * @date    2026/10/19 01:48:26
+ * @version Copyright (c) 2026
+ */
+
+/* Includes --------------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include "heldSet.h"
+#include "common.h"
+
+/**
+ * @note The hooks of a thread search the set on every lock and unlock, so that a relock,
+ *       an unlock of a mutex not held, and an unlock out of order are found by the thread
+ *       itself, before it blocks. A thread rarely holds more than a few mutexes, so the
+ *       set is a small array searched at once, rather than a map.
+ */
+
+/**
+ * @brief remove the mutex in a slot, the mutexes locked after it move down a slot.
+ */
+void heldSetRemove(heldSet_t *set, int slot){
+    assert(slot >= 0 && (uint32_t)slot < set->count);
+
+    set->count--;
+    memmove(&set->mid[slot], &set->mid[slot + 1], (set->count - slot) * sizeof(size_t));
+}
+
+/**
+ * @brief print the mutexes held, the last one locked first.
+ */
+void heldSetPrint(const heldSet_t *set, const char *prefix){
+    fprintf(stderr, "%s  \t holds %u locks", prefix, set->count + set->overflow);
+    for(int i = (int)set->count - 1; i >= 0; i--){
+        fprintf(stderr, " #%p", (void *)set->mid[i]);
+    }
+    fprintf(stderr, set->overflow != 0 ? " ...\n" : "\n");
+}
+
+// #define DLC_TEST
+#ifdef DLC_TEST
+#include <stdlib.h>
+#include "testhelp.h"
+
+static int heldSetFindScalar(const heldSet_t *set, size_t mid){
+    for(int i = (int)set->count - 1; i >= 0; i--){
+        if(set->mid[i] == mid) return i;
+    }
+    return -1;
+}
+
+/* ./demo test held [<ops>], each depth of 1 to 16 mutexes held is searched ops times for
+   a mutex not held, the worst case, with the compare at once and with a loop. */
+int heldSetTest(int argc, char **argv, int flags){
+    long ops = 10000000;
+    heldSet_t set = {.count = 0};
+    volatile size_t key = 0x5000;
+    long long simd, scalar;
+    volatile long found = 0;
+
+    if(argc >= 4) ops = strtol(argv[3], NULL, 10);
+
+    //! the slots above count are never found, the same mutex relocked is found on top.
+    for(int i = 0; i < SIZE_OF_HELD_SET; i++){
+        heldSetPush(&set, 0x1000 + i * 0x40);
+    }
+    for(int i = 0; i < SIZE_OF_HELD_SET; i++){
+        assert(heldSetFind(&set, 0x1000 + i * 0x40) == i);
+    }
+    heldSetPush(&set, 0x1000);
+    assert(set.overflow == 1);
+    set.overflow = 0;
+    heldSetRemove(&set, 3);
+    assert(set.count == SIZE_OF_HELD_SET - 1 && heldSetFind(&set, 0x1000 + 3 * 0x40) == -1);
+    assert(heldSetFind(&set, 0x1000 + 4 * 0x40) == 3);
+    heldSetPush(&set, 0x1000);
+    assert(heldSetFind(&set, 0x1000) == SIZE_OF_HELD_SET - 1);
+    set.count = 2;
+    assert(heldSetFind(&set, 0x1000 + 5 * 0x40) == -1);
+
+    for(uint32_t depth = 1; depth <= SIZE_OF_HELD_SET; depth++){
+        set.count = depth;
+        simd = timeInMilliseconds();
+        for(long j = 0; j < ops; j++){
+            found += heldSetFind(&set, key);
+        }
+        simd = timeInMilliseconds() - simd;
+
+        scalar = timeInMilliseconds();
+        for(long j = 0; j < ops; j++){
+            found += heldSetFindScalar(&set, key);
+        }
+        scalar = timeInMilliseconds() - scalar;
+        printf("depth %2u x %ld finds: at once %5lld ms, loop %5lld ms\n",
+            depth, ops, simd, scalar);
+    }
+    assert(found == -2 * ops * SIZE_OF_HELD_SET);
+    return 0;
+}
+#endif
@@ -9,7 +9,8 @@
 
 /* Includes --------------------------------------------------------------------------------*/
 #include <stdatomic.h>
-#include "hashMap.h"
+#include "flatMap.h"
+#include "interface.h"
 #include "internal.h"
 #include "common.h"
 #include "mempool.h"
@@ -17,35 +18,20 @@
 #include "vertex.h"
 
 
-hashMap_t *eventQueueMap = NULL;
-hashMap_t *requestThreadMap = NULL;
-hashMap_t *vertexThreadMap = NULL;
-hashMap_t *vertexMutexMap = NULL;
-hashMap_t *residentThreadMap = NULL;
-memPool_t *eventQueueMemPool = NULL, *eventQueueBufferMemPool = NULL;
-memPool_t *threadVertexMemPool = NULL, *mutexVertexMemPool = NULL;
-memPool_t *arcMemPool = NULL;
-spinlock_t eventQueueMemPoolLock = {.lock = ATOMIC_FLAG_INIT};
-spinlock_t eventQueueBufferMemPoolLock = {.lock = ATOMIC_FLAG_INIT};
-spinlock_t eventQueueMapLock = {.lock = ATOMIC_FLAG_INIT};
+flatMap_t *eventQueueMap = NULL;
+flatMap_t *requestThreadMap = NULL;
+flatMap_t *vertexThreadMap = NULL;
+flatMap_t *vertexMutexMap = NULL;
+shadowMap_t mutexShadowMap = {.slots = NULL};
+flatMap_t *residentThreadMap = NULL;
+bool isEnabledLockOrder = false;
+flatMap_t *lockOrderMap = NULL;
+memPool_t *eventQueueMemPools[NUMBER_OF_NUMA_NODES] = {NULL};
+memPool_t *eventQueueBufferMemPools[NUMBER_OF_NUMA_NODES] = {NULL};
+spinlock_t eventQueueMapLock = SPINLOCK_INITIALIZER;
 
 atomic_long atomicThreadCounts = 0;
 
-//! hash function for long.
-static uint64_t hashCallback(const void *key) {
-    extern size_t _hashCodeOfInteger(size_t key);
-    return _hashCodeOfInteger((size_t)key);
-}
-
-static HASH_MAP_OPS IntegerMapType = {
-    hashCallback,
-    NULL,
-    NULL,
-    NULL,
-    NULL,
-    NULL
-};
-
 /**
  * @brief   1. Initialise a map that will record all threads and its eventqueue.
  *          2. Initialise a map that will record threads requesting mutex and not holding it.
@@ -53,28 +39,32 @@ static HASH_MAP_OPS IntegerMapType = {
  */
 void mapAllInit(){
     if(eventQueueMap == NULL){
-        eventQueueMap = (hashMap_t *)hashMapInitLocked(&IntegerMapType, 
-            NUMBER_OF_EVENTQUEUE, &eventQueueMapLock);
+        eventQueueMap = flatMapInitLocked(NUMBER_OF_EVENTQUEUE, &eventQueueMapLock);
     }
 
     if(requestThreadMap == NULL){
-        requestThreadMap = (hashMap_t *)hashMapCreate(&IntegerMapType, 
-            NUMBER_OF_THREAD);
+        requestThreadMap = flatMapCreate(NUMBER_OF_THREAD);
     }
 
     if(vertexThreadMap == NULL){
-        vertexThreadMap = (hashMap_t *)hashMapCreate(&IntegerMapType, 
-            NUMBER_OF_VERTEX_THREAD);
+        vertexThreadMap = flatMapCreate(NUMBER_OF_VERTEX_THREAD);
     }
 
     if(vertexMutexMap == NULL){
-        vertexMutexMap = (hashMap_t *)hashMapCreate(&IntegerMapType, 
-            NUMBER_OF_VERTEX_MUTEX);
+        vertexMutexMap = flatMapCreate(NUMBER_OF_VERTEX_MUTEX);
+    }
+
+    //! mutex vertices are indexed by the shadow, vertexMutexMap keeps those it can't hold.
+    if(mutexShadowMap.slots == NULL){
+        shadowMapInit(&mutexShadowMap, "mutex shadow");
     }
 
     if(residentThreadMap == NULL){
-        residentThreadMap = (hashMap_t *)hashMapCreate(&IntegerMapType, 
-            NUMBER_OF_VERTEX_THREAD);
+        residentThreadMap = flatMapCreate(NUMBER_OF_VERTEX_THREAD);
+    }
+
+    if(isEnabledLockOrder && lockOrderMap == NULL){
+        lockOrderMap = flatMapCreate(NUMBER_OF_VERTEX_MUTEX);
     }
 }
 
@@ -85,56 +75,87 @@ void mapAllInit(){
  * @note    this function must be called int the initial phase of program.  
  */
 void memPoolAllInit(){
-    if(eventQueueMemPool == NULL){
-        eventQueueMemPool = memPoolLockedDefine("eq", 
-            NUMBER_OF_EVENTQUEUE, SIZE_OF_EVENTQUEUE,
-            &eventQueueMemPoolLock);
+    int nodes = memNumaNodes();
+    char name[SIZE_OF_NAME];
+
+    //! the event queues of a thread are placed on the node it runs on, as the thread
+    //! writes them on every lock operation.
+    for(int node = 0; node < nodes; node++){
+        if(eventQueueMemPools[node] == NULL){
+            snprintf(name, sizeof(name), nodes > 1 ? "eq%d" : "eq", node);
+            eventQueueMemPools[node] = memPoolNodeDefine(name,
+                (NUMBER_OF_EVENTQUEUE - 1) / nodes + 1, SIZE_OF_EVENTQUEUE, nodes > 1 ? node : -1);
+        }
+
+        if(eventQueueBufferMemPools[node] == NULL){
+            snprintf(name, sizeof(name), nodes > 1 ? "eqBuffer%d" : "eqBuffer", node);
+            eventQueueBufferMemPools[node] = memPoolNodeDefine(name,
+                (NUMBER_OF_EVENTQUEUE_BUFFER - 1) / nodes + 1, SIZE_OF_EVENTQUEUE_BUFFER,
+                nodes > 1 ? node : -1);
+        }
     }
 
-    if(eventQueueBufferMemPool == NULL){
-        eventQueueBufferMemPool = memPoolLockedDefine("eqBuffer",
-            NUMBER_OF_EVENTQUEUE_BUFFER, SIZE_OF_EVENTQUEUE_BUFFER,
-            &eventQueueBufferMemPoolLock);
-    }
+    //! vertices and their arcs live in the arrays of the graph.
+    graphInit(NUMBER_OF_VERTEX_THREAD, NUMBER_OF_VERTEX_MUTEX);
+}
 
-    if(threadVertexMemPool == NULL){
-        threadVertexMemPool = memPoolDefine("tv", 
-            NUMBER_OF_VERTEX_THREAD, SIZE_OF_VERTEX_THREAD);
-    }
+/**
+ * @brief   Apply the limits of a configuration to all memory pools.
+ 
+ * @param   config is the configuration of the checker.
+ * @note    memPoolAllInit must be called before.
+ */
+void memPoolAllLimit(const dlcConfig_t *config){
+    uint32_t threads, mutexes;
+    assert(config != NULL);
 
-    if(mutexVertexMemPool == NULL){
-        mutexVertexMemPool = memPoolDefine("mv", 
-            NUMBER_OF_VERTEX_MUTEX, SIZE_OF_VERTEX_MUTEX);
-    }
+    threads = config->threads ? config->threads : NUMBER_OF_THREAD;
+    mutexes = config->mutexes ? config->mutexes : NUMBER_OF_VERTEX_MUTEX;
 
-    if(arcMemPool == NULL){
-        arcMemPool = memPoolDefine("arc", 
-            NUMBER_OF_ARC, SIZE_OF_ARC);
+    for(int node = 0; node < memNumaNodes(); node++){
+        memPoolSetLimit(eventQueueMemPools[node], threads);
+        memPoolSetLimit(eventQueueBufferMemPools[node], threads);
     }
+    graphSetLimit(VERTEX_THREAD, threads);
+    graphSetLimit(VERTEX_MUTEX, mutexes);
+    graphSetMemoryLimit(VERTEX_MUTEX, config->mutexMemoryLimit);
+    memPoolSetMemoryLimit(config->memoryLimit);
 }
 
+/**
+ * @brief   Release the resources of a destroyed thread.
+ * @param   args is the thread id.
+ * @note    It is called by the checker after the event queues were drained,
+ *          so no event of the thread is pending.
+ */
 void gcForThread(void *args){
     eventQueue_t *eq;
-    vertex_t *vertex;
+    vid_t vertex;
 
     assert(args);
     size_t tid = (size_t)args;
 
     //! destroy event queue.
-    eq = hashMapGet(eventQueueMap, (void *)tid);
+    spinlockAcquire(&eventQueueMapLock);
+    eq = flatMapGet(eventQueueMap, tid);
+    if(eq){
+        flatMapRemove(eventQueueMap, tid);
+    }
+    spinlockRelease(&eventQueueMapLock);
     if(eq){
         eventQueueDeInit(eq);
     }
      
-    //! destroy vertex.  
-    vertex = hashMapGet(vertexThreadMap, (void *)tid);
-    if(vertex){
+    //! destroy vertex, unless the thread exited holding a lock, 
+    //! which still takes part in the graph.
+    vertex = (vid_t)(size_t)flatMapGet(vertexThreadMap, tid);
+    if(vertex != VID_NONE && vertexIndegree(vertex) == 0 && vertexOutdegree(vertex) == 0){
         //! remove the vertex first.
-        hashMapRemove(vertexThreadMap, (void *)tid);
+        flatMapRemove(vertexThreadMap, tid);
         
         //！ then destroy it.
-        vertexDestroy(VERTEX_THREAD, vertex);
+        vertexDestroy(vertex);
     }
-}
-
 
+    flatMapRemove(residentThreadMap, tid);
+}
@@ -0,0 +1,478 @@
+/**
+ * @file    log.c
+ * @author  qufeiyan
+ * @brief   binary log, the messages of a thread are queued and printed by a drainer.
+ * @version 1.0.0
+ * @date    2026/10/19 01:05:12
+ * @version Copyright (c) 2026
+ */
+
+/* Includes --------------------------------------------------------------------------------*/
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "common.h"
+#include "dlcDef.h"
+#include "lfqueue.h"
+#include "log.h"
+#include "spinlock.h"
+
+#define NUMBER_OF_LOG_RECORDS   (512)   //! messages a thread queues before dropping them.
+#define SIZE_OF_LOG_RECORD      (256)
+#define PERIOD_OF_LOG_DRAIN     (10)    //! uint:ms
+
+/**
+ * @note The message of dlc_info() and the like is queued by its thread as the id of its
+ *       site and its arguments, a string argument is copied, and the drainer formats it
+ *       later. printf() takes the lock of stdout and writes, so it would serialise the
+ *       threads in the hooks and change the timing observed, whenever the log is on.
+ *
+ *       thread:  dlcLogWrite() --> ring of the thread --+
+ *       thread:  dlcLogWrite() --> ring of the thread --+--> drainer --> stdout
+ *
+ *       Each thread has a ring of its own, a lfqueue, and a full ring drops the message
+ *       rather than waits, the drops are reported by the drainer. A ring isn't freed
+ *       once its thread exits, the next thread logging takes it over.
+ *
+ *       The messages are printed by their thread as before, if the drainer isn't started,
+ *       e.g. by the tests and dlc-inspect, or if their format isn't supported, e.g. a
+ *       width of '*', or has more than DLC_LOG_ARGS arguments.
+ */
+enum{
+    LOG_ARG_NONE,       //! "%%".
+    LOG_ARG_INT,
+    LOG_ARG_LONG,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_PTR,
+    LOG_ARG_STR,
+    LOG_ARG_UNSUPPORTED
+};
+
+typedef struct dlcLogRecord{
+    dlcLogSite_t *site;
+    uint64_t args[DLC_LOG_ARGS];    //! a string is its offset into strings.
+    char strings[SIZE_OF_LOG_RECORD - sizeof(void *) - DLC_LOG_ARGS * sizeof(uint64_t)];
+}dlcLogRecord_t;
+
+typedef struct dlcLogRing{
+    lfqueue_t queue;
+    struct dlcLogRing *next;
+    atomic_bool owned;              //! false once its thread exits.
+    atomic_ulong dropped;           //! messages dropped as the ring was full.
+    dlcLogRecord_t records[NUMBER_OF_LOG_RECORDS];
+}dlcLogRing_t;
+
+static dlcLogRing_t *_Atomic logRings;
+static atomic_bool logDraining;
+static spinlock_t logDrainLock = SPINLOCK_INITIALIZER;  //! a lfqueue has a single reader.
+
+static __thread dlcLogRing_t *logRing __tlsInitialExec;
+static __thread bool logDrainingHere __tlsInitialExec;   //! an error raised by the drain skips it.
+static pthread_key_t logRingKey;
+static pthread_once_t logRingKeyOnce = PTHREAD_ONCE_INIT;
+
+extern void dlcSetTaskName(char *name);
+
+/**
+ * @brief   find the next conversion of a format.
+ * @param   format is where to search from.
+ * @param   spec [out] the '%' of the conversion.
+ * @param   type [out] LOG_ARG_xxx, the argument it takes.
+ * @return  the character following the conversion, NULL if there is none.
+ */
+static const char *logSpecNext(const char *format, const char **spec, int *type){
+    const char *p = strchr(format, '%');
+    char length = 0;
+
+    if(p == NULL) return NULL;
+    *spec = p++;
+
+    p += strspn(p, "-+ #0123456789.");
+    while(*p != 0 && strchr("hlLqjzt", *p) != NULL){
+        length = length == 0 || length == 'h' ? *p : length;
+        p++;
+    }
+
+    switch(*p){
+    case '%':
+        *type = LOG_ARG_NONE;
+        break;
+    case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+        *type = length == 0 || length == 'h' ? LOG_ARG_INT : LOG_ARG_LONG;
+        break;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+        *type = length == 'L' ? LOG_ARG_UNSUPPORTED : LOG_ARG_DOUBLE;
+        break;
+    case 'p':
+        *type = LOG_ARG_PTR;
+        break;
+    case 's':
+        *type = LOG_ARG_STR;
+        break;
+    default:
+        *type = LOG_ARG_UNSUPPORTED;
+        break;
+    }
+    return *p == 0 ? p : p + 1;
+}
+
+//! the arguments of a site, parsed once by the first of its messages.
+static int dlcLogParse(dlcLogSite_t *site){
+    const char *p = site->format, *spec;
+    int type, nargs = 0;
+
+    while((p = logSpecNext(p, &spec, &type)) != NULL){
+        if(type == LOG_ARG_NONE) continue;
+        if(type == LOG_ARG_UNSUPPORTED || nargs == DLC_LOG_ARGS){
+            nargs = DLC_LOG_UNQUEUED;
+            break;
+        }
+        site->types[nargs++] = type;
+    }
+    atomic_store_explicit(&site->nargs, nargs, memory_order_release);
+    return nargs;
+}
+
+static void dlcLogPrint(dlcLogSite_t *site, const char *format, va_list ap){
+    flockfile(stdout);
+    printf("%s%s:%d](#%s) ", site->prefix, site->file, site->line, site->func);
+    vprintf(format, ap);
+    printf(LOG_COLOR_NONE);
+    funlockfile(stdout);
+}
+
+static void dlcLogRingRelease(void *arg){
+    atomic_store(&((dlcLogRing_t *)arg)->owned, false);
+    logRing = NULL;
+}
+
+static void dlcLogRingKeyCreate(void){
+    pthread_key_create(&logRingKey, dlcLogRingRelease);
+}
+
+/**
+ * @brief   the ring of the current thread, the ring of a thread exited is taken over.
+ * @return  the ring, NULL if it can't be mapped.
+ */
+static dlcLogRing_t *dlcLogRingCurrent(void){
+    dlcLogRing_t *ring;
+    bool owned;
+
+    if(logRing != NULL) return logRing;
+    pthread_once(&logRingKeyOnce, dlcLogRingKeyCreate);
+
+    for(ring = atomic_load(&logRings); ring != NULL; ring = ring->next){
+        owned = false;
+        if(atomic_compare_exchange_strong(&ring->owned, &owned, true)) break;
+    }
+
+    if(ring == NULL){
+        ring = mmap(NULL, sizeof(dlcLogRing_t), PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(ring == MAP_FAILED) return NULL;
+
+        lfqueueInit(&ring->queue, ring->records, NUMBER_OF_LOG_RECORDS,
+            sizeof(dlcLogRecord_t));
+        atomic_init(&ring->owned, true);
+        atomic_init(&ring->dropped, 0);
+        ring->next = atomic_load(&logRings);
+        while(!atomic_compare_exchange_weak(&logRings, &ring->next, ring));
+    }
+
+    pthread_setspecific(logRingKey, ring);
+    logRing = ring;
+    return ring;
+}
+
+/**
+ * @brief   queue a message, see dlc_info().
+ * @param   site is the site of the message.
+ * @param   format is the format of the site, it's passed again to be checked.
+ */
+void dlcLogWrite(dlcLogSite_t *site, const char *format, ...){
+    dlcLogRecord_t record;
+    dlcLogRing_t *ring = NULL;
+    size_t used = 0, room, len;
+    const char *s;
+    double d;
+    va_list ap;
+    int nargs;
+
+    nargs = atomic_load_explicit(&site->nargs, memory_order_acquire);
+    if(nargs == DLC_LOG_UNPARSED){
+        nargs = dlcLogParse(site);
+    }
+    if(nargs >= 0 && atomic_load_explicit(&logDraining, memory_order_relaxed)){
+        ring = dlcLogRingCurrent();
+    }
+
+    va_start(ap, format);
+    if(ring == NULL){
+        dlcLogPrint(site, format, ap);
+        va_end(ap);
+        return;
+    }
+
+    //! lfqueuePut() would log the ring is full.
+    if(lfqueueAvail(&ring->queue) == 0){
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        va_end(ap);
+        return;
+    }
+
+    record.site = site;
+    for(int i = 0; i < nargs; i++){
+        switch(site->types[i]){
+        case LOG_ARG_INT:
+            record.args[i] = (uint64_t)va_arg(ap, int);
+            break;
+        case LOG_ARG_LONG:
+            record.args[i] = (uint64_t)va_arg(ap, long);
+            break;
+        case LOG_ARG_DOUBLE:
+            d = va_arg(ap, double);
+            memcpy(&record.args[i], &d, sizeof(d));
+            break;
+        case LOG_ARG_PTR:
+            record.args[i] = (uint64_t)(uintptr_t)va_arg(ap, void *);
+            break;
+        default:
+            //! truncated once the strings are full, the last byte is always 0 then.
+            s = va_arg(ap, const char *);
+            s = s == NULL ? "(null)" : s;
+            room = sizeof(record.strings) - used;
+            if(room == 0){
+                record.args[i] = sizeof(record.strings) - 1;
+                break;
+            }
+            len = strnlen(s, room - 1);
+            memcpy(record.strings + used, s, len);
+            record.strings[used + len] = 0;
+            record.args[i] = used;
+            used += len + 1;
+            break;
+        }
+    }
+    va_end(ap);
+
+    lfqueuePut(&ring->queue, &record, 1);
+}
+
+static void dlcLogFormat(dlcLogRecord_t *record, FILE *out){
+    dlcLogSite_t *site = record->site;
+    const char *p = site->format, *next, *spec;
+    char conv[32];
+    size_t len;
+    double d;
+    int type, i = 0;
+
+    fprintf(out, "%s%s:%d](#%s) ", site->prefix, site->file, site->line, site->func);
+    while((next = logSpecNext(p, &spec, &type)) != NULL){
+        fwrite(p, 1, spec - p, out);
+        p = next;
+        if(type == LOG_ARG_NONE){
+            fputc('%', out);
+            continue;
+        }
+
+        len = DLC_MIN((size_t)(next - spec), sizeof(conv) - 1);
+        memcpy(conv, spec, len);
+        conv[len] = 0;
+        switch(type){
+        case LOG_ARG_INT:
+            fprintf(out, conv, (int)record->args[i]);
+            break;
+        case LOG_ARG_LONG:
+            fprintf(out, conv, (long)record->args[i]);
+            break;
+        case LOG_ARG_DOUBLE:
+            memcpy(&d, &record->args[i], sizeof(d));
+            fprintf(out, conv, d);
+            break;
+        case LOG_ARG_PTR:
+            fprintf(out, conv, (void *)(uintptr_t)record->args[i]);
+            break;
+        default:
+            fprintf(out, conv, record->strings + record->args[i]);
+            break;
+        }
+        i++;
+    }
+    fputs(p, out);
+    fputs(LOG_COLOR_NONE, out);
+}
+
+//! print the messages queued by every thread.
+static void dlcLogDrain(void){
+    dlcLogRecord_t record;
+    dlcLogRing_t *ring;
+    unsigned long dropped;
+
+    if(logDrainingHere) return;
+    logDrainingHere = true;
+    spinlockAcquire(&logDrainLock);
+    flockfile(stdout);
+    for(ring = atomic_load(&logRings); ring != NULL; ring = ring->next){
+        while(lfqueueGet(&ring->queue, &record, 1) == 1){
+            dlcLogFormat(&record, stdout);
+        }
+        dropped = atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+        if(dropped > 0){
+            printf(LOG_COLOR_WARN "[DLC_WARN] %lu messages dropped, the log of a thread "
+                "is full" LOG_COLOR_NONE "\n", dropped);
+        }
+    }
+    fflush(stdout);
+    funlockfile(stdout);
+    spinlockRelease(&logDrainLock);
+    logDrainingHere = false;
+}
+
+static void *dlcLogDrainer(void *arg){
+    (void)arg;
+    dlcSetTaskName("dlc-log");
+
+    for(;;){
+        dlcLogDrain();
+        usleep(PERIOD_OF_LOG_DRAIN * 1000);
+    }
+    return NULL;
+}
+
+/**
+ * @brief   start the drainer, the messages are queued from now on.
+ * @note    the messages queued are printed at exit too.
+ */
+void dlcLogStart(void){
+    pthread_t tid;
+    bool draining = false;
+
+    if(!atomic_compare_exchange_strong(&logDraining, &draining, true)) return;
+
+    spinlockInit(&logDrainLock, 64);
+    atexit(dlcLogFlush);
+    if(pthread_create(&tid, NULL, dlcLogDrainer, NULL) != 0){
+        atomic_store(&logDraining, false);
+        return;
+    }
+    pthread_detach(tid);
+}
+
+//! print the messages queued so far, e.g. before an error is printed.
+void dlcLogFlush(void){
+    dlcLogDrain();
+}
+
+// #define DLC_TEST
+#ifdef DLC_TEST
+#include <stdlib.h>
+#include "testhelp.h"
+
+#define SIZE_OF_LOG_TEST_LINE   (512)
+
+//! the message of a site is queued and formatted as expected, or printed if expect is NULL.
+static void logTestCheck(dlcLogSite_t *site, dlcLogRing_t *ring, const char *expect){
+    dlcLogRecord_t record;
+    char line[SIZE_OF_LOG_TEST_LINE], *out = NULL;
+    size_t size = 0;
+    FILE *stream;
+
+    if(expect == NULL){
+        assert(atomic_load(&site->nargs) == DLC_LOG_UNQUEUED);
+        assert(lfqueueIsEmpty(&ring->queue));
+        return;
+    }
+
+    assert(atomic_load(&site->nargs) >= 0);
+    assert(lfqueueGet(&ring->queue, &record, 1) == 1);
+    assert(lfqueueIsEmpty(&ring->queue));
+    stream = open_memstream(&out, &size);
+    assert(stream != NULL);
+    dlcLogFormat(&record, stream);
+    fclose(stream);
+
+    snprintf(line, sizeof(line), "%s%s:%d](#%s) %s" LOG_COLOR_NONE,
+        site->prefix, site->file, site->line, site->func, expect);
+    if(strcmp(out, line) != 0){
+        printf("format \"%s\"\n  queued \"%s\"\nexpected \"%s\"\n", site->format, out, line);
+        assert(0);
+    }
+    printf("  %-28s -> %s\n", site->format, expect);
+    free(out);
+}
+
+//! the message is formatted from a record as snprintf() formats it at once.
+#define LOG_TEST(ring, format, ...)                                             \
+do{                                                                             \
+    static dlcLogSite_t _site = DLC_LOG_SITE("", format);                       \
+    char _expect[SIZE_OF_LOG_TEST_LINE];                                        \
+    snprintf(_expect, sizeof(_expect), format, ##__VA_ARGS__);                  \
+    dlcLogWrite(&_site, format, ##__VA_ARGS__);                                 \
+    logTestCheck(&_site, ring, _expect);                                        \
+}while(0)
+
+#define LOG_TEST_EXPECT(ring, expect, format, ...)                              \
+do{                                                                             \
+    static dlcLogSite_t _site = DLC_LOG_SITE("", format);                       \
+    dlcLogWrite(&_site, format, ##__VA_ARGS__);                                 \
+    logTestCheck(&_site, ring, expect);                                         \
+}while(0)
+
+/* ./demo test log, messages are queued into the ring of the test thread and formatted as
+   the drainer would, the drainer itself isn't started. */
+int logTest(int argc, char **argv, int flags){
+    char a[300], b[100], expect[SIZE_OF_LOG_TEST_LINE];
+    const size_t room = sizeof(((dlcLogRecord_t *)0)->strings);
+    dlcLogRing_t *ring;
+    int n;
+
+    atomic_store(&logDraining, true);
+    ring = dlcLogRingCurrent();
+    assert(ring != NULL && lfqueueIsEmpty(&ring->queue));
+
+    printf("specifiers:\n");
+    LOG_TEST(ring, "%#lx", 0xdeadbeefUL);
+    LOG_TEST(ring, "[%-10s]", "mutex");
+    LOG_TEST(ring, "%hhd %hd", 300, 70000);
+    LOG_TEST(ring, "%lld", -1234567890123LL);
+    LOG_TEST(ring, "%zu", (size_t)-1);
+    LOG_TEST(ring, "%5.2f|%g", 3.14159, 1e-7);
+    LOG_TEST(ring, "%p %p", (void *)ring, NULL);
+    LOG_TEST(ring, "100%% of %s", "locks");
+    LOG_TEST(ring, "%c%3d%-5u|%08X", 'x', 7, 42u, 0xbeefu);
+    LOG_TEST(ring, "%d %d %d %d %d %d %d %d", 1, 2, 3, 4, 5, 6, 7, 8);
+
+    //! the strings share the room of a record, the last byte is always 0.
+    printf("strings truncated at %zu bytes:\n", room);
+    memset(a, 'a', sizeof(a) - 1);
+    a[sizeof(a) - 1] = 0;
+    memset(b, 'b', sizeof(b) - 1);
+    b[sizeof(b) - 1] = 0;
+    n = (int)room - 1;
+    snprintf(expect, sizeof(expect), "%.*s|", n, a);
+    LOG_TEST_EXPECT(ring, expect, "%s|", a);
+
+    n = 150;
+    snprintf(expect, sizeof(expect), "[%.*s][%.*s]", n, a, (int)room - n - 2, b);
+    LOG_TEST_EXPECT(ring, expect, "[%s][%s]", a + sizeof(a) - 1 - n, b);
+
+    n = (int)room - 1;
+    snprintf(expect, sizeof(expect), "%.*s %d [] []", n, a, 5);
+    LOG_TEST_EXPECT(ring, expect, "%s %d [%s] [%s]", a + sizeof(a) - 1 - n, 5, "x", "y");
+
+    //! a width of '*', a long double and more than DLC_LOG_ARGS are printed by the thread.
+    printf("printed by the thread:\n");
+    LOG_TEST_EXPECT(ring, NULL, "%*d|\n", 5, 42);
+    LOG_TEST_EXPECT(ring, NULL, "%.*s|\n", 2, "abc");
+    LOG_TEST_EXPECT(ring, NULL, "%Lf\n", 1.5L);
+    LOG_TEST_EXPECT(ring, NULL, "%d %d %d %d %d %d %d %d %d\n", 1, 2, 3, 4, 5, 6, 7, 8, 9);
+
+    atomic_store(&logDraining, false);
+    return 0;
+}
+#endif
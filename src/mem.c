@@ -1,18 +1,24 @@
 /**
  * @file    mem.c
  * @author  qufeiyan (2491411913@qq.com)
- * @brief   simple implementation of small memory manage algorithm based on first fit.
- * @version 0.1
+ * @brief   implementation of small memory manage algorithm based on two-level segregated
+ *          fit (TLSF), with a cache of small blocks for each thread.
+ * @version 0.2
  * @date    2022-10-02
- * 
+ *
  * @copyright Copyright (c) 2022
- * 
+ *
  */
+#include <pthread.h>
 #include <stddef.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include "common.h"
+#include "mem.h"
+#include "spinlock.h"
 
 #define MEMDBG   (0)
 #define mem_dbg(format, ...)                                                      \
@@ -22,226 +28,572 @@ do{
         printf(LOG_COLOR_DEBUG "[MEM_DBG %s:%d](#%s) " format LOG_COLOR_NONE ,    \
             __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__);                     \
     }                                                                             \
-}while(0) 
-
-#define MEM_ALIGNMENT    (4)
+}while(0)
 
 /**
- * @ingroup BasicDef
+ * @note The heap is managed by TLSF. The free blocks are kept in lists segregated by
+ *       size: the first level splits the sizes by powers of two, the second level
+ *       splits each power of two into SL_INDEX_COUNT ranges. A bitmap of each level
+ *       tells the lists which aren't empty, so a free block that fits is found by two
+ *       find-first-set, and a block is split from, or merged with, its physical
+ *       neighbours in constant time.
  *
- * @def MEM_ALIGN_UP(size, align)
- * Return the most contiguous size aligned at specified width. MEM_ALIGN_UP(13, 4)
- * would return 16.
+ *       block:      | prevPhys | size F P | payload ...                 |
+ *       free block: | prevPhys | size F P | next | prev | ...           |
+ *
+ *       F is set while the block is free, P while the block before it is free, only
+ *       then prevPhys is valid. The heap ends with a used block of size 0, so that
+ *       the last block has a next block.
+ *
+ *       The heap is shared by the checker and the threads of the application, and is
+ *       guarded by a spinlock, as a pthread mutex would be tracked by the checker.
+ *       Small blocks freed by a thread are kept in a cache of the thread instead, and
+ *       are handed out again to the thread without taking the lock.
  */
-#define MEM_ALIGN_UP(size, align)        (((size) + (align) - 1) & ~((align) - 1))
+typedef struct memBlock{
+    struct memBlock *prevPhys;  /**< the block before it, valid while that block is free */
+    size_t size;                /**< the size of the payload, with the flags in the low bits */
+    struct memBlock *next;      /**< the next free block of the list, in the payload */
+    struct memBlock *prev;      /**< the previous free block of the list, in the payload */
+}MEM_BLOCK;
+
+#define BLOCK_FREE              (1UL)
+#define BLOCK_PREV_FREE         (2UL)
+#define BLOCK_FLAGS             (BLOCK_FREE | BLOCK_PREV_FREE)
+
+#define BLOCK_OVERHEAD          offsetof(MEM_BLOCK, next)
+#define BLOCK_SIZE_MIN          (sizeof(MEM_BLOCK) - BLOCK_OVERHEAD)
+
+#define blockSize(block)        ((block)->size & ~BLOCK_FLAGS)
+#define blockPayload(block)     ((void *)((uint8_t *)(block) + BLOCK_OVERHEAD))
+#define blockFromPayload(ptr)   ((MEM_BLOCK *)((uint8_t *)(ptr) - BLOCK_OVERHEAD))
+#define blockNext(block)        ((MEM_BLOCK *)((uint8_t *)blockPayload(block) + blockSize(block)))
+
+#define ALIGN_SIZE_LOG2         (3)
+#define SL_INDEX_COUNT_LOG2     (4)
+#define SL_INDEX_COUNT          (1 << SL_INDEX_COUNT_LOG2)
+#define FL_INDEX_SHIFT          (SL_INDEX_COUNT_LOG2 + ALIGN_SIZE_LOG2)
+#define FL_INDEX_MAX            (32)
+#define FL_INDEX_COUNT          (FL_INDEX_MAX - FL_INDEX_SHIFT + 1)
+#define SMALL_BLOCK_SIZE        (1UL << FL_INDEX_SHIFT)
 
 /**
- * @ingroup BasicDef
- *
- * @def MEM_ALIGN_DOWN(size, align)
- * Return the down number of aligned at specified width. MEM_ALIGN_DOWN(13, 4)
- * would return 12.
+ * @note A thread caches the blocks of MEM_CACHE_CLASSES sizes, a multiple of
+ *       MEM_CACHE_GRANULE each, up to MEM_CACHE_SIZE bytes in all. A cache is refilled
+ *       with up to MEM_CACHE_BATCH blocks at a time, half of it is handed back to the
+ *       heap when it's full, and all of it when its thread exits.
  */
-#define MEM_ALIGN_DOWN(size, align)      ((size) & ~((align) - 1))
+#define MEM_CACHE_GRANULE       (16)
+#define MEM_CACHE_CLASSES       (16)
+#define MEM_CACHE_SIZE          (4096)
+#define MEM_CACHE_BATCH         (8)
 
 typedef struct{
-    size_t prev;
-    size_t next;
-    uint8_t used;
-}SMALL_MEM_INFO;
+    uint32_t epoch;             /**< the heap the blocks come from, see MEM_MANAGER */
+    size_t size;                /**< bytes of all blocks cached */
+    MEM_BLOCK *blocks[MEM_CACHE_CLASSES];   /**< linked through next */
+}MEM_CACHE;
 
 typedef struct{
     uint8_t *heap;            /**< pointer to the heap */
-    SMALL_MEM_INFO *heapFree; /**< pointer to the lowest free block, this is used for faster search */
-    SMALL_MEM_INFO *heapEnd;  /**< the last entry, always unused! */
+    MEM_BLOCK *heapEnd;       /**< the last block, always used and empty! */
     size_t memSizeAligned;    /**< aligned memory size */
+    spinlock_t lock;          /**< guards the heap, but not the large blocks */
+
+    uint32_t flBitmap;                          /**< the first levels not empty */
+    uint32_t slBitmap[FL_INDEX_COUNT];          /**< the second levels not empty */
+    MEM_BLOCK *blocks[FL_INDEX_COUNT][SL_INDEX_COUNT];  /**< the lists of free blocks */
+    uint32_t epoch;           /**< bumped by memInit, the caches of an old heap are dropped */
 
     const char* name;         /**< the name of memory block. */
     size_t err;
     size_t avail;
-    size_t used;
+    size_t used;              /**< memory taken from the heap, including the caches */
     size_t max;
+    size_t large;             /**< memory mapped for large blocks */
 }MEM_MANAGER;
 
+/**
+ * @note A block of at least MEM_LARGE_SIZE bytes is mapped on its own instead of being
+ *       carved from the heap, such as the table of a large hash map. The header of
+ *       a large block records the size of the mapping.
+ */
+#define MEM_LARGE_SIZE     (64 * 1024)
+#define MEM_LARGE_MAGIC    (0x4c415247454d454dUL)
+
+typedef struct{
+    size_t size;
+    size_t magic;
+}LARGE_MEM_INFO;
 
-#define MIN_SIZE 12  //! 32-bit cpu
-#define MIN_SIZE_ALIGNED   MEM_ALIGN_UP(MIN_SIZE, MEM_ALIGNMENT)
-#define SIZEOF_STRUCT_MEM  MEM_ALIGN_UP(sizeof(SMALL_MEM_INFO), MEM_ALIGNMENT)
+#define SIZEOF_STRUCT_LARGE_MEM  sizeof(LARGE_MEM_INFO)
 
 #if USE_STATIC_HEAP
 #define MEM_SIZE           (64 * 1024)    //！set heap size.
 #define MEM_SIZE_ALIGNED   MEM_ALIGN_UP(MEM_SIZE, MEM_ALIGNMENT)
 
-/** the heap. we need one struct mem at the end and some room for alignment */
-uint8_t ram_heap[MEM_SIZE_ALIGNED + (2U * SIZEOF_STRUCT_MEM) + MEM_ALIGNMENT - 1U];
+/** the heap. we need one block at the end and some room for alignment */
+uint8_t ram_heap[MEM_SIZE_ALIGNED + (2U * BLOCK_OVERHEAD) + MEM_ALIGNMENT - 1U];
 #else
-extern unsigned long __DLC_HEAP_START, __DLC_HEAP_END;
-#define ram_heap (size_t)(&__DLC_HEAP_START)
-#define MEM_SIZE_ALIGNED   MEM_ALIGN_DOWN(((size_t)(&__DLC_HEAP_END) - (size_t)(&__DLC_HEAP_START)) \
-                                - 2 * SIZEOF_STRUCT_MEM, MEM_ALIGNMENT)
+/**
+ * @note The heap is an arena reserved at runtime by memInit(), of the size set by
+ *       memConfigure(). Its pages are only committed as the heap is used.
+ */
+static struct{
+    uint8_t *start;
+    size_t size;            //! size reserved.
+    size_t wanted;          //! size of the arena for the next memInit().
+    dlcHugePages_t hugePages;
+}heapArena = {.wanted = SIZE_OF_HEAP_ARENA};
+
+#define ram_heap (size_t)(heapArena.start)
+#define MEM_SIZE_ALIGNED   MEM_ALIGN_DOWN(heapArena.size - 2 * BLOCK_OVERHEAD - MEM_ALIGNMENT, \
+                                MEM_ALIGNMENT)
 #endif
 
 /** the small memory management object. */
 static MEM_MANAGER manager = {0};
 
+static __thread MEM_CACHE cache __tlsInitialExec;
+static pthread_key_t cacheKey;
+static pthread_once_t cacheKeyOnce = PTHREAD_ONCE_INIT;
 
 static void memInfo(MEM_MANAGER* pMem);
 
+#define memIsLarge(pMem, ptr)  ((uint8_t *)(ptr) < (pMem)->heap || \
+                                (uint8_t *)(ptr) >= (uint8_t *)(pMem)->heapEnd)
+
+/**
+ * @brief map a large block of memory.
+ *
+ * @param size is the minimum size of the requested block in bytes.
+ * @return the pointer to allocated memory or NULL if mmap fails.
+ */
+static void *memAllocLarge(size_t size){
+    MEM_MANAGER *pMemManager = &manager;
+    LARGE_MEM_INFO *mem;
+
+    size = MEM_ALIGN_UP(size + SIZEOF_STRUCT_LARGE_MEM, (size_t)getpagesize());
+    mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mem == MAP_FAILED){
+        __atomic_fetch_add(&pMemManager->err, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    mem->size = size;
+    mem->magic = MEM_LARGE_MAGIC;
+    __atomic_fetch_add(&pMemManager->large, size, __ATOMIC_RELAXED);
+    return (uint8_t *)mem + SIZEOF_STRUCT_LARGE_MEM;
+}
+
+/**
+ * @brief unmap a large block of memory.
+ *
+ * @param ptr the address of memory which allocted by memAllocLarge function.
+ */
+static void memFreeLarge(void *ptr){
+    MEM_MANAGER *pMemManager = &manager;
+    LARGE_MEM_INFO *mem;
+
+    mem = (LARGE_MEM_INFO *)((uint8_t *)ptr - SIZEOF_STRUCT_LARGE_MEM);
+    assert(mem->magic == MEM_LARGE_MAGIC);
+
+    __atomic_fetch_sub(&pMemManager->large, mem->size, __ATOMIC_RELAXED);
+    munmap(mem, mem->size);
+}
+
+/**
+ * @brief map a size to the list of its free blocks.
+ */
+static inline void memMapping(size_t size, int *fl, int *sl){
+    int msb;
+
+    if(size < SMALL_BLOCK_SIZE){
+        *fl = 0;
+        *sl = (int)(size / (SMALL_BLOCK_SIZE / SL_INDEX_COUNT));
+    }else{
+        msb = 63 - __builtin_clzl(size);
+        *sl = (int)(size >> (msb - SL_INDEX_COUNT_LOG2)) ^ SL_INDEX_COUNT;
+        *fl = msb - (FL_INDEX_SHIFT - 1);
+    }
+}
+
+/**
+ * @brief map a size to the first list whose free blocks all fit it.
+ */
+static inline void memMappingSearch(size_t size, int *fl, int *sl){
+    if(size >= SMALL_BLOCK_SIZE){
+        size += (1UL << (63 - __builtin_clzl(size) - SL_INDEX_COUNT_LOG2)) - 1;
+    }
+    memMapping(size, fl, sl);
+}
+
+static void memBlockRemove(MEM_MANAGER *pMem, MEM_BLOCK *block){
+    int fl, sl;
+
+    memMapping(blockSize(block), &fl, &sl);
+    if(block->prev != NULL){
+        block->prev->next = block->next;
+    }else{
+        pMem->blocks[fl][sl] = block->next;
+        if(block->next == NULL){
+            pMem->slBitmap[fl] &= ~(1U << sl);
+            if(pMem->slBitmap[fl] == 0){
+                pMem->flBitmap &= ~(1U << fl);
+            }
+        }
+    }
+    if(block->next != NULL){
+        block->next->prev = block->prev;
+    }
+}
+
+static void memBlockInsert(MEM_MANAGER *pMem, MEM_BLOCK *block){
+    int fl, sl;
+
+    memMapping(blockSize(block), &fl, &sl);
+    block->prev = NULL;
+    block->next = pMem->blocks[fl][sl];
+    if(block->next != NULL){
+        block->next->prev = block;
+    }
+    pMem->blocks[fl][sl] = block;
+    pMem->slBitmap[fl] |= 1U << sl;
+    pMem->flBitmap |= 1U << fl;
+}
+
+//! mark a block free, so is it seen by the block after it.
+static inline void memBlockMarkFree(MEM_BLOCK *block){
+    MEM_BLOCK *next;
+
+    block->size |= BLOCK_FREE;
+    next = blockNext(block);
+    next->prevPhys = block;
+    next->size |= BLOCK_PREV_FREE;
+}
+
+static inline void memBlockMarkUsed(MEM_BLOCK *block){
+    block->size &= ~BLOCK_FREE;
+    blockNext(block)->size &= ~BLOCK_PREV_FREE;
+}
+
+/**
+ * @brief take a block of at least size bytes from the heap, the lock must be held.
+ * @param size is aligned already.
+ */
+static MEM_BLOCK *memHeapAlloc(MEM_MANAGER *pMem, size_t size){
+    MEM_BLOCK *block, *rest;
+    uint32_t map;
+    int fl, sl;
+
+    memMappingSearch(size, &fl, &sl);
+    if(fl >= FL_INDEX_COUNT) return NULL;
+
+    //! the first list not empty from the mapping on.
+    map = pMem->slBitmap[fl] & (~0U << sl);
+    if(map == 0){
+        map = fl + 1 < FL_INDEX_COUNT ? pMem->flBitmap & (~0U << (fl + 1)) : 0;
+        if(map == 0) return NULL;
+        fl = __builtin_ctz(map);
+        map = pMem->slBitmap[fl];
+    }
+    sl = __builtin_ctz(map);
+
+    block = pMem->blocks[fl][sl];
+    assert(block != NULL && blockSize(block) >= size);
+    memBlockRemove(pMem, block);
+
+    //! split the rest off, if it can hold a free block.
+    if(blockSize(block) >= size + BLOCK_OVERHEAD + BLOCK_SIZE_MIN){
+        rest = (MEM_BLOCK *)((uint8_t *)blockPayload(block) + size);
+        rest->size = blockSize(block) - size - BLOCK_OVERHEAD;
+        block->size = size | (block->size & BLOCK_FLAGS);
+        memBlockMarkFree(rest);
+        memBlockInsert(pMem, rest);
+    }
+    memBlockMarkUsed(block);
+
+    pMem->used += blockSize(block) + BLOCK_OVERHEAD;
+    if(pMem->max < pMem->used){
+        pMem->max = pMem->used;
+    }
+    return block;
+}
+
+/**
+ * @brief hand a block back to the heap, the lock must be held.
+ */
+static void memHeapFree(MEM_MANAGER *pMem, MEM_BLOCK *block){
+    MEM_BLOCK *neighbour;
+
+    assert((block->size & BLOCK_FREE) == 0);
+    pMem->used -= blockSize(block) + BLOCK_OVERHEAD;
+
+    //! merge with the free neighbours, two free blocks are never adjacent.
+    if(block->size & BLOCK_PREV_FREE){
+        neighbour = block->prevPhys;
+        memBlockRemove(pMem, neighbour);
+        neighbour->size += BLOCK_OVERHEAD + blockSize(block);
+        block = neighbour;
+    }
+    neighbour = blockNext(block);
+    if(neighbour->size & BLOCK_FREE){
+        memBlockRemove(pMem, neighbour);
+        block->size += BLOCK_OVERHEAD + blockSize(neighbour);
+    }
+
+    memBlockMarkFree(block);
+    memBlockInsert(pMem, block);
+}
+
+/**
+ * @brief hand the blocks cached by a thread back to the heap, the largest first,
+ *        until the cache holds no more than size bytes.
+ */
+static void memCacheTrim(MEM_CACHE *pCache, size_t size){
+    MEM_MANAGER *pMemManager = &manager;
+    MEM_BLOCK *block;
+
+    if(pCache->epoch != pMemManager->epoch || pCache->size <= size) return;
+
+    spinlockAcquire(&pMemManager->lock);
+    for(int i = MEM_CACHE_CLASSES - 1; i >= 0 && pCache->size > size; i--){
+        while(pCache->size > size && (block = pCache->blocks[i]) != NULL){
+            pCache->blocks[i] = block->next;
+            pCache->size -= blockSize(block);
+            memHeapFree(pMemManager, block);
+        }
+    }
+    spinlockRelease(&pMemManager->lock);
+}
+
+static void memCacheFlush(MEM_CACHE *pCache){
+    memCacheTrim(pCache, 0);
+    memset(pCache->blocks, 0, sizeof(pCache->blocks));
+    pCache->size = 0;
+}
+
+static void memCacheDestructor(void *arg){
+    memCacheFlush((MEM_CACHE *)arg);
+}
+
+static void memCacheKeyCreate(void){
+    pthread_key_create(&cacheKey, memCacheDestructor);
+}
+
+/**
+ * @brief get the cache of the calling thread, which is emptied if it holds blocks of a
+ *        heap initialized again since.
+ */
+static inline MEM_CACHE *memCacheGet(void){
+    MEM_MANAGER *pMemManager = &manager;
+
+    if(cache.epoch != pMemManager->epoch){
+        memset(&cache, 0, sizeof(MEM_CACHE));
+        cache.epoch = pMemManager->epoch;
+        //! the cache is handed back as the thread exits.
+        pthread_setspecific(cacheKey, &cache);
+    }
+    return &cache;
+}
+
+#define MEM_HUGE_PAGE_SIZE  ((size_t)2 << 20)
+
+/**
+ * @brief reserve an arena of address space, whose pages are committed as they are touched.
+ *
+ * @param size is the size of the arena, it's rounded up to pages.
+ * @param hugePages is how the arena is backed by huge pages.
+ * @return the arena, NULL if the address space can't be reserved.
+ * @note an arena backed by huge pages is aligned to them. Explicit huge pages fall
+ *       back to transparent huge pages if none is reserved by the system.
+ */
+void *memArenaReserve(size_t size, dlcHugePages_t hugePages){
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+    size_t span;
+    uint8_t *start, *aligned;
+
+    size = MEM_ALIGN_UP(size, (size_t)getpagesize());
+#ifdef MAP_HUGETLB
+    if(hugePages == DLC_HUGEPAGE_EXPLICIT){
+        //! reserved up front, as a huge page missing on a fault raises SIGBUS.
+        start = mmap(NULL, MEM_ALIGN_UP(size, MEM_HUGE_PAGE_SIZE), PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(start != MAP_FAILED) return start;
+    }
+#endif
+    if(hugePages == DLC_HUGEPAGE_NONE){
+        start = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+        return start == MAP_FAILED ? NULL : start;
+    }
+
+    //! reserve a huge page more, and trim the ends not aligned.
+    span = MEM_ALIGN_UP(size, MEM_HUGE_PAGE_SIZE) + MEM_HUGE_PAGE_SIZE;
+    start = mmap(NULL, span, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if(start == MAP_FAILED) return NULL;
+
+    aligned = (uint8_t *)MEM_ALIGN_UP((size_t)start, MEM_HUGE_PAGE_SIZE);
+    if(aligned > start){
+        munmap(start, aligned - start);
+    }
+    if(start + span > aligned + size){
+        munmap(aligned + size, start + span - (aligned + size));
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+    return aligned;
+}
+
+/**
+ * @brief set the arena of the heap, which is reserved again by the next memInit().
+ *
+ * @param size is the size of the heap, 0 takes SIZE_OF_HEAP_ARENA.
+ * @param hugePages is how the arena is backed by huge pages.
+ */
+void memConfigure(size_t size, dlcHugePages_t hugePages){
+#if !USE_STATIC_HEAP
+    heapArena.wanted = size ? size : SIZE_OF_HEAP_ARENA;
+    heapArena.hugePages = hugePages;
+#else
+    (void)size;
+    (void)hugePages;
+#endif
+}
+
 /**
- * @brief initialize small memory management algorithm. 
- * 
+ * @brief initialize small memory management algorithm.
+ *
  */
 void memInit(void){
     MEM_MANAGER *pMemManager = &manager;
+    MEM_BLOCK *block;
+    uint32_t epoch = pMemManager->epoch;
+
+#if !USE_STATIC_HEAP
+    if(heapArena.start == NULL || heapArena.size != heapArena.wanted){
+        if(heapArena.start != NULL){
+            munmap(heapArena.start, heapArena.size);
+        }
+        heapArena.size = heapArena.wanted;
+        heapArena.start = memArenaReserve(heapArena.size, heapArena.hugePages);
+        if(heapArena.start == NULL){
+            dlc_err("the heap of %lu bytes can't be reserved\n", heapArena.size);
+            abort();
+        }
+    }
+#endif
+
+    memset(pMemManager, 0, sizeof(MEM_MANAGER));
     pMemManager->name = "small mem";
+    spinlockInit(&pMemManager->lock, 64);
+    pthread_once(&cacheKeyOnce, memCacheKeyCreate);
 
-    SMALL_MEM_INFO *mem;
-    
-    // mem_dbg("ram_heap %p, %p, %#lx\n", &__DLC_HEAP_START, &__DLC_HEAP_END, MEM_SIZE_ALIGNED);
-   
-    pMemManager->heap = (uint8_t *)MEM_ALIGN_DOWN((size_t)(ram_heap), MEM_ALIGNMENT);
-
-    /* initialize the start of the heap */
-    mem = (SMALL_MEM_INFO *)(void *)pMemManager->heap;
-    mem->prev = 0;
-    mem->next = MEM_SIZE_ALIGNED + SIZEOF_STRUCT_MEM;
-    mem->used = 0;
-    pMemManager->heapFree = mem;
-    pMemManager->heapEnd = (SMALL_MEM_INFO *)&pMemManager->heap[mem->next];
-    pMemManager->heapEnd->prev = pMemManager->heapEnd->next = MEM_SIZE_ALIGNED + SIZEOF_STRUCT_MEM;
+    pMemManager->heap = (uint8_t *)MEM_ALIGN_UP((size_t)(ram_heap), MEM_ALIGNMENT);
     pMemManager->memSizeAligned = MEM_SIZE_ALIGNED;
 
+    /* initialize the start of the heap, a single free block */
+    block = (MEM_BLOCK *)(void *)pMemManager->heap;
+    block->size = pMemManager->memSizeAligned;
+    pMemManager->heapEnd = blockNext(block);
+    pMemManager->heapEnd->size = 0;
+    memBlockMarkFree(block);
+    memBlockInsert(pMemManager, block);
+
     pMemManager->avail = pMemManager->memSizeAligned;
+    //! 0 is never an epoch, the caches of threads start with it.
+    pMemManager->epoch = epoch + 1 != 0 ? epoch + 1 : 1;
 }
 
 /**
  * @brief Allocate a block of memory with a minimum of 'size' bytes.
- * 
+ *
  * @param size is the minimum size of the requested block in bytes.
  * @return the pointer to allocated memory or NULL if no free memory was found.
  */
 void* memAlloc(size_t size){
     MEM_MANAGER *pMemManager = &manager;
-
-    size_t ptr, ptr2;
-    SMALL_MEM_INFO *mem, *mem2;
+    MEM_CACHE *pCache = NULL;
+    MEM_BLOCK *block;
+    int class = -1, batch = 1;
 
     assert(pMemManager->memSizeAligned > 0); //! if memSizeAligned == 0 means memInit() is not called.
 
     if(size == 0) return NULL;
 
-    size = MEM_ALIGN_UP(size, MEM_ALIGNMENT);
-
-    /* every data block must be at least MIN_SIZE_ALIGNED long */
-    if(size < MIN_SIZE_ALIGNED){
-        size = MIN_SIZE_ALIGNED;
-    }
-    if(size > pMemManager->memSizeAligned){
-        mem_dbg("Sorry, out of memory trying to allocate %lu bytes.\n", size);
-        return NULL;
+    if(size >= MEM_LARGE_SIZE){
+        return memAllocLarge(size);
     }
-    
-    /** Scan through the heap searching for a free block that is big enough,
-     *  beginning with the lowest free block.
-     */
-    for(ptr = (uint8_t *)pMemManager->heapFree - pMemManager->heap; 
-        ptr <= pMemManager->memSizeAligned - size;
-        ptr = ((SMALL_MEM_INFO *)&pMemManager->heap[ptr])->next){
-        
-        /** mem is the current free block in the small memory list. */
-        mem = (SMALL_MEM_INFO *)&pMemManager->heap[ptr];
-
-        if(!mem->used && (mem->next - (ptr + SIZEOF_STRUCT_MEM)) >= size){
-            /** mem is not used and at least perfect fit is possible:
-             *  mem->next - (ptr + SIZEOF_STRUCT_MEM) gives us the 'user data size' of mem 
-             */
-            
-            if (mem->next - (ptr + SIZEOF_STRUCT_MEM) >= (size + SIZEOF_STRUCT_MEM + MIN_SIZE_ALIGNED)) {
-                /** (in addition to the above, we test if another struct SMALL_MEM_INFO (SIZEOF_STRUCT_MEM) containing
-                 * at least MIN_SIZE_ALIGNED of data also fits in the 'user data space' of 'mem')
-                 * -> split large block, create empty remainder,
-                 * remainder must be large enough to contain MIN_SIZE_ALIGNED data: if
-                 * mem->next - (ptr + (2*SIZEOF_STRUCT_MEM)) == size,
-                 * struct SMALL_MEM_INFO would fit in but no data between mem2 and mem2->next
-                 * @todo we could leave out MIN_SIZE_ALIGNED. We would create an empty
-                 *       region that couldn't hold data, but when mem->next gets freed,
-                 *       the 2 regions would be combined, resulting in more free memory
-                 */
-                //! ptr2 
-                ptr2 = (size_t)(ptr + SIZEOF_STRUCT_MEM + size);
-                /* create mem2 struct */
-                mem2 = (SMALL_MEM_INFO *)&pMemManager->heap[ptr2];
-                mem2->used = 0;
-                mem2->prev = ptr;
-                mem2->next = mem->next;
-                /* and insert it between mem and mem->next */
-                mem->next = ptr2;
-                mem->used = 1;
-                
-                if(mem2->next != MEM_SIZE_ALIGNED + SIZEOF_STRUCT_MEM){
-                    ((SMALL_MEM_INFO *)&pMemManager->heap[mem2->next])->prev = ptr2;
-                }
-                //! increase used..
-                pMemManager->used += (size + SIZEOF_STRUCT_MEM);
-                if (pMemManager->max < pMemManager->used){
-                    pMemManager->max = pMemManager->used;
-                }
-            }else{
-                mem->used = 1;  
-                pMemManager->used += mem->next - ((uint8_t *)mem - pMemManager->heap);
-                if (pMemManager->max < pMemManager->used){
-                    pMemManager->max = pMemManager->used;
-                }
-            }
-
-            if(mem == pMemManager->heapFree){
-                /* Find next free block after mem and update lowest free pointer */
-                SMALL_MEM_INFO *cur = pMemManager->heapFree;
-                while (cur->used && cur != pMemManager->heapEnd) {
-                    cur = (SMALL_MEM_INFO *)&pMemManager->heap[cur->next];
-                }
-                pMemManager->heapFree = cur;
-                assert((pMemManager->heapFree == pMemManager->heapEnd || !pMemManager->heapFree->used));
-            }
 
-            assert(((size_t)mem + SIZEOF_STRUCT_MEM + size) <= (size_t)pMemManager->heapEnd);
-            assert(((size_t)mem & (MEM_ALIGNMENT - 1)) == 0);
+    if(size <= MEM_CACHE_GRANULE * MEM_CACHE_CLASSES){
+        //! a small block, from the cache of the thread if it has one.
+        size = MEM_ALIGN_UP(size, MEM_CACHE_GRANULE);
+        class = size / MEM_CACHE_GRANULE - 1;
+        pCache = memCacheGet();
+        block = pCache->blocks[class];
+        if(block != NULL){
+            pCache->blocks[class] = block->next;
+            pCache->size -= size;
+            return blockPayload(block);
+        }
+        batch = DLC_MAX(1, DLC_MIN(MEM_CACHE_BATCH, (MEM_CACHE_SIZE - (int)pCache->size) / (int)size));
+    }else{
+        size = MEM_ALIGN_UP(size, MEM_ALIGNMENT);
+    }
 
-            mem_dbg("allocate memory at %p, size: %lu\n",
-                ((uint8_t *)mem + SIZEOF_STRUCT_MEM),
-                (size_t)(mem->next - ((uint8_t *)mem - pMemManager->heap)));
-            /* return the memory data except mem struct */
-            return (uint8_t *)mem + SIZEOF_STRUCT_MEM;
+    spinlockAcquire(&pMemManager->lock);
+    block = memHeapAlloc(pMemManager, size);
+    //! refill the cache, with blocks of the size asked for exactly.
+    for(int i = 1; block != NULL && i < batch; i++){
+        MEM_BLOCK *extra = memHeapAlloc(pMemManager, size);
+        if(extra == NULL) break;
+        if(blockSize(extra) != size){
+            memHeapFree(pMemManager, extra);
+            break;
         }
+        extra->next = pCache->blocks[class];
+        pCache->blocks[class] = extra;
+        pCache->size += size;
     }
-    pMemManager->err++;  /**< record the number of failure to malloc.*/
+    spinlockRelease(&pMemManager->lock);
 
-    mem_dbg("mem_malloc: could not allocate %lu bytes\n", size);
-    memInfo(pMemManager);
-    return NULL;
+    if(block == NULL){
+        __atomic_fetch_add(&pMemManager->err, 1, __ATOMIC_RELAXED);  /**< record the number of failure to malloc.*/
+        mem_dbg("mem_malloc: could not allocate %lu bytes\n", size);
+        memInfo(pMemManager);
+        return NULL;
+    }
+
+    assert(((size_t)block & (MEM_ALIGNMENT - 1)) == 0);
+    mem_dbg("allocate memory at %p, size: %lu\n", blockPayload(block), blockSize(block));
+    /* return the memory data except the header of the block */
+    return blockPayload(block);
 }
 
 /**
  * @brief obtain the size of address pointed to by the pointer ptr,
  *        which is assigned by the memAlloc function.
- *        
+ *
  * @param ptr the address of memory which allocted by memAlloc function.
  * @return the size of address pointed to by the pointer ptr.
  */
 size_t memAllocSize(const void *ptr){
     MEM_MANAGER *pMemManager = &manager;
-    SMALL_MEM_INFO *mem;
+    MEM_BLOCK *block;
 
     if (NULL == ptr) return 0;
     assert((((size_t)ptr) & (MEM_ALIGNMENT - 1)) == 0);
 
-    /* Get the corresponding struct SMALL_MEM_INFO ... */
-    mem = (SMALL_MEM_INFO *)((uint8_t *)ptr - SIZEOF_STRUCT_MEM);
-    assert(mem->used);
-    assert((uint8_t *)ptr >= (uint8_t *)pMemManager->heap &&
-            (uint8_t *)ptr < (uint8_t *)pMemManager->heapEnd);
+    if (memIsLarge(pMemManager, ptr)) {
+        return ((LARGE_MEM_INFO *)((uint8_t *)ptr - SIZEOF_STRUCT_LARGE_MEM))->size -
+            SIZEOF_STRUCT_LARGE_MEM;
+    }
+
+    /* Get the corresponding block ... */
+    block = blockFromPayload(ptr);
+    assert((block->size & BLOCK_FREE) == 0);
 
-    return (mem->next - ((uint8_t *)mem - pMemManager->heap) - SIZEOF_STRUCT_MEM);
+    return blockSize(block);
 }
 
 /**
@@ -272,86 +624,47 @@ void *memCalloc(size_t count, size_t size)
     return p;
 }
 
-static void memPlugHoles(SMALL_MEM_INFO *mem);
-
 /**
  * @brief This function will release the previously allocated memory block by
  *        memAlloc. The released memory block is taken back to system heap.
  *
  * @param ptr the address of memory which will be released.
+ * @note  a small block is kept in the cache of the calling thread, whichever thread
+ *        allocated it.
  */
 void memFree(void* ptr){
     MEM_MANAGER *pMemManager = &manager;
-    SMALL_MEM_INFO *mem;
+    MEM_CACHE *pCache;
+    MEM_BLOCK *block;
+    size_t size;
 
     if (NULL == ptr) return;
     assert((((size_t)ptr) & (MEM_ALIGNMENT - 1)) == 0);
 
-    /* Get the corresponding struct SMALL_MEM_INFO ... */
-    mem = (SMALL_MEM_INFO *)((uint8_t *)ptr - SIZEOF_STRUCT_MEM);
-    assert(mem->used);
-    assert((uint8_t *)ptr >= (uint8_t *)pMemManager->heap &&
-            (uint8_t *)ptr < (uint8_t *)pMemManager->heapEnd);
-    
-    /* ... and is now unused. */
-    mem->used = 0;
-
-    if (mem < pMemManager->heapFree) {
-    /* the newly freed struct is now the lowest */
-        pMemManager->heapFree = mem;
+    if (memIsLarge(pMemManager, ptr)) {
+        memFreeLarge(ptr);
+        return;
     }
 
-    pMemManager->used -= (mem->next - ((uint8_t *)mem - pMemManager->heap));
-    
-    /* finally, see if prev or next are free also */
-    memPlugHoles(mem);
-}
+    /* Get the corresponding block ... */
+    block = blockFromPayload(ptr);
+    assert((block->size & BLOCK_FREE) == 0);
+    size = blockSize(block);
 
-/**
- * @brief "Plug holes" by combining adjacent empty struct mems.
- *        After this function is through, there should not exist
- *        one empty struct mem pointing to another empty struct mem.
- *
- * @param mem this points to a struct mem which just has been freed
- * @internal this function is only called by memFree()
- *
- */
-static void memPlugHoles(SMALL_MEM_INFO *mem){
-    MEM_MANAGER *pMemManager = &manager;
-    SMALL_MEM_INFO *nmem, *pmem;
-
-    assert((uint8_t *)mem >= pMemManager->heap);
-    assert((uint8_t *)mem < (uint8_t *)pMemManager->heapEnd);
-
-    /* plug hole forward */
-    nmem = (SMALL_MEM_INFO *)&pMemManager->heap[mem->next];
-    if (mem != nmem && !nmem->used &&
-        (uint8_t *)nmem != (uint8_t *)pMemManager->heapEnd){
-        /* if mem->next is unused and not end of m->heap_ptr,
-         * combine mem and mem->next
-         */
-        if (pMemManager->heapFree == nmem)
-        {
-            pMemManager->heapFree = mem;
-        }
-        mem->next = nmem->next;
-        if(nmem->next != MEM_SIZE_ALIGNED + SIZEOF_STRUCT_MEM){
-            ((SMALL_MEM_INFO *)&pMemManager->heap[nmem->next])->prev = (uint8_t *)mem - pMemManager->heap;
+    if(size <= MEM_CACHE_GRANULE * MEM_CACHE_CLASSES && size % MEM_CACHE_GRANULE == 0){
+        pCache = memCacheGet();
+        if(pCache->size + size > MEM_CACHE_SIZE){
+            memCacheTrim(pCache, MEM_CACHE_SIZE / 2);
         }
+        block->next = pCache->blocks[size / MEM_CACHE_GRANULE - 1];
+        pCache->blocks[size / MEM_CACHE_GRANULE - 1] = block;
+        pCache->size += size;
+        return;
     }
 
-    /* plug hole backward */
-    pmem = (SMALL_MEM_INFO *)&pMemManager->heap[mem->prev];
-    if (pmem != mem && !pmem->used){
-        /* if mem->prev is unused, combine mem and mem->prev */
-        if (pMemManager->heapFree == mem){
-            pMemManager->heapFree = pmem;
-        }
-        pmem->next = mem->next;
-        if(mem->next != MEM_SIZE_ALIGNED + SIZEOF_STRUCT_MEM){
-            ((SMALL_MEM_INFO *)&pMemManager->heap[mem->next])->prev = (uint8_t *)pmem - pMemManager->heap;
-        }
-    }
+    spinlockAcquire(&pMemManager->lock);
+    memHeapFree(pMemManager, block);
+    spinlockRelease(&pMemManager->lock);
 }
 
 static void memInfo(MEM_MANAGER* pMem)
@@ -360,6 +673,7 @@ static void memInfo(MEM_MANAGER* pMem)
     mem_dbg("avail: %lu\n\t", pMem->avail);
     mem_dbg("used: %lu\n\t", pMem->used);
     mem_dbg("max: %lu\n\t", pMem->max);
+    mem_dbg("large: %lu\n\t", pMem->large);
     mem_dbg("err: %lu\n", pMem->err);
 }
 
@@ -367,6 +681,8 @@ static void memInfo(MEM_MANAGER* pMem)
 /* ------------------------------- Benchmark ---------------------------------*/
 
 #ifdef DLC_TEST
+#include <stdlib.h>
+#include "mem.h"
 #include "testhelp.h"
 
 #define UNUSED(V) ((void) V)
@@ -379,30 +695,84 @@ static void memInfo(MEM_MANAGER* pMem)
     memInfo(&manager); \
 } while(0)
 
-/* ./demo test dict [<count> | --accurate] */
+#define MEM_TEST_LIVE   (256)
+
+struct memTestArg{
+    long ops;
+    bool libc;
+};
+
+/**
+ * @brief churn blocks of 16 to 271 bytes, as hash entries and timers do, keeping
+ *        about half of MEM_TEST_LIVE blocks alive.
+ */
+static void *memTestChurn(void *arg){
+    struct memTestArg *testArg = arg;
+    void *mems[MEM_TEST_LIVE] = {0};
+    unsigned int seed = (unsigned int)(size_t)&mems;
+    size_t size;
+    int k;
+
+    for(long j = 0; j < testArg->ops; j++){
+        seed = seed * 1103515245 + 12345;
+        k = (seed >> 8) % MEM_TEST_LIVE;
+        if(mems[k] != NULL){
+            testArg->libc ? free(mems[k]) : zfree(mems[k]);
+            mems[k] = NULL;
+            continue;
+        }
+        size = 16 + (seed >> 16) % 256;
+        mems[k] = testArg->libc ? malloc(size) : zmalloc(size);
+        assert(mems[k] != NULL);
+        memset(mems[k], k, size);
+    }
+    for(k = 0; k < MEM_TEST_LIVE; k++){
+        testArg->libc ? free(mems[k]) : zfree(mems[k]);
+    }
+    return NULL;
+}
+
+static long long memTestRun(int threads, long ops, bool libc){
+    pthread_t tids[threads];
+    struct memTestArg arg = {.ops = ops, .libc = libc};
+    long long start = timeInMilliseconds();
+
+    for(int i = 0; i < threads; i++){
+        assert(pthread_create(&tids[i], NULL, memTestChurn, &arg) == 0);
+    }
+    for(int i = 0; i < threads; i++){
+        pthread_join(tids[i], NULL);
+    }
+    return timeInMilliseconds() - start;
+}
+
+/* ./demo test mem [<count> [<threads>] | --accurate] */
 int memTest(int argc, char *argv[], int flags) {
     long j;
     long long start, elapsed;
+    size_t used;
 
-    long count = 0;
+    long count = 10000;
+    int threads = 4;
     int accurate = (flags & DLC_TEST_ACCURATE);
 
-    if (argc == 4) {
+    if (argc >= 4) {
         if (accurate) {
             count = 5000000;
         } else {
             count = strtol(argv[3],NULL,10);
         }
     }
+    if (argc >= 5) threads = DLC_MAX(1, atoi(argv[4]));
 
     dlc_dbg("count %ld\n", count);
-    
+
     memInit();
-    void* mems[count];
+    void **mems = malloc(count * sizeof(void *));
     start_benchmark();
     for (j = 0; j < count; j++) {
         mems[j] = memAlloc(4);
-        assert(memAllocSize(mems[j]) == MAX(MIN_SIZE_ALIGNED, 4));
+        assert(memAllocSize(mems[j]) == MAX(BLOCK_SIZE_MIN, MEM_CACHE_GRANULE));
     }
     end_benchmark("Malloc fixed size");
 
@@ -414,26 +784,29 @@ int memTest(int argc, char *argv[], int flags) {
 
     start_benchmark();
     for (j = 0; j < count; j++) {
-        mems[j] = memAlloc(4 * j + 1);
-        assert(memAllocSize(mems[j]) == MAX(MEM_ALIGN_UP(4 * j + 1, MEM_ALIGNMENT), MIN_SIZE_ALIGNED));
-    }
-    end_benchmark("Malloc variable size");
-
-    start_benchmark();
-    for (j = 0; j < count; j++) {
-        memFree(mems[j]);
-    }
-    end_benchmark("Free variable size");
-
-    start_benchmark();
-    for (j = 0; j < count; j++) {
-        mems[j] = memAlloc(8 * j + 1);
-        assert(memAllocSize(mems[j]) == MAX(MEM_ALIGN_UP(8 * j + 1, MEM_ALIGNMENT), MIN_SIZE_ALIGNED));
+        used = (size_t)(j & 4095) + 1;
+        mems[j] = memAlloc(used);
+        assert(mems[j] != NULL && memAllocSize(mems[j]) >= used);
         memFree(mems[j]);
         assert((&manager)->err == 0);
     }
     end_benchmark("Malloc && Free variable size");
+
+    //! the heap is whole again, once the cache is handed back.
+    memCacheFlush(&cache);
+    assert(manager.used == 0 && blockSize((MEM_BLOCK *)manager.heap) == manager.memSizeAligned);
+    free(mems);
+
+    //! concurrent callers, the accounting of zmalloc must come back exactly.
+    used = zmalloc_used_memory();
+    elapsed = memTestRun(threads, count * 100, false);
+    printf("zmalloc %d threads: %ld ops each in %lld ms\n", threads, count * 100, elapsed);
+    assert(zmalloc_used_memory() == used);
+    assert(manager.err == 0);
+
+    elapsed = memTestRun(threads, count * 100, true);
+    printf("malloc  %d threads: %ld ops each in %lld ms\n", threads, count * 100, elapsed);
     return 0;
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -8,130 +8,410 @@
  */
 
 /* Includes --------------------------------------------------------------------------------*/
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#endif
 #include "mempool.h"
 #include "dlcDef.h"
 #include "internal.h"
 
+/**
+ * @note A memory pool is a list of slabs, a slab is a contiguous run of equally sized
+ *       blocks. The first slab of a pool is carved from an arena reserved at runtime, the
+ *       pool grows by mapping new slabs when it runs out of blocks, and unmaps a grown
+ *       slab once all its blocks are free again.
+ *
+ *       +--------------+-------+---------+-------+---------+-----
+ *       | struct slab  | *slab | block 0 | *slab | block 1 | ...
+ *       +--------------+-------+---------+-------+---------+-----
+ *
+ *       A free block links to the next free block of its slab, an allocated block
+ *       points to the slab it belongs to, so that it's freed in O(1).
+ *
+ *       The blocks never used are carved from the tail of a slab by a bump index, the
+ *       block list only holds blocks freed, so that a slab isn't touched beyond the
+ *       blocks ever used, and its pages are only committed as it's used.
+ */
+struct memSlab{
+    struct memSlab *prev;   //! links of the slab list of the pool.
+    struct memSlab *next;
+    struct memPool *pool;   //! the pool the slab belongs to.
+    uint8_t *block_list;    //! free blocks of the slab, which have been used.
+    size_t carved;          //! blocks ever used, the rest are free beyond them.
+    size_t free_blocks;
+    size_t total_blocks;
+    size_t size;            //! size of the slab, including the header.
+    bool mapped;            //! whether the slab is mapped on demand, and may be unmapped.
+};
 
 struct memPool{
     char name[SIZE_OF_NAME];          //! name of memory pool.
-    void* start;            //! start address for the memory pool.
-    size_t size;            //! size of memory pool.
+    struct memSlab partial; //! dummy head of slabs with free blocks, full slabs are unlinked.
+    size_t size;            //! size of all slabs of the memory pool.
     
-    uint8_t* block_list;    //! memory block list.
     size_t block_size;      //! size of memory block.
+    size_t slab_blocks;     //! count of blocks in a slab mapped on demand.
 
     size_t free_blocks;
     size_t total_blocks;
+    size_t soft_limit;      //! count of blocks in use beyond which a warning is issued.
 
     int32_t err;
-    int32_t avail;
-    int32_t used;
-    int32_t max;
-
-    // spinlock_t *lock;       //! lock for memory pool.
+    int32_t slabs;
+    size_t avail;
+    size_t used;
+    size_t max;
+    int node;               //! the NUMA node the slabs are placed on, -1 if any.
+
+    //! shared pools only, see memPoolSharedDefine().
+    int id;                 //! the magazine of the pool in each thread, -1 if none.
+    size_t magazine;        //! blocks a magazine of the pool holds at most.
+    spinlock_t lock;        //! guards the slabs.
+    _Atomic uint64_t depot; //! free blocks, the tagged top of a Treiber stack.
+    atomic_size_t depot_blocks;
+    atomic_int poppers;     //! threads popping the depot, no slab is unmapped meanwhile.
 };
 
-extern unsigned long __DLC_MEMPOOL_START, __DLC_MEMPOOL_END;
-static size_t mp_current_start = (size_t)(&__DLC_MEMPOOL_START);
+#define SIZE_OF_SLAB_HEADER     MEM_ALIGN_UP(sizeof(struct memSlab), MEM_ALIGNMENT)
+#define SIZE_OF_SLAB_BLOCK(mp)  ((mp)->block_size + sizeof(struct memSlab *))
+
+//! the arena the first slabs are carved from, reserved by the first pool defined.
+static struct{
+    uint8_t *start;
+    uint8_t *current;
+    uint8_t *end;
+    size_t size;
+    dlcHugePages_t hugePages;
+}mp_arena = {.size = SIZE_OF_MEMPOOL_ARENA};
+
+//! memory mapped on demand by all pools, and the hard limit of it, 0 means unlimited.
+static atomic_size_t mp_mapped_size = 0;
+static size_t mp_mapped_limit = 0;
 
 #define MEMPOOL_UPDATE_CURRENT_START(size)  do{\
-    mp_current_start += (MEM_ALIGN_UP(size, MEM_ALIGNMENT));\
+    mp_arena.current += (MEM_ALIGN_UP(size, MEM_ALIGNMENT));\
 }while(0)
 
+//! slabs mapped on demand are linked at the tail, so that blocks are taken from 
+//! the first slab before them, and they have a chance to become empty.
+static inline void memSlabLink(struct memSlab *head, struct memSlab *slab){
+    if(slab->mapped) head = head->prev;
+    slab->next = head->next;
+    slab->prev = head;
+    head->next->prev = slab;
+    head->next = slab;
+}
+
+static inline void memSlabUnlink(struct memSlab *slab){
+    slab->prev->next = slab->next;
+    slab->next->prev = slab->prev;
+    slab->prev = slab->next = NULL;
+}
+
+/**
+ * @brief   format a slab and link it into the pool.
+ 
+ * @param   mp is the memory pool object.
+ * @param   start is the start address of the slab.
+ * @param   size is the size of the slab.
+ * @param   mapped indicates whether the slab is mapped on demand.
+ */
+static void memSlabInit(struct memPool *mp, void *start, size_t size, bool mapped){
+    struct memSlab *slab = (struct memSlab *)start;
+    size_t stride = SIZE_OF_SLAB_BLOCK(mp);
+
+    slab->pool = mp;
+    slab->size = size;
+    slab->mapped = mapped;
+    slab->total_blocks = (size - SIZE_OF_SLAB_HEADER) / stride;
+    slab->free_blocks = slab->total_blocks;
+    assert(slab->total_blocks > 0);
+
+    //! no block is touched, they are carved as they are used.
+    slab->carved = 0;
+    slab->block_list = NULL;
+
+    memSlabLink(&mp->partial, slab);
+    mp->slabs++;
+    mp->size += size;
+    mp->total_blocks += slab->total_blocks;
+    mp->free_blocks += slab->total_blocks;
+}
+
+/**
+ * @note The pages of a pool bound to a NUMA node are placed on the node as they are
+ *       first touched, which is after the pool is defined, as blocks are carved lazily.
+ *       Without NUMA support, there is a single node 0 and binding does nothing.
+ */
+static int mp_numa_nodes = 0;
+
+/**
+ * @brief   the count of NUMA nodes of the system, 1 if unknown.
+ */
+int memNumaNodes(void){
+    int nodes = mp_numa_nodes;
+#ifdef __linux__
+    char buf[64] = {0};
+    char *last;
+    int fd;
+
+    if(nodes > 0) return nodes;
+    nodes = 1;
+    //! a range like "0-1", or a single node "0".
+    fd = open("/sys/devices/system/node/possible", O_RDONLY);
+    if(fd >= 0){
+        if(read(fd, buf, sizeof(buf) - 1) > 0){
+            last = strrchr(buf, '-');
+            last = last ? last + 1 : buf;
+            nodes = DLC_MAX(1, atoi(last) + 1);
+        }
+        close(fd);
+    }
+    nodes = DLC_MIN(nodes, NUMBER_OF_NUMA_NODES);
+    mp_numa_nodes = nodes;
+#else
+    if(nodes == 0) nodes = mp_numa_nodes = 1;
+#endif
+    return nodes;
+}
+
+/**
+ * @brief   the NUMA node the calling thread is running on.
+ */
+int memNumaNode(void){
+#ifdef __linux__
+    unsigned cpu, node = 0;
+
+    if(memNumaNodes() == 1) return 0;
+    if(syscall(SYS_getcpu, &cpu, &node, NULL) != 0) return 0;
+    return (int)DLC_MIN(node, (unsigned)memNumaNodes() - 1);
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief   prefer a NUMA node for the pages of a range, those touched already stay.
+ * @note    only the pages wholly in the range are bound, as its edges may be shared.
+ */
+void memNumaBind(void *addr, size_t size, int node){
+#ifdef __linux__
+    size_t page = (size_t)getpagesize();
+    size_t start = MEM_ALIGN_UP((size_t)addr, page);
+    size_t end = MEM_ALIGN_DOWN((size_t)addr + size, page);
+    unsigned long mask;
+
+    if(node < 0 || memNumaNodes() == 1 || end <= start) return;
+    mask = 1UL << node;
+    syscall(SYS_mbind, start, end - start, MPOL_PREFERRED, &mask, sizeof(mask) * 8, 0);
+#else
+    (void)addr;
+    (void)size;
+    (void)node;
+#endif
+}
+
+/**
+ * @brief   map a new slab for the memory pool.
+ 
+ * @param   mp is the memory pool object.
+ * @return  DLC_OK if the pool has grown, DLC_ERR if the limit is reached or mmap fails.
+ */
+static err_t memPoolGrow(struct memPool *mp){
+    size_t size = SIZE_OF_SLAB_HEADER + mp->slab_blocks * SIZE_OF_SLAB_BLOCK(mp);
+    void *start;
+
+    size = MEM_ALIGN_UP(size, (size_t)getpagesize());
+    if(memPoolCharge(size) != DLC_OK){
+        return DLC_ERR;
+    }
+
+    start = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(start == MAP_FAILED){
+        memPoolRefund(size);
+        return DLC_ERR;
+    }
+
+    memNumaBind(start, size, mp->node);
+    memSlabInit(mp, start, size, true);
+    return DLC_OK;
+}
+
+/**
+ * @brief   hand an empty slab back to the OS.
+ 
+ * @param   mp is the memory pool object.
+ * @param   slab is the slab whose blocks are all free.
+ */
+static void memPoolShrink(struct memPool *mp, struct memSlab *slab){
+    size_t size = slab->size;
+
+    assert(slab->mapped && slab->free_blocks == slab->total_blocks);
+
+    memSlabUnlink(slab);
+    mp->slabs--;
+    mp->size -= size;
+    mp->total_blocks -= slab->total_blocks;
+    mp->free_blocks -= slab->total_blocks;
+
+    munmap(slab, size);
+    memPoolRefund(size);
+}
+
 /**
  * @brief  define a memPool object.
  
  * @param  name the name of the memPool.    
- * @param  block_count the count of memory block of the memPool.    
+ * @param  block_count the count of memory block of the first slab.    
  * @param  block_size  the size of memory block of the memPool.  
  * @return  the memPool object which is created.
- * @note   the memPool object is a static memPool.
+ * @note   the first slab is carved from the arena of pools, or mapped if the arena
+ *         is used up. It is never unmapped.
  * @see     
  */
 struct memPool *memPoolDefine(char* name, size_t block_count, size_t block_size){
     struct memPool *mp;
-    size_t offset;
-    uint8_t *block_ptr;
+    size_t size;
     void *start;
 
     assert(name != NULL);
     assert(block_size > 0 && block_count > 0);
 
-    start = (void *)mp_current_start;
-    assert(start != NULL);
-
     mp = (struct memPool *)zmalloc(sizeof(struct memPool));
     if(mp == NULL) return NULL;
+    memset(mp, 0, sizeof(struct memPool));
 
-    strncpy(mp->name, name, DLC_NAME_SIZE);
-    mp->total_blocks = block_count;
-
+    strncpy(mp->name, name, DLC_NAME_SIZE - 1);
+    mp->partial.prev = mp->partial.next = &mp->partial;
     mp->block_size = MEM_ALIGN_UP(block_size, MEM_ALIGNMENT);
-    mp->free_blocks = block_count;
-
-    mp->start = start;
-    mp->size = (mp->block_size + sizeof(uint8_t*)) * mp->total_blocks;
+    mp->slab_blocks = DLC_MAX((size_t)1, SIZE_OF_MEMPOOL_SLAB / SIZE_OF_SLAB_BLOCK(mp));
+    mp->soft_limit = block_count;
+    mp->node = -1;
+
+    if(mp_arena.start == NULL){
+        mp_arena.start = memArenaReserve(mp_arena.size, mp_arena.hugePages);
+        mp_arena.current = mp_arena.start;
+        mp_arena.end = mp_arena.start == NULL ? NULL : mp_arena.start + mp_arena.size;
+    }
 
-    block_ptr = (uint8_t *)mp->start;
-    for (offset = 0; offset < mp->total_blocks; ++offset) {
-        *(uint8_t **)(block_ptr + offset * (mp->block_size + sizeof(uint8_t *))) =  \
-        block_ptr + (offset + 1) * (mp->block_size + sizeof(uint8_t *));
+    size = SIZE_OF_SLAB_HEADER + block_count * SIZE_OF_SLAB_BLOCK(mp);
+    start = mp_arena.current;
+    if(mp_arena.start != NULL && (size_t)(mp_arena.end - mp_arena.current) >= size){
+        MEMPOOL_UPDATE_CURRENT_START(size);
+    }else{
+        start = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(start == MAP_FAILED){
+            zfree(mp);
+            return NULL;
+        }
     }
+    memSlabInit(mp, start, size, false);
 
-    //! remove last invalid block.
-    *(uint8_t **)(block_ptr + (offset - 1) * (mp->block_size + sizeof(uint8_t *))) = NULL; 
+    mp->avail = mp->free_blocks * mp->block_size;
+    return mp;
+}
 
-    mp->block_list = block_ptr;
-    MEMPOOL_UPDATE_CURRENT_START(mp->size);
+/**
+ * @brief   set the arena the first slabs of pools are carved from.
+ 
+ * @param   size is the size of the arena, 0 takes SIZE_OF_MEMPOOL_ARENA.
+ * @param   hugePages is how the arena is backed by huge pages.
+ * @note    it takes effect only before the first pool is defined.
+ */
+void memPoolConfigure(size_t size, dlcHugePages_t hugePages){
+    if(mp_arena.start != NULL) return;
+    mp_arena.size = size ? size : SIZE_OF_MEMPOOL_ARENA;
+    mp_arena.hugePages = hugePages;
+}
 
-    mp->err = 0;
-    mp->max = 0;
-    mp->used = 0;
-    mp->avail = mp->total_blocks * mp->block_size;
-    return mp;
+/**
+ * @brief   set the soft limit of a memory pool.
+ 
+ * @param   mp is the memory pool object.
+ * @param   block_count is the count of blocks in use beyond which a warning is issued,
+ *          the pool keeps growing anyway.
+ */
+void memPoolSetLimit(struct memPool *mp, size_t block_count){
+    assert(mp != NULL);
+    mp->soft_limit = block_count;
 }
 
+/**
+ * @brief   set the hard limit of memory mapped on demand by all pools.
+ 
+ * @param   size is the limit, uint:byte. 0 means unlimited.
+ * @note    allocation fails with NULL once a pool can't grow within the limit.
+ */
+void memPoolSetMemoryLimit(size_t size){
+    mp_mapped_limit = size;
+}
 
 /**
  * @brief   allocate a memory block from memory pool.
  
  * @param   mp is the memory pool object.
- * @return  the memory block.
+ * @return  the memory block, NULL if the pool can't grow any more.
  * @note    
  * @see     
  */
 void *memPoolAlloc(struct memPool *mp){
+    struct memSlab *slab;
     uint8_t *block_ptr;
 
     assert(mp != NULL);
     assert(mp->free_blocks <= mp->total_blocks);
-    // assert(mp->block_list != NULL);
 
-    if (mp->free_blocks <= 0 || mp->block_list == NULL) {
-        mp->err++;
-        return NULL;
+    slab = mp->partial.next;
+    if (slab == &mp->partial) {
+        if(memPoolGrow(mp) != DLC_OK){
+            mp->err++;
+            return NULL;
+        }
+        slab = mp->partial.next;
+    }
+    assert(slab->free_blocks > 0);
+
+    if(slab->block_list != NULL){
+        //! get the head of block list, which points to next block.
+        block_ptr = slab->block_list;
+        slab->block_list = *(uint8_t **)block_ptr;
+    }else{
+        //! carve a block never used.
+        assert(slab->carved < slab->total_blocks);
+        block_ptr = (uint8_t *)slab + SIZE_OF_SLAB_HEADER + slab->carved++ * SIZE_OF_SLAB_BLOCK(mp);
     }
 
-    //！get the head of block list.
-    block_ptr = mp->block_list;
-
-    //! the head of block list points to next block.
-    mp->block_list = *(uint8_t **)block_ptr;
-
-    //! unlinked block points to the memPool.
-    *(uint8_t **)block_ptr = (uint8_t *)mp;
+    //! unlinked block points to the slab.
+    *(struct memSlab **)block_ptr = slab;
+    if(--slab->free_blocks == 0){
+        memSlabUnlink(slab);
+    }
     mp->free_blocks--;
 
     //! record the memory usage.
     mp->avail = mp->free_blocks * mp->block_size;
-    mp->used = mp->size - mp->avail;
-    mp->max = mp->used < mp->max ? mp->max : mp->used;
+    mp->used = (mp->total_blocks - mp->free_blocks) * mp->block_size;
+    if(mp->used > mp->max){
+        //! warn once, when the high-water mark crosses the soft limit.
+        if(mp->max <= mp->soft_limit * mp->block_size 
+            && mp->used > mp->soft_limit * mp->block_size){
+            dlc_warn("memPool [%s] exceeds its soft limit of %lu blocks\n", 
+                mp->name, mp->soft_limit);
+        }
+        mp->max = mp->used;
+    }
 
-    return (uint8_t *)(block_ptr + sizeof(uint8_t *));
+    return (uint8_t *)(block_ptr + sizeof(struct memSlab *));
 }
 
 /**
@@ -140,52 +420,356 @@ void *memPoolAlloc(struct memPool *mp){
  * @param   mp is the memory pool object.
  * @param   prt is pointer to a memory block.
  * @return  void
- * @note    
+ * @note    an empty slab mapped on demand is unmapped, unless the rest of the pool
+ *          runs short of free blocks, which keeps a pool at the edge of a slab from
+ *          mapping and unmapping on every allocation.
  * @see     
  */
 void memPoolFree(struct memPool *mp, void *ptr){
+    struct memSlab *slab;
     uint8_t *block_ptr;
     assert(mp);
     assert(ptr);
 
-    block_ptr = (uint8_t *)(((uint8_t *)ptr) - sizeof(uint8_t *));
-    if((uint8_t *)mp != *(uint8_t **)block_ptr){
+    block_ptr = (uint8_t *)(((uint8_t *)ptr) - sizeof(struct memSlab *));
+    slab = *(struct memSlab **)block_ptr;
+    if(slab == NULL || mp != slab->pool){
         mp->err++;
         return;
     }
 
-    assert(mp->free_blocks < mp->total_blocks);
+    assert(slab->free_blocks < slab->total_blocks);
 
     //! link the block into the block list. 
-    *(uint8_t **)block_ptr = mp->block_list;
-    mp->block_list = block_ptr;
+    *(uint8_t **)block_ptr = slab->block_list;
+    slab->block_list = block_ptr;
 
+    if(slab->free_blocks++ == 0){
+        memSlabLink(&mp->partial, slab);
+    }
     mp->free_blocks++;
 
+    //! an empty slab is rewound, its blocks are carved from the start again.
+    if(slab->free_blocks == slab->total_blocks){
+        slab->carved = 0;
+        slab->block_list = NULL;
+    }
+
+    if(slab->mapped && slab->free_blocks == slab->total_blocks
+        && mp->free_blocks - slab->free_blocks >= mp->slab_blocks / 2
+        && atomic_load(&mp->poppers) == 0){
+        memPoolShrink(mp, slab);
+    }
+
     //! record the memory usage.
     mp->avail = mp->free_blocks * mp->block_size;
-    mp->used = mp->size - mp->avail;
+    mp->used = (mp->total_blocks - mp->free_blocks) * mp->block_size;
 }
 
-void memPoolPrint(struct memPool *mp){
-    if(mp == NULL) return;
+/**
+ * @note A shared pool is allocated from and freed to by any thread. In front of its
+ *       slabs, which are guarded by the lock of the pool, there are two layers:
+ *
+ *       thread --> magazine --> depot --> slabs (locked)
+ *
+ *       1. a magazine of each thread keeps a few blocks the thread freed, and hands
+ *          them out again to the thread without any atomic operation.
+ *       2. the depot is a lock-free stack of free blocks, linked through the first
+ *          word of their payload, the header of a block keeps pointing to its slab.
+ *          The top is tagged with a count of pops in its unused high bits, so that a
+ *          top popped and pushed again meanwhile fails the compare-and-swap (ABA).
+ *
+ *       A full magazine hands half of it to the depot with a single compare-and-swap,
+ *       or to the slabs once the depot holds a slab of blocks, so that the empty slabs
+ *       are unmapped. An empty magazine is refilled from the slabs by a batch.
+ *
+ *       A thread popping the depot may read the link of a block another thread has
+ *       just popped, so no slab is unmapped while a thread is popping the depot.
+ */
+#define MEMPOOL_MAGAZINES       (8)     //! shared pools with magazines at most.
+#define MEMPOOL_MAGAZINE_BLOCKS (16)
+#define MEMPOOL_MAGAZINE_SIZE   (4096)  //! bytes of blocks a magazine holds at most.
+
+#define DEPOT_PTR_BITS          (48)
+#define DEPOT_PTR_MASK          (((uint64_t)1 << DEPOT_PTR_BITS) - 1)
+#define depotPtr(top)           ((void *)(size_t)((top) & DEPOT_PTR_MASK))
+#define depotTag(top)           ((top) >> DEPOT_PTR_BITS)
+#define depotPack(ptr, tag)     ((uint64_t)(size_t)(ptr) | ((uint64_t)(tag) << DEPOT_PTR_BITS))
+#define depotLink(ptr)          (*(void **)(ptr))
+
+typedef struct memMagazine{
+    struct memPool *pool;
+    size_t count;
+    void *blocks[MEMPOOL_MAGAZINE_BLOCKS];
+}memMagazine_t;
+
+static __thread memMagazine_t magazines[MEMPOOL_MAGAZINES] __tlsInitialExec;
+static __thread bool magazinesArmed __tlsInitialExec;
+static atomic_int mp_shared_pools = 0;
+static pthread_key_t magazineKey;
+static pthread_once_t magazineKeyOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief   push a chain of blocks linked through depotLink() onto the depot.
+ */
+static void memDepotPush(struct memPool *mp, void *first, void *last, size_t count){
+    uint64_t top = atomic_load_explicit(&mp->depot, memory_order_relaxed);
+
+    do{
+        depotLink(last) = depotPtr(top);
+    }while(!atomic_compare_exchange_weak_explicit(&mp->depot, &top,
+        depotPack(first, depotTag(top)), memory_order_release, memory_order_relaxed));
+    atomic_fetch_add_explicit(&mp->depot_blocks, count, memory_order_relaxed);
+}
+
+static void *memDepotPop(struct memPool *mp){
+    uint64_t top;
+    void *ptr;
+
+    atomic_fetch_add(&mp->poppers, 1);
+    top = atomic_load_explicit(&mp->depot, memory_order_acquire);
+    do{
+        ptr = depotPtr(top);
+        if(ptr == NULL) break;
+    }while(!atomic_compare_exchange_weak_explicit(&mp->depot, &top,
+        depotPack(__atomic_load_n((void **)ptr, __ATOMIC_RELAXED), depotTag(top) + 1),
+        memory_order_acquire, memory_order_acquire));
+    atomic_fetch_sub_explicit(&mp->poppers, 1, memory_order_release);
+
+    if(ptr != NULL){
+        atomic_fetch_sub_explicit(&mp->depot_blocks, 1, memory_order_relaxed);
+    }
+    return ptr;
+}
+
+/**
+ * @brief   hand blocks back to a shared pool, to the depot while it holds less than a
+ *          slab of blocks, to the slabs otherwise.
+ */
+static void memPoolGiveBack(struct memPool *mp, void **blocks, size_t count){
+    if(count == 0) return;
+
+    if(atomic_load_explicit(&mp->depot_blocks, memory_order_relaxed) + count <= mp->slab_blocks){
+        for(size_t i = 0; i + 1 < count; i++){
+            depotLink(blocks[i]) = blocks[i + 1];
+        }
+        memDepotPush(mp, blocks[0], blocks[count - 1], count);
+        return;
+    }
+
+    spinlockAcquire(&mp->lock);
+    for(size_t i = 0; i < count; i++){
+        memPoolFree(mp, blocks[i]);
+    }
+    spinlockRelease(&mp->lock);
+}
+
+//! the magazines of an exiting thread are handed back.
+static void memMagazineDestructor(void *arg){
+    memMagazine_t *mags = arg;
+
+    for(int i = 0; i < MEMPOOL_MAGAZINES; i++){
+        if(mags[i].pool == NULL) continue;
+        memPoolGiveBack(mags[i].pool, mags[i].blocks, mags[i].count);
+        mags[i].count = 0;
+    }
+}
+
+static void memMagazineKeyCreate(void){
+    pthread_key_create(&magazineKey, memMagazineDestructor);
+}
+
+//! the magazine of the calling thread for a pool, NULL if the pool has none.
+static inline memMagazine_t *memMagazineGet(struct memPool *mp){
+    memMagazine_t *mag;
+
+    if(mp->id < 0) return NULL;
+    if(!magazinesArmed){
+        magazinesArmed = true;
+        pthread_setspecific(magazineKey, magazines);
+    }
+    mag = &magazines[mp->id];
+    mag->pool = mp;
+    return mag;
+}
+
+/**
+ * @brief   define a memPool object shared by all threads.
+ * @note    the parameters are those of memPoolDefine(). A pool of blocks too large
+ *          to be kept by magazines, or beyond MEMPOOL_MAGAZINES pools, has no magazine.
+ */
+struct memPool *memPoolSharedDefine(char* name, size_t block_count, size_t block_size){
+    return memPoolNodeDefine(name, block_count, block_size, -1);
+}
+
+/**
+ * @brief   define a memPool object shared by all threads, placed on a NUMA node.
+ * @param   node is the node, -1 for any.
+ */
+struct memPool *memPoolNodeDefine(char* name, size_t block_count, size_t block_size, int node){
+    struct memPool *mp;
+    struct memSlab *slab;
+    int id;
+
+    pthread_once(&magazineKeyOnce, memMagazineKeyCreate);
+    mp = memPoolDefine(name, block_count, block_size);
+    if(mp == NULL) return NULL;
+
+    //! the first slab is the only one yet, none of its blocks has been touched.
+    mp->node = node;
+    slab = mp->partial.next;
+    memNumaBind(slab, slab->size, node);
+
+    spinlockInit(&mp->lock, 2048);
+    mp->magazine = DLC_MIN(MEMPOOL_MAGAZINE_BLOCKS, MEMPOOL_MAGAZINE_SIZE / mp->block_size);
+    mp->id = -1;
+    if(mp->magazine > 0){
+        id = atomic_fetch_add(&mp_shared_pools, 1);
+        if(id < MEMPOOL_MAGAZINES) mp->id = id;
+    }
+    return mp;
+}
+
+/**
+ * @brief   the pool a block allocated from a memory pool belongs to.
+ */
+struct memPool *memPoolOwner(void *ptr){
+    assert(ptr != NULL);
+    return (*(struct memSlab **)((uint8_t *)ptr - sizeof(struct memSlab *)))->pool;
+}
+
+/**
+ * @brief   allocate a memory block from a shared memory pool.
+ * @return  the memory block, NULL if the pool can't grow any more.
+ */
+void *memPoolAllocShared(struct memPool *mp){
+    memMagazine_t *mag;
+    void *ptr;
+
+    assert(mp != NULL);
+    mag = memMagazineGet(mp);
+    if(mag != NULL && mag->count > 0){
+        return mag->blocks[--mag->count];
+    }
+
+    ptr = memDepotPop(mp);
+    if(ptr != NULL) return ptr;
+
+    spinlockAcquire(&mp->lock);
+    ptr = memPoolAlloc(mp);
+    //! a batch for the magazine, half of it, so that a free doesn't overflow it.
+    while(ptr != NULL && mag != NULL && mag->count < mp->magazine / 2){
+        void *extra = memPoolAlloc(mp);
+        if(extra == NULL) break;
+        mag->blocks[mag->count++] = extra;
+    }
+    spinlockRelease(&mp->lock);
+
+    if(ptr == NULL) memPoolInfo(mp);
+    return ptr;
+}
+
+/**
+ * @brief   free a memory block to a shared memory pool, from any thread.
+ */
+void memPoolFreeShared(struct memPool *mp, void *ptr){
+    memMagazine_t *mag;
+    size_t half;
+
+    assert(mp != NULL && ptr != NULL);
+    assert(memPoolOwner(ptr) == mp);
+
+    mag = memMagazineGet(mp);
+    if(mag == NULL){
+        memPoolGiveBack(mp, &ptr, 1);
+        return;
+    }
+
+    if(mag->count == mp->magazine){
+        half = mag->count / 2;
+        mag->count -= half;
+        memPoolGiveBack(mp, &mag->blocks[mag->count], half);
+    }
+    mag->blocks[mag->count++] = ptr;
+}
+
+/**
+ * @brief   hand the blocks of the magazine of the calling thread and of the depot back
+ *          to the slabs of a shared pool, so that its statistics are exact.
+ * @note    the blocks in the magazines of the other threads are kept.
+ */
+void memPoolDrain(struct memPool *mp){
+    memMagazine_t *mag;
+    void *ptr;
+
+    assert(mp != NULL);
+    mag = memMagazineGet(mp);
+    spinlockAcquire(&mp->lock);
+    while(mag != NULL && mag->count > 0){
+        memPoolFree(mp, mag->blocks[--mag->count]);
+    }
+    while((ptr = memDepotPop(mp)) != NULL){
+        memPoolFree(mp, ptr);
+    }
+    spinlockRelease(&mp->lock);
+}
+
+/**
+ * @brief   charge memory mapped outside of the pools to the limit of mapped memory.
+ * @param   size is the size in bytes.
+ * @return  DLC_OK, or DLC_ERR if the limit would be exceeded.
+ */
+err_t memPoolCharge(size_t size){
+    if(mp_mapped_limit != 0 && mp_mapped_size + size > mp_mapped_limit){
+        return DLC_ERR;
+    }
+    mp_mapped_size += size;
+    return DLC_OK;
+}
+
+/**
+ * @brief   give back memory charged by memPoolCharge().
+ */
+void memPoolRefund(size_t size){
+    assert(mp_mapped_size >= size);
+    mp_mapped_size -= size;
+}
+
+/**
+ * @brief   print a line of statistics in the format of the memory pools.
+ * @note    shared by the other allocators of the checker, so that the memory 
+ *          used by them is reported alongside the pools.
+ */
+void memPoolPrintStats(const char *name, int32_t err, int32_t slabs, size_t size, 
+    size_t avail, size_t used, size_t max){
     fprintf(stderr, "\n---------------[%s] memPool info------------------\n",\
-        mp->name);\
-    fprintf(stderr, "err \t avail \t used \t max\t\n");\
-    fprintf(stderr, "%d \t %d \t %d\t %d\t\n", mp->err, \
-        mp->avail, mp->used, mp->max);\
+        name);\
+    fprintf(stderr, "err \t slabs \t size \t avail \t used \t max\t\n");\
+    fprintf(stderr, "%d \t %d \t %lu \t %lu \t %lu\t %lu\t\n", err, slabs, \
+        size, avail, used, max);\
     fflush(stderr);\
 }
 
+void memPoolPrint(struct memPool *mp){
+    if(mp == NULL) return;
+    memPoolPrintStats(mp->name, mp->err, mp->slabs, mp->size, mp->avail, mp->used, mp->max);
+}
+
 /*------------------------------test-----------------------*/
 //! test program
 // #define DLC_TEST
 #ifdef DLC_TEST
+#include <sched.h>
 #include "testhelp.h"
 #include "vertex.h"
 
+//! blocks of the size of a thread vertex, which the pools used to hold.
+#define SIZE_OF_TEST_BLOCK      (sizeof(threadInfo_t) + 32)
+
+static memPool_t *testMemPool;
+
 static size_t mpool_used_memory(){
-    return threadVertexMemPool->used + mutexVertexMemPool->used;
+    return testMemPool->used;
 }
 
 #define UNUSED(V) ((void) V)
@@ -198,26 +782,79 @@ static size_t mpool_used_memory(){
 } while(0)
 
 #define report_benchmark(msg) do { \
-    printf(msg ": %ld items , size %lu, block_size %lu, free_blocks %lu, err %d avail %d, max %d\n",  \
-        count, threadVertexMemPool->size, threadVertexMemPool->block_size, threadVertexMemPool->free_blocks, \
-        threadVertexMemPool->err, threadVertexMemPool->avail, threadVertexMemPool->max); \
+    printf(msg ": %ld items , slabs %d, size %lu, block_size %lu, free_blocks %lu, err %d avail %lu, max %lu\n",  \
+        count, testMemPool->slabs, testMemPool->size, testMemPool->block_size, \
+        testMemPool->free_blocks, testMemPool->err, testMemPool->avail, \
+        testMemPool->max); \
 } while(0)
 
-/* ./demo test mpool [<count> | --accurate] */
+#define SIZE_OF_TEST_BURST      (8)
+
+struct memPoolTestArg{
+    memPool_t *mp;
+    spinlock_t *lock;       //! NULL for a shared pool.
+    long count;
+};
+
+//! allocate bursts of blocks and free them, as threads coming and going do.
+static void *memPoolTestThread(void *arg){
+    struct memPoolTestArg *t = arg;
+    void *blocks[SIZE_OF_TEST_BURST];
+    long j;
+    int k;
+
+    for (j = 0; j < t->count; j += SIZE_OF_TEST_BURST) {
+        for (k = 0; k < SIZE_OF_TEST_BURST; k++) {
+            if (t->lock == NULL) {
+                blocks[k] = memPoolAllocShared(t->mp);
+            } else {
+                spinlockAcquire(t->lock);
+                blocks[k] = memPoolAlloc(t->mp);
+                spinlockRelease(t->lock);
+            }
+            assert(blocks[k]);
+            *(long *)blocks[k] = j;
+        }
+        for (k = 0; k < SIZE_OF_TEST_BURST; k++) {
+            assert(*(long *)blocks[k] == j);
+            if (t->lock == NULL) {
+                memPoolFreeShared(t->mp, blocks[k]);
+            } else {
+                spinlockAcquire(t->lock);
+                memPoolFree(t->mp, blocks[k]);
+                spinlockRelease(t->lock);
+            }
+        }
+    }
+    return NULL;
+}
+
+static long long memPoolTestConcurrent(memPool_t *mp, spinlock_t *lock, long count, int threads){
+    struct memPoolTestArg arg = {.mp = mp, .lock = lock, .count = count};
+    pthread_t tids[threads];
+    long long start = timeInMilliseconds();
+
+    for (int i = 0; i < threads; i++) {
+        assert(pthread_create(&tids[i], NULL, memPoolTestThread, &arg) == 0);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    return timeInMilliseconds() - start;
+}
+
+/* ./demo test mpool [<count> | --accurate [<threads>]], a count beyond NUMBER_OF_THREAD 
+   grows the pool, then each of the threads allocates and frees count blocks. */
 int memPoolTest(int argc, char **argv, int flags) {
     long j;
     long long start, elapsed;
     memInit();
-    threadVertexMemPool = memPoolDefine("mpool", NUMBER_OF_THREAD, 
-        sizeof(vertex_t) + sizeof(struct threadInfo));
-
-    mutexVertexMemPool = memPoolDefine("mpool", NUMBER_OF_THREAD, 
-        sizeof(vertex_t) + sizeof(struct mutexInfo));
+    testMemPool = memPoolDefine("mpool", NUMBER_OF_THREAD, SIZE_OF_TEST_BLOCK);
 
     long count = 0;
     int accurate = (flags & DLC_TEST_ACCURATE);
 
-    if (argc == 4) {
+    if (argc >= 4) {
         if (accurate) {
             count = 5000000;
         } else {
@@ -229,11 +866,12 @@ int memPoolTest(int argc, char **argv, int flags) {
 
     report_benchmark("initial");
     dlc_dbg("count %ld\n", count);
-    vertex_t *vs[NUMBER_OF_THREAD] = {0};
+    void **vs = zmalloc(count * sizeof(void *));
+    assert(vs);
     start_benchmark();
 
     for (j = 0; j < count; j++) {
-        vs[j] = memPoolAlloc(threadVertexMemPool);
+        vs[j] = memPoolAlloc(testMemPool);
         assert(vs[j]);
     }
     end_benchmark("Allocating");
@@ -242,17 +880,103 @@ int memPoolTest(int argc, char **argv, int flags) {
 
     start_benchmark();
     for (j = 0; j < count; j++) {
-
+        memset(vs[j], 0xa5, SIZE_OF_TEST_BLOCK);
     }
     end_benchmark("Validity of allocated memory address");
 
     start_benchmark();
     for (j = 0; j < count; j++) {
         // fprintf(stderr, "vs[%ld]: %p\n", j, vs[j]);
-        memPoolFree(threadVertexMemPool, vs[j]);
+        memPoolFree(testMemPool, vs[j]);
     }
     end_benchmark("Free of allocated memory address");
 
+    report_benchmark("Shrink");
+    zfree(vs);
+    if (testMemPool->used != 0) return 1;
+
+    int threads = argc >= 5 ? (int)strtol(argv[4], NULL, 10) : 4;
+    spinlock_t lock = SPINLOCK_INITIALIZER;
+    memPool_t *shared = memPoolSharedDefine("shared", NUMBER_OF_THREAD, SIZE_OF_TEST_BLOCK);
+
+    spinlockInit(&lock, 2048);
+    elapsed = memPoolTestConcurrent(testMemPool, &lock, count, threads);
+    printf("Locked pool: %d threads x %ld items in %lld ms\n", threads, count, elapsed);
+    elapsed = memPoolTestConcurrent(shared, NULL, count, threads);
+    printf("Shared pool: %d threads x %ld items in %lld ms\n", threads, count, elapsed);
+
+    //! the magazines of the threads are handed back as they exit.
+    memPoolDrain(shared);
+    testMemPool = shared;
+    report_benchmark("Shared");
+    return testMemPool->used == 0 && testMemPool->err == 0 ? 0 : 1;
+}
+
+/**
+ * @brief   write events round-robin into the rings of a pool, as the threads of the
+ *          application do, from a thread pinned to a cpu.
+ * @return  the time taken, uint:ms.
+ */
+static long long memNumaTestWrite(memPool_t *mp, long rings, long count){
+    uint8_t **buffers = zmalloc(rings * sizeof(uint8_t *));
+    uint8_t event[SIZE_OF_EVENT];
+    long long start;
+    long j;
+
+    memset(event, 0x5a, sizeof(event));
+    for (j = 0; j < rings; j++) {
+        buffers[j] = memPoolAllocShared(mp);
+        assert(buffers[j]);
+    }
+
+    start = timeInMilliseconds();
+    for (j = 0; j < count; j++) {
+        memcpy(buffers[j % rings] + ((j / rings) & (NUMBER_OF_EVENT - 1)) * SIZE_OF_EVENT,
+            event, SIZE_OF_EVENT);
+    }
+    start = timeInMilliseconds() - start;
+
+    for (j = 0; j < rings; j++) {
+        memPoolFreeShared(mp, buffers[j]);
+    }
+    zfree(buffers);
+    return start;
+}
+
+/* ./demo test numa [<count> [<rings>]], writes count events into the rings placed on a
+   remote node, as a single pool used to place them, then on the node of the writer. */
+int numaTest(int argc, char **argv, int flags) {
+    long count = 10000000, rings = 256;
+    long long remote, local;
+    int nodes, node;
+    memPool_t *mp;
+#ifdef __linux__
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(sched_getcpu(), &set);
+    sched_setaffinity(0, sizeof(set), &set);
+#endif
+    UNUSED(flags);
+    if (argc >= 4) count = strtol(argv[3], NULL, 10);
+    if (argc >= 5) rings = strtol(argv[4], NULL, 10);
+    memInit();
+
+    nodes = memNumaNodes();
+    node = memNumaNode();
+    printf("nodes %d, writer on node %d, %ld rings of %lu bytes\n", nodes, node, rings,
+        (size_t)SIZE_OF_EVENTQUEUE_BUFFER);
+    if (nodes == 1) printf("a single node, remote is local\n");
+
+    mp = memPoolNodeDefine("remote", rings, SIZE_OF_EVENTQUEUE_BUFFER, (node + 1) % nodes);
+    memNumaTestWrite(mp, rings, rings * NUMBER_OF_EVENT);
+    remote = memNumaTestWrite(mp, rings, count);
+    printf("remote: %ld events in %lld ms\n", count, remote);
+
+    mp = memPoolNodeDefine("local", rings, SIZE_OF_EVENTQUEUE_BUFFER, node);
+    memNumaTestWrite(mp, rings, rings * NUMBER_OF_EVENT);
+    local = memNumaTestWrite(mp, rings, count);
+    printf("local : %ld events in %lld ms\n", count, local);
     return 0;
 }
 #endif
@@ -0,0 +1,356 @@
+/**
+ * @file    period.c
+ * @author  qufeiyan
+ * @brief   Adaptive cadence of the checker.
+ * @version 1.0.0
+ * @date    2026/10/18 10:12:31
+ * @version Copyright (c) 2026
+ */
+
+/* Includes --------------------------------------------------------------------------------*/
+#include "common.h"
+#include "dlcDef.h"
+#include "internal.h"
+#include "interface.h"
+#include "timer.h"
+#include <stdatomic.h>
+
+/**
+ * @note The detection period starts at PERIOD_OF_DLCHECKER and is revised after every pass:
+ *       1. it doubles up to PERIOD_OF_DLCHECKER_MAX while no event arrives and no thread waits.
+ *       2. it halves down to PERIOD_OF_DLCHECKER_MIN while the oldest wait exceeds
+ *          THRESHOLD_OF_LONG_WAIT, since a long wait is the symptom of a deadlock.
+ *       3. it is held while the event queues lag, the graph is stale until they are drained.
+ *       4. it returns to the baseline otherwise, or as soon as a thread waits while backed off.
+ *       The period of gc follows the detection period by FACTOR_OF_GC_PERIOD.
+ *       The sleep between two drains backs off with the period while quiescent, up to
+ *       PERIOD_OF_EVENTLOOP_MAX, so that a queue still can't fill up during one sleep, and
+ *       returns to PERIOD_OF_EVENTLOOP as soon as a drain finds events.
+ */
+
+#define METRICS_INITIALIZER {                               \
+    .periodMs = PERIOD_OF_DLCHECKER,                        \
+    .gcPeriodMs = FACTOR_OF_GC_PERIOD * PERIOD_OF_DLCHECKER,\
+    .drainWaitMs = PERIOD_OF_EVENTLOOP,                     \
+    .reason = DLC_PERIOD_BASELINE                           \
+}
+
+//! owned by the checker thread.
+static dlcCheckerMetrics_t metrics = METRICS_INITIALIZER;
+
+//! the copy read by dlcGetCheckerMetrics, the sequence is odd while it is rewritten.
+static dlcCheckerMetrics_t published = METRICS_INITIALIZER;
+static atomic_uint publishedSeq;
+
+static dlcTimer_t *checkTimer, *gcTimer;
+
+//! observed by the event loop since the last pass.
+static uint64_t drainedEvents;
+static uint32_t maxFillPercent;
+
+static const char *reasonName[DLC_PERIOD_BUTT] = {
+    "baseline",
+    "quiescent",
+    "wakeup",
+    "long wait",
+    "queue lag",
+    "deadlock"
+};
+
+/**
+ * @brief   bind the timers whose period is to be adapted.
+ * @param   check is the timer of detection.
+ * @param   gc is the timer of garbage collection.
+ */
+void checkPeriodInit(dlcTimer_t *check, dlcTimer_t *gc){
+    assert(check != NULL && gc != NULL);
+
+    checkTimer = check;
+    gcTimer = gc;
+}
+
+/**
+ * @brief   publish the metrics to dlcGetCheckerMetrics.
+ * @note    a seqlock with the checker as the only writer.
+ */
+static void checkPeriodPublish(void){
+    unsigned seq = atomic_load_explicit(&publishedSeq, memory_order_relaxed);
+
+    atomic_store_explicit(&publishedSeq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    published = metrics;
+    atomic_store_explicit(&publishedSeq, seq + 2, memory_order_release);
+}
+
+static void checkPeriodApply(uint32_t period, dlcPeriodReason_t reason, long long now){
+    uint32_t gcPeriod;
+
+    metrics.reason = reason;
+    if(period == metrics.periodMs) return;
+
+    metrics.periodMs = period;
+    dlcTimerReset(checkTimer, now + period, period);
+
+    gcPeriod = FACTOR_OF_GC_PERIOD * period;
+    metrics.gcPeriodMs = gcPeriod;
+    dlcTimerReset(gcTimer, DLC_MIN(gcTimer->whenMs, (uint64_t)now + gcPeriod), gcPeriod);
+}
+
+/**
+ * @brief   the upper bound of sleeping before the next drain.
+ */
+uint32_t checkPeriodDrainWait(void){
+    return metrics.drainWaitMs;
+}
+
+/**
+ * @brief   account a drain of all event queues.
+ * @param   drained is the number of events processed.
+ * @param   fillPercent is the highest fill level among the queues before draining.
+ * @note    called by the event loop, after every drain.
+ */
+void checkPeriodObserve(uint32_t drained, uint32_t fillPercent){
+    uint32_t drainWait = metrics.drainWaitMs;
+
+    drainedEvents += drained;
+    maxFillPercent = DLC_MAX(maxFillPercent, fillPercent);
+
+    //! keep draining without sleep while any queue is filling up.
+    if(fillPercent >= THRESHOLD_OF_QUEUE_LAG){
+        metrics.drainWaitMs = 0;
+    }else if(drained > 0){
+        metrics.drainWaitMs = PERIOD_OF_EVENTLOOP;
+    }
+
+    //! a thread starts waiting while backed off, pull the next pass in.
+    if(drained > 0 && metrics.periodMs > PERIOD_OF_DLCHECKER
+        && flatMapSize(requestThreadMap) > 0){
+        checkPeriodApply(PERIOD_OF_DLCHECKER, DLC_PERIOD_WAKEUP, timeInMilliseconds());
+        checkPeriodPublish();
+    }else if(metrics.drainWaitMs != drainWait){
+        checkPeriodPublish();
+    }
+}
+
+/**
+ * @brief   the age of the oldest wait edge.
+ * @note    the value of requestThreadMap is the time the thread started waiting.
+ */
+static uint64_t checkPeriodOldestWait(long long now){
+    flatMapIterator_t iter;
+    flatMapEntry_t *entry;
+    long long oldest = now;
+
+    flatMapIteratorInit(&iter, requestThreadMap);
+    while((entry = flatMapNext(&iter)) != NULL){
+        oldest = DLC_MIN(oldest, (long long)entry->value);
+    }
+    return now - oldest;
+}
+
+/**
+ * @brief   revise the detection period after a pass.
+ * @param   deadlocks is the number of deadlocks found by the pass.
+ */
+void checkPeriodAdjust(int deadlocks){
+    long long now = timeInMilliseconds();
+    uint32_t period = metrics.periodMs;
+    dlcPeriodReason_t reason;
+
+    assert(checkTimer != NULL && gcTimer != NULL);
+    assert(requestThreadMap != NULL);
+
+    metrics.waitingThreads = flatMapSize(requestThreadMap);
+    metrics.oldestWaitMs = checkPeriodOldestWait(now);
+    metrics.queueFillPercent = maxFillPercent;
+    metrics.events = drainedEvents;
+    metrics.checks++;
+    metrics.mutexVertices = graph.set[VERTEX_MUTEX].live;
+    metrics.evictions = graph.set[VERTEX_MUTEX].evicted;
+    metrics.graphBytes = graph.set[VERTEX_THREAD].size + graph.set[VERTEX_MUTEX].size;
+
+    if(deadlocks > 0){
+        metrics.deadlocks++;
+        period = PERIOD_OF_DLCHECKER;
+        reason = DLC_PERIOD_DEADLOCK;
+    }else if(maxFillPercent >= THRESHOLD_OF_QUEUE_LAG){
+        reason = DLC_PERIOD_QUEUE_LAG;
+    }else if(metrics.waitingThreads == 0 && drainedEvents == 0){
+        period = DLC_MIN(period * 2, PERIOD_OF_DLCHECKER_MAX);
+        reason = DLC_PERIOD_QUIESCENT;
+    }else if(metrics.oldestWaitMs >= THRESHOLD_OF_LONG_WAIT){
+        period = DLC_MAX(period / 2, PERIOD_OF_DLCHECKER_MIN);
+        reason = DLC_PERIOD_LONG_WAIT;
+    }else{
+        period = PERIOD_OF_DLCHECKER;
+        reason = DLC_PERIOD_BASELINE;
+    }
+
+    checkPeriodApply(period, reason, now);
+    if(reason == DLC_PERIOD_QUIESCENT){
+        metrics.drainWaitMs = DLC_MIN(period / PERIOD_OF_DLCHECKER, PERIOD_OF_EVENTLOOP_MAX);
+    }else{
+        metrics.drainWaitMs = DLC_MIN(metrics.drainWaitMs, PERIOD_OF_EVENTLOOP);
+    }
+    dlc_dbg("period %u ms (%s), drain wait %u ms, waiting %u, oldest %lu ms, fill %u%%, "
+        "events %lu\n", metrics.periodMs, reasonName[reason], metrics.drainWaitMs,
+        metrics.waitingThreads, metrics.oldestWaitMs, metrics.queueFillPercent, metrics.events);
+    checkPeriodPublish();
+
+    drainedEvents = 0;
+    maxFillPercent = 0;
+}
+
+/**
+ * @brief take a snapshot of the checker metrics.
+ * @param snapshot [out] the snapshot.
+ * @note  all fields come from the same pass, retried while the checker publishes.
+ */
+void dlcGetCheckerMetrics(dlcCheckerMetrics_t *snapshot){
+    unsigned seq;
+
+    assert(snapshot != NULL);
+    do{
+        seq = atomic_load_explicit(&publishedSeq, memory_order_acquire);
+        if(seq & 1) continue;
+        *snapshot = published;
+        atomic_thread_fence(memory_order_acquire);
+    }while((seq & 1) || seq != atomic_load_explicit(&publishedSeq, memory_order_relaxed));
+}
+
+/**
+ * @brief the printable name of a period reason.
+ */
+const char *dlcPeriodReasonName(dlcPeriodReason_t reason){
+    return reason < DLC_PERIOD_BUTT ? reasonName[reason] : "unknown";
+}
+
+// #define DLC_TEST
+#ifdef DLC_TEST
+#include <stdio.h>
+#include "mem.h"
+#include "testhelp.h"
+
+#define PERIOD_TEST_WAITER      (0x7e57)    //! the key of a thread waiting, never a real one.
+
+static void periodTestTimerProc(void *args){
+    (void)args;
+}
+
+/**
+ * @brief revise the period once and check the outcome, the gc period must follow.
+ */
+static void periodTestAdjust(int deadlocks, uint32_t period, dlcPeriodReason_t reason){
+    dlcCheckerMetrics_t snapshot;
+
+    checkPeriodAdjust(deadlocks);
+    dlcGetCheckerMetrics(&snapshot);
+    assert(snapshot.periodMs == metrics.periodMs && snapshot.reason == metrics.reason);
+    assert(snapshot.checks == metrics.checks && snapshot.drainWaitMs == metrics.drainWaitMs);
+    printf("  %-9s period %4u ms, gc %6u ms, drain wait %2u ms\n",
+        reasonName[metrics.reason], metrics.periodMs, metrics.gcPeriodMs, metrics.drainWaitMs);
+    assert(metrics.reason == reason);
+    assert(metrics.periodMs == period);
+    assert(metrics.periodMs >= PERIOD_OF_DLCHECKER_MIN);
+    assert(metrics.periodMs <= PERIOD_OF_DLCHECKER_MAX);
+    assert(checkTimer->period == period);
+    assert(metrics.gcPeriodMs == FACTOR_OF_GC_PERIOD * period);
+    assert(gcTimer->period == metrics.gcPeriodMs);
+    assert(gcTimer->whenMs <= (uint64_t)timeInMilliseconds() + metrics.gcPeriodMs);
+    assert(checkTimer->whenMs <= (uint64_t)timeInMilliseconds() + period);
+}
+
+/* ./demo test period, synthetic drains, fill levels and wait ages are fed to the checker
+   cadence, each transition of the period and its bounds are checked. */
+int periodTest(int argc, char **argv, int flags){
+    dlcTimerConfig_t config = {
+        .period = PERIOD_OF_DLCHECKER,
+        .timerFunc = periodTestTimerProc,
+        .cycle = TIMER_CYCLE,
+    };
+    flatMap_t *waiters = requestThreadMap;
+    uint32_t period;
+    uint64_t deadlocks;
+
+    memInit();
+    //! the threads waiting are the test's own, whatever other tests left behind.
+    requestThreadMap = flatMapCreate(16);
+    assert(requestThreadMap != NULL);
+
+    //! the timers are never fired, only their periods are looked at.
+    config.whenMs = timeInMilliseconds() + PERIOD_OF_DLCHECKER;
+    checkTimer = dlcTimerCreate(&config);
+    config.period = FACTOR_OF_GC_PERIOD * PERIOD_OF_DLCHECKER;
+    config.whenMs = timeInMilliseconds() + config.period;
+    gcTimer = dlcTimerCreate(&config);
+    checkPeriodInit(checkTimer, gcTimer);
+    assert(metrics.periodMs == PERIOD_OF_DLCHECKER);
+
+    //! no event and no waiter, the period doubles up to the max, the drain wait follows.
+    printf("quiescent:\n");
+    for(period = PERIOD_OF_DLCHECKER * 2; period <= PERIOD_OF_DLCHECKER_MAX; period *= 2){
+        checkPeriodObserve(0, 0);
+        periodTestAdjust(0, period, DLC_PERIOD_QUIESCENT);
+        assert(metrics.drainWaitMs > PERIOD_OF_EVENTLOOP);
+        assert(metrics.drainWaitMs <= PERIOD_OF_EVENTLOOP_MAX);
+    }
+    periodTestAdjust(0, PERIOD_OF_DLCHECKER_MAX, DLC_PERIOD_QUIESCENT);
+    assert(metrics.drainWaitMs == PERIOD_OF_EVENTLOOP_MAX);
+
+    //! a thread starts waiting while backed off, the next pass is pulled in at once.
+    printf("wakeup:\n");
+    assert(flatMapPut(requestThreadMap, PERIOD_TEST_WAITER,
+        (void *)timeInMilliseconds()) == 1);
+    checkPeriodObserve(1, 1);
+    assert(metrics.reason == DLC_PERIOD_WAKEUP);
+    assert(metrics.periodMs == PERIOD_OF_DLCHECKER);
+    assert(metrics.gcPeriodMs == FACTOR_OF_GC_PERIOD * PERIOD_OF_DLCHECKER);
+    assert(metrics.drainWaitMs == PERIOD_OF_EVENTLOOP);
+    periodTestAdjust(0, PERIOD_OF_DLCHECKER, DLC_PERIOD_BASELINE);
+
+    //! a queue filling up, the drain doesn't sleep and the period is held.
+    printf("queue lag:\n");
+    checkPeriodObserve(200, THRESHOLD_OF_QUEUE_LAG);
+    assert(metrics.drainWaitMs == 0);
+    checkPeriodObserve(0, 10);
+    assert(metrics.drainWaitMs == 0);
+    periodTestAdjust(0, PERIOD_OF_DLCHECKER, DLC_PERIOD_QUEUE_LAG);
+    assert(metrics.queueFillPercent == THRESHOLD_OF_QUEUE_LAG);
+    assert(metrics.drainWaitMs == 0);
+    checkPeriodObserve(10, 10);
+    assert(metrics.drainWaitMs == PERIOD_OF_EVENTLOOP);
+
+    //! the oldest wait is long, the period halves down to the min.
+    printf("long wait:\n");
+    assert(flatMapPut(requestThreadMap, PERIOD_TEST_WAITER,
+        (void *)(timeInMilliseconds() - THRESHOLD_OF_LONG_WAIT - 1)) == 0);
+    for(period = PERIOD_OF_DLCHECKER / 2; period >= PERIOD_OF_DLCHECKER_MIN; period /= 2){
+        periodTestAdjust(0, period, DLC_PERIOD_LONG_WAIT);
+        assert(metrics.oldestWaitMs > THRESHOLD_OF_LONG_WAIT);
+        assert(metrics.waitingThreads == 1);
+    }
+    periodTestAdjust(0, PERIOD_OF_DLCHECKER_MIN, DLC_PERIOD_LONG_WAIT);
+
+    //! a deadlock found, back to the baseline.
+    printf("deadlock:\n");
+    deadlocks = metrics.deadlocks;
+    periodTestAdjust(1, PERIOD_OF_DLCHECKER, DLC_PERIOD_DEADLOCK);
+    assert(metrics.deadlocks == deadlocks + 1);
+
+    //! the wait is over and events keep coming, the period stays at the baseline.
+    printf("baseline:\n");
+    periodTestAdjust(0, PERIOD_OF_DLCHECKER / 2, DLC_PERIOD_LONG_WAIT);
+    assert(flatMapRemove(requestThreadMap, PERIOD_TEST_WAITER) == 0);
+    checkPeriodObserve(3, 0);
+    periodTestAdjust(0, PERIOD_OF_DLCHECKER, DLC_PERIOD_BASELINE);
+    assert(metrics.events == 3 && metrics.waitingThreads == 0);
+    assert(metrics.drainWaitMs == PERIOD_OF_EVENTLOOP);
+
+    dlcTimerDestroy(checkTimer);
+    dlcTimerDestroy(gcTimer);
+    checkTimer = gcTimer = NULL;
+    flatMapDestroy(requestThreadMap);
+    requestThreadMap = waiters;
+    return 0;
+}
+#endif
@@ -8,38 +8,25 @@
  */
 
 /* Includes --------------------------------------------------------------------------------*/
-#include "hashMap.h"
+#include "flatMap.h"
+#include "heldSet.h"
 #include "internal.h"
 #include "vertex.h"
 #include <stddef.h>
 
-static void reportInfo(const char *prefix, vertex_t *u, vertex_t *v);
-
-//! hash function for long.
-static uint64_t hashCallback(const void *key) {
-    extern size_t _hashCodeOfInteger(size_t key);
-    return _hashCodeOfInteger((size_t)key);
-}
-
-static HASH_MAP_OPS IntegerMapType = {
-    hashCallback,
-    NULL,
-    NULL,
-    NULL,
-    NULL,
-    NULL
-};
+static void reportInfo(const char *prefix, vid_t u, vid_t v);
 
 /**
  * @brief handler for unlocking the mutex possibly held by a different thread.
  * @param ssc [in] is the dead-lock cycle. 
  * @param num is the number of vertex of ssc. 
  */ 
-void reportDeadLock(vertex_t **ssc, int num){
-    vertex_t *v;
+void reportDeadLock(vid_t *ssc, int num){
+    vid_t v = VID_NONE, next;
+    int count, i;
     const char *info, *prefix;
     assert(num >= 2);
-    hashMap_t *sscMap = hashMapCreate(&IntegerMapType, num);
+    flatMap_t *sscMap = flatMapCreate(num);
 
     if(num == 2){
         info = "==1001== [!!!Warnning!!!] Possible self-lock detected...";
@@ -51,51 +38,51 @@ void reportDeadLock(vertex_t **ssc, int num){
     fprintf(stderr, "%s\n", info);
 
     for(size_t i = 0; i < num; ++i){
-        hashMapPut(sscMap, ssc[i], (void *)i);
+        flatMapPut(sscMap, ssc[i], (void *)i);
 
         //! find a vertex whose type is thread.
-        if(ssc[i]->type == VERTEX_THREAD){
+        if(vertexType(ssc[i]) == VERTEX_THREAD){
             v = ssc[i];
             continue;
         }
     }
 
-    arc_t *head = v->arcList;
+    assert(v != VID_NONE);
 
     //! the outer loop traverses every vertex in the ssc.
     while (num--) {
-        //! traverse v's arc list to find a vertex in the sscMap. 
-        while(head){
-            if(hashMapFind(sscMap, head->tail)){
-                reportInfo(prefix, v, head->tail);
-                //! head->tail is the next vertex in the circle.
-                v = head->tail;
-                head = v->arcList;
+        //! traverse v's arcs to find a vertex in the sscMap. 
+        count = vertexOutdegree(v);
+        for(i = 0; i < count; i++){
+            next = vertexArc(v, i);
+            if(flatMapFind(sscMap, next)){
+                reportInfo(prefix, v, next);
+                //! next is the next vertex in the circle.
+                v = next;
                 break;
             }
-            head = head->next;
         }
     }
 
-    hashMapDestroy(sscMap);
+    flatMapDestroy(sscMap);
 }
 
-static void reportInfo(const char *prefix, vertex_t *u, vertex_t *v){
+static void reportInfo(const char *prefix, vid_t u, vid_t v){
     threadInfo_t *ti;
     mutexInfo_t *mi;
-    assert(v);
+    assert(v != VID_NONE);
 
-    if(u->type == VERTEX_THREAD && v->type == VERTEX_MUTEX){
-        ti = (threadInfo_t *)u->private;
-        mi = (mutexInfo_t *)v->private;
+    if(vertexType(u) == VERTEX_THREAD && vertexType(v) == VERTEX_MUTEX){
+        ti = vertexThreadInfo(u);
+        mi = vertexMutexInfo(v);
 
         fprintf(stderr, "%s Thread # [%ld %s]:\n", prefix, ti->tid, ti->name);
         fprintf(stderr, "%s  \t holds the lock #%p [%p %p %p %p %p]\n", 
             prefix, (void *)mi->mid, ti->backtrace[0], ti->backtrace[1], 
             ti->backtrace[2], ti->backtrace[3], ti->backtrace[4]);
-    }else if(u->type == VERTEX_MUTEX && v->type == VERTEX_THREAD){
-        ti = (threadInfo_t *)v->private;
-        mi = (mutexInfo_t *)u->private;
+    }else if(vertexType(u) == VERTEX_MUTEX && vertexType(v) == VERTEX_THREAD){
+        ti = vertexThreadInfo(v);
+        mi = vertexMutexInfo(u);
         
         fprintf(stderr, "%s Thread # [%ld %s]:\n", prefix, ti->tid, ti->name);
         fprintf(stderr, "%s  \t waits the lock #%p [%p %p %p %p %p]\n",
@@ -104,7 +91,67 @@ static void reportInfo(const char *prefix, vertex_t *u, vertex_t *v){
     }
 }
 
+static void reportHeld(const char *prefix, const char *what, threadInfo_t *ti, 
+    size_t mid, const heldSet_t *set){
+    fprintf(stderr, "%s Thread # [%ld %s]:\n", prefix, ti->tid, ti->name);
+    fprintf(stderr, "%s  \t %s the lock #%p [%p %p %p %p %p]\n",
+        prefix, what, (void *)mid, ti->backtrace[0], ti->backtrace[1], 
+        ti->backtrace[2], ti->backtrace[3], ti->backtrace[4]);
+    heldSetPrint(set, prefix);
+}
 
+/**
+ * @brief handler for locking a mutex the thread holds, reported by the thread itself
+ *        before it blocks forever.
+ * @param ti [in] is the thread.
+ * @param mid is the mutex locked again.
+ * @param set [in] is the mutexes held by the thread.
+ */
+void reportRelock(threadInfo_t *ti, size_t mid, const heldSet_t *set){
+    fprintf(stderr, "==1001== [!!!Warnning!!!] Self-lock detected...\n");
+    reportHeld("==1001==", "locks again", ti, mid, set);
+}
 
+/**
+ * @brief handler for unlocking a mutex the thread doesn't hold, e.g. unlocked twice.
+ */
+void reportUnheldUnlock(threadInfo_t *ti, size_t mid, const heldSet_t *set){
+    fprintf(stderr, "==1232== [!!!Warnning!!!] Unlocking mutex not held by the thread...\n");
+    reportHeld("==1232==", "unlocks", ti, mid, set);
+}
 
+/**
+ * @brief handler for unlocking a mutex before the mutexes locked after it.
+ */
+void reportUnlockOrder(threadInfo_t *ti, size_t mid, const heldSet_t *set){
+    fprintf(stderr, "==1233== [Notice] Mutex unlocked out of order...\n");
+    reportHeld("==1233==", "unlocks", ti, mid, set);
+}
+
+extern threadInfo_t *lockOrderInfo(vid_t u, vid_t v);
+
+/**
+ * @brief handler for a cycle of the lock order, the mutexes may deadlock.
+ * @param cycle [in] is the mutexes of the cycle, each one was locked while the one before
+ *        it was held, and the first one while the last one was held.
+ * @param num is the number of mutexes of the cycle.
+ */
+void reportLockOrder(vid_t *cycle, int num){
+    threadInfo_t *ti;
+    vid_t u, v;
 
+    assert(num >= 2);
+    fprintf(stderr, "==1241== [!!!Warnning!!!] Possible deadlock, mutexes locked in a cycle of orders...\n");
+    for(int i = 0; i < num; i++){
+        u = cycle[(i + num - 1) % num];
+        v = cycle[i];
+        ti = lockOrderInfo(u, v);
+        assert(ti != NULL);
+
+        fprintf(stderr, "==1241== Thread # [%ld %s]:\n", ti->tid, ti->name);
+        fprintf(stderr, "==1241==  \t locks #%p while holding #%p [%p %p %p %p %p]\n",
+            (void *)vertexMutexInfo(v)->mid, (void *)vertexMutexInfo(u)->mid,
+            ti->backtrace[0], ti->backtrace[1], ti->backtrace[2], ti->backtrace[3],
+            ti->backtrace[4]);
+    }
+}
@@ -0,0 +1,250 @@
+/**
+ * @file    shadow.c
+ * @author  qufeiyan
+ * @brief   direct-mapped shadow table indexed by user addresses.
+ * @version 1.0.0
+ * @date    2026/10/18 19:02:37
+ * @version Copyright (c) 2026
+ */
+
+/* Includes --------------------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "common.h"
+#include "mempool.h"
+#include "shadow.h"
+
+#define SHADOW_MAP_FLAGS    (MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE)
+
+//! the page of the reservation a slot lies in.
+#define shadowMapPage(map, index)   (((index) << SHADOW_SLOT_SHIFT) >> (map)->pageShift)
+
+/**
+ * @brief   reserve the address space of a shadow map.
+ * @param   map is the shadow map object.
+ * @param   name is the name reported in the statistics.
+ * @return  DLC_OK, or DLC_ERR if the address space can't be reserved, the map
+ *          covers nothing then.
+ */
+err_t shadowMapInit(shadowMap_t *map, const char *name){
+    size_t pageSize = (size_t)getpagesize();
+    void *slots, *refs, *generations;
+
+    assert(map != NULL && name != NULL);
+    memset(map, 0, sizeof(shadowMap_t));
+    strncpy(map->name, name, DLC_NAME_SIZE - 1);
+    map->pageShift = __builtin_ctzl(pageSize);
+
+    slots = mmap(NULL, SIZE_OF_SHADOW, PROT_READ | PROT_WRITE, SHADOW_MAP_FLAGS, -1, 0);
+    if(slots == MAP_FAILED){
+        dlc_warn("[%s] shadow can't be reserved\n", map->name);
+        return DLC_ERR;
+    }
+
+    refs = mmap(NULL, (SIZE_OF_SHADOW >> map->pageShift) * sizeof(uint16_t),
+        PROT_READ | PROT_WRITE, SHADOW_MAP_FLAGS, -1, 0);
+    if(refs == MAP_FAILED){
+        munmap(slots, SIZE_OF_SHADOW);
+        dlc_warn("[%s] shadow can't be reserved\n", map->name);
+        return DLC_ERR;
+    }
+
+    map->slots = slots;
+    map->refs = refs;
+
+    //! without generations, every address has a single life.
+    generations = mmap(NULL, SIZE_OF_SHADOW_GENERATIONS, PROT_READ | PROT_WRITE,
+        SHADOW_MAP_FLAGS, -1, 0);
+    map->generations = generations == MAP_FAILED ? NULL : generations;
+    return DLC_OK;
+}
+
+void shadowMapDeInit(shadowMap_t *map){
+    if(map == NULL || map->slots == NULL) return;
+
+    munmap(map->slots, SIZE_OF_SHADOW);
+    munmap(map->refs, (SIZE_OF_SHADOW >> map->pageShift) * sizeof(uint16_t));
+    if(map->generations != NULL){
+        munmap((void *)map->generations, SIZE_OF_SHADOW_GENERATIONS);
+    }
+    memPoolRefund((size_t)map->pages << map->pageShift);
+    map->spare = 0;
+    map->slots = NULL;
+    map->refs = NULL;
+    map->generations = NULL;
+    map->pages = 0;
+    map->used = 0;
+}
+
+/**
+ * @brief   set the slot of a address.
+ * @param   map is the shadow map object.
+ * @param   addr is the address.
+ * @param   value is the value, must not be NULL.
+ * @return  DLC_OK, or DLC_ERR if the address isn't covered, the slot is taken,
+ *          or the page of the slot can't be committed.
+ */
+err_t shadowMapSet(shadowMap_t *map, size_t addr, void *value){
+    size_t index, page;
+
+    assert(map != NULL && value != NULL);
+    if(!shadowMapCovers(map, addr)) return DLC_ERR;
+
+    index = addr >> SHADOW_GRANULE_SHIFT;
+    if(map->slots[index] != NULL) return DLC_ERR;
+
+    //! the first slot of a page commits the page, unless it's the spare page.
+    page = shadowMapPage(map, index);
+    if(map->refs[page] == 0 && map->spare == page + 1){
+        map->spare = 0;
+    }else if(map->refs[page] == 0){
+        if(memPoolCharge((size_t)1 << map->pageShift) != DLC_OK){
+            if(map->err++ == 0) shadowMapPrint(map);
+            return DLC_ERR;
+        }
+        map->pages++;
+        if(((size_t)map->pages << map->pageShift) > map->max){
+            map->max = (size_t)map->pages << map->pageShift;
+        }
+    }
+    map->refs[page]++;
+    map->slots[index] = value;
+    map->used++;
+    return DLC_OK;
+}
+
+static void shadowMapDecommit(shadowMap_t *map, size_t page){
+    madvise((uint8_t *)map->slots + (page << map->pageShift),
+        (size_t)1 << map->pageShift, MADV_DONTNEED);
+    memPoolRefund((size_t)1 << map->pageShift);
+    map->pages--;
+}
+
+/**
+ * @brief   clear the slot of a address.
+ * @note    the page of the slot is handed back once it has no slot set, and another
+ *          page has been emptied since. The last page emptied is kept as the spare,
+ *          so that a slot set and cleared over and over, e.g. by a mutex created and
+ *          destroyed in a loop, doesn't commit and hand back its page every time.
+ */
+void shadowMapClear(shadowMap_t *map, size_t addr){
+    size_t index, page;
+
+    assert(map != NULL);
+    if(!shadowMapCovers(map, addr)) return;
+
+    index = addr >> SHADOW_GRANULE_SHIFT;
+    if(map->slots[index] == NULL) return;
+
+    map->slots[index] = NULL;
+    map->used--;
+
+    page = shadowMapPage(map, index);
+    assert(map->refs[page] > 0);
+    if(--map->refs[page] == 0){
+        if(map->spare != 0){
+            shadowMapDecommit(map, map->spare - 1);
+        }
+        map->spare = page + 1;
+    }
+}
+
+/**
+ * @brief   print the memory used by the shadow map, in the format of memory pools.
+ */
+void shadowMapPrint(shadowMap_t *map){
+    size_t size, used;
+    if(map == NULL) return;
+
+    size = (size_t)map->pages << map->pageShift;
+    used = map->used << SHADOW_SLOT_SHIFT;
+    memPoolPrintStats(map->name, map->err, map->pages, size, size - used, used, map->max);
+}
+
+/*------------------------------test-----------------------*/
+//! test program
+// #define DLC_TEST
+#ifdef DLC_TEST
+#include <stdlib.h>
+#include "flatMap.h"
+#include "mem.h"
+#include "testhelp.h"
+
+#define start_benchmark() start = timeInMilliseconds()
+#define end_benchmark(name, msg) do { \
+    elapsed = timeInMilliseconds() - start; \
+    printf("%-8s %-8s: %8ld items in %8lld ms\n", name, msg, count, elapsed); \
+} while(0)
+
+int shadowTest(int argc, char **argv, int flags){
+    long j, count = 100000, hits = 0;
+    long long start, elapsed;
+    shadowMap_t map;
+    flatMap_t *fmap;
+    size_t *keys;
+
+    if(argc >= 4) count = strtol(argv[3], NULL, 10);
+    memInit();
+
+    //! keys look like pthread_mutex_t objects allocated together.
+    keys = zmalloc(count * sizeof(size_t));
+    for (j = 0; j < count; j++) {
+        keys[j] = 0x7f0000001000UL + j * 40;
+    }
+
+    assert(shadowMapInit(&map, "shadow") == DLC_OK);
+    fmap = flatMapCreate(16);
+
+    start_benchmark();
+    for (j = 0; j < count; j++) {
+        assert(shadowMapSet(&map, keys[j], (void *)(j + 1)) == DLC_OK);
+    }
+    end_benchmark("shadow", "insert");
+    assert(shadowMapSet(&map, keys[0], (void *)1) == DLC_ERR);
+    shadowMapPrint(&map);
+
+    start_benchmark();
+    for (j = 0; j < count; j++) {
+        flatMapPut(fmap, keys[j], (void *)(j + 1));
+    }
+    end_benchmark("flatMap", "insert");
+
+    start_benchmark();
+    for (int round = 0; round < 10; round++) {
+        for (j = 0; j < count; j++) {
+            hits += shadowMapGet(&map, keys[j]) == (void *)(j + 1);
+        }
+    }
+    end_benchmark("shadow", "lookupx10");
+    assert(hits == count * 10);
+
+    hits = 0;
+    start_benchmark();
+    for (int round = 0; round < 10; round++) {
+        for (j = 0; j < count; j++) {
+            hits += flatMapGet(fmap, keys[j]) == (void *)(j + 1);
+        }
+    }
+    end_benchmark("flatMap", "lookupx10");
+    assert(hits == count * 10);
+
+    //! addresses past the keys and beyond the shadow have no value.
+    assert(shadowMapGet(&map, keys[0] + 40 * count) == NULL);
+    assert(shadowMapGet(&map, (size_t)1 << SHADOW_APP_BITS) == NULL);
+
+    start_benchmark();
+    for (j = 0; j < count; j++) {
+        shadowMapClear(&map, keys[j]);
+    }
+    end_benchmark("shadow", "remove");
+    shadowMapPrint(&map);
+    //! the spare page is kept.
+    assert(map.used == 0 && map.pages == 1);
+
+    shadowMapDeInit(&map);
+    flatMapDestroy(fmap);
+    zfree(keys);
+    return 0;
+}
+#endif
@@ -10,44 +10,230 @@
 /* Includes --------------------------------------------------------------------------------*/
 #include <sched.h>
 #include <stdint.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
 #include "spinlock.h"
 #include "common.h"
 
+/**
+ * @note The lock is queued like a MCS lock, so that it's handed over in the order it's
+ *       asked for, and a waiter only spins on the cache line of its own node:
+ *
+ *       lock: locked | tail --------------------------------+
+ *                                                           v
+ *       owner        head waiter --> waiter --> ... --> last waiter
+ *                    spins on locked  spin on their node
+ *
+ *       The head of the queue spins on the lock word, the other waiters on their node.
+ *       Once the head takes the lock, it wakes up the next waiter, the new head, and its
+ *       node is free again. So a thread needs a single node, as it waits for one lock
+ *       at a time, and the owner holds none, unlock is a single store.
+ *
+ *       A thread finding the lock free takes it straight away, even with waiters queued.
+ *       Handing it over strictly in order would stall every thread behind a waiter that
+ *       has been preempted, as a single cpu would switch threads on every unlock.
+ *
+ *       After spinning for a while, a waiter sleeps on a futex, the lock word or its
+ *       node, as the checker and the threads of the application may share a cpu. A pthread
+ *       mutex can't be used, as it would be tracked by the checker itself.
+ */
+enum{
+    SPIN_WAIT_DONE,
+    SPIN_WAIT_SPINNING,
+    SPIN_WAIT_SLEEPING,
+};
+
+static __thread struct spinNode spinNode __tlsInitialExec;
+
+static inline void spinFutexWait(_Atomic uint32_t *word, uint32_t value){
+#ifdef __linux__
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+#else
+    (void)word;
+    (void)value;
+    sched_yield();
+#endif
+}
+
+static inline void spinFutexWake(_Atomic uint32_t *word){
+#ifdef __linux__
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#else
+    (void)word;
+#endif
+}
+
+//! spin until a word turns to a value, or the spins run out.
+static inline bool spinUntil(_Atomic uint32_t *word, uint32_t value, uint32_t spin){
+    for(uint32_t n = 0; n < spin; n++){
+        if(atomic_load_explicit(word, memory_order_acquire) == value) return true;
+        __cpuRelax();
+    }
+    return false;
+}
+
+static inline bool spinTryLock(struct spinlock *spinlock){
+    uint32_t expected = SPIN_UNLOCKED;
+
+    return atomic_compare_exchange_strong_explicit(&spinlock->locked, &expected,
+        SPIN_LOCKED, memory_order_acquire, memory_order_relaxed);
+}
+
 __weak void __lock(struct spinlock *spinlock){
+    struct spinNode *node = &spinNode, *prev, *next;
+    uint32_t wait;
+
     assert(spinlock);
-    __prefetchw(&spinlock->lock);
-    for(;;){
-        if(!atomic_flag_test_and_set_explicit(&spinlock->lock, memory_order_acq_rel)){
-            return;
-        }
-        
-        //! backoff
-        for(int n = 1; n < spinlock->spin; n <<= 1){
-            __nop;
+    __prefetchw(&spinlock->locked);
+    if(spinTryLock(spinlock)) return;
+
+    //! queue up, and wait on the node until it's the head of the queue.
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    atomic_store_explicit(&node->wait, SPIN_WAIT_SPINNING, memory_order_relaxed);
+    prev = atomic_exchange_explicit(&spinlock->tail, node, memory_order_acq_rel);
+    if(prev != NULL){
+        atomic_store_explicit(&prev->next, node, memory_order_release);
+        while(!spinUntil(&node->wait, SPIN_WAIT_DONE, spinlock->spin)){
+            //! it's SPIN_WAIT_SLEEPING already after a spurious wakeup.
+            wait = SPIN_WAIT_SPINNING;
+            atomic_compare_exchange_strong(&node->wait, &wait, SPIN_WAIT_SLEEPING);
+            if(wait != SPIN_WAIT_DONE){
+                spinFutexWait(&node->wait, SPIN_WAIT_SLEEPING);
+            }
         }
+    }
 
-        if(!atomic_flag_test_and_set_explicit(&spinlock->lock, memory_order_relaxed)){
-            return;
+    //! the head of the queue waits on the lock word.
+    for(;;){
+        if(spinTryLock(spinlock)) break;
+        if(spinUntil(&spinlock->locked, SPIN_UNLOCKED, spinlock->spin)) continue;
+
+        if(atomic_exchange_explicit(&spinlock->locked, SPIN_LOCKED_SLEEPERS,
+            memory_order_acquire) == SPIN_UNLOCKED){
+            break;
         }
-    
-        sched_yield();
-    }  
+        spinFutexWait(&spinlock->locked, SPIN_LOCKED_SLEEPERS);
+    }
+
+    //! leave the queue, the next waiter becomes the head.
+    prev = node;
+    if(atomic_compare_exchange_strong_explicit(&spinlock->tail, &prev, NULL,
+        memory_order_acq_rel, memory_order_relaxed)){
+        return;
+    }
+    while((next = atomic_load_explicit(&node->next, memory_order_acquire)) == NULL){
+        __cpuRelax();
+    }
+    if(atomic_exchange_explicit(&next->wait, SPIN_WAIT_DONE, memory_order_release)
+        == SPIN_WAIT_SLEEPING){
+        spinFutexWake(&next->wait);
+    }
 }
 
 __weak void __unlock(struct spinlock *spinlock){
     assert(spinlock);
-    atomic_flag_clear_explicit(&spinlock->lock, memory_order_relaxed);
+    spinlockRelease(spinlock);
+}
+
+//! wake up the head of the queue sleeping on the lock word.
+void __spinlockWake(struct spinlock *spinlock){
+    spinFutexWake(&spinlock->locked);
 }
 
 void spinlockInit(struct spinlock *spinlock, int32_t spin){
     assert(spinlock);
     assert(spin >= 2);
 
+    atomic_store(&spinlock->locked, SPIN_UNLOCKED);
+    atomic_store(&spinlock->tail, NULL);
     spinlock->spin = spin;
     spinlock->acquire = __lock;
     spinlock->release = __unlock;
 }
 
+/*------------------------------test-----------------------*/
+//! test program
+// #define DLC_TEST
+#ifdef DLC_TEST
+#include <pthread.h>
+#include <stdlib.h>
+#include "testhelp.h"
+
+//! the test-and-set lock the queued lock replaced, as the baseline.
+static atomic_flag tasLock = ATOMIC_FLAG_INIT;
+
+static void tasAcquire(struct spinlock *spinlock){
+    for(;;){
+        if(!atomic_flag_test_and_set_explicit(&tasLock, memory_order_acquire)) return;
+        for(uint32_t n = 1; n < spinlock->spin; n <<= 1){
+            __cpuRelax();
+        }
+        if(!atomic_flag_test_and_set_explicit(&tasLock, memory_order_acquire)) return;
+        sched_yield();
+    }
+}
+
+static void tasRelease(struct spinlock *spinlock){
+    atomic_flag_clear_explicit(&tasLock, memory_order_release);
+}
+
+struct spinlockTestArg{
+    spinlock_t *lock;
+    long ops;
+    volatile long counter;  //! guarded by the lock.
+};
+
+static void *spinlockTestThread(void *arg){
+    struct spinlockTestArg *t = arg;
+
+    for(long j = 0; j < t->ops; j++){
+        t->lock->acquire(t->lock);
+        t->counter++;
+        t->lock->release(t->lock);
+    }
+    return NULL;
+}
 
+static long long spinlockTestRun(spinlock_t *lock, int threads, long ops){
+    struct spinlockTestArg arg = {.lock = lock, .ops = ops, .counter = 0};
+    pthread_t tids[threads];
+    long long start = timeInMilliseconds();
 
+    for(int i = 0; i < threads; i++){
+        assert(pthread_create(&tids[i], NULL, spinlockTestThread, &arg) == 0);
+    }
+    for(int i = 0; i < threads; i++){
+        pthread_join(tids[i], NULL);
+    }
+    start = timeInMilliseconds() - start;
+    assert(arg.counter == ops * threads);
+    return start;
+}
+
+/* ./demo test spinlock [<ops> [<threads>]], each of 2, 4, ... threads up to 64 takes
+   the lock ops times, with the queued lock and with the test-and-set lock. */
+int spinlockTest(int argc, char **argv, int flags){
+    long ops = 100000;
+    int maxThreads = 64;
+    long long queued, tas;
+    spinlock_t lock = SPINLOCK_INITIALIZER;
+
+    if(argc >= 4) ops = strtol(argv[3], NULL, 10);
+    if(argc >= 5) maxThreads = atoi(argv[4]);
 
+    for(int threads = 2; threads <= maxThreads; threads <<= 1){
+        spinlockInit(&lock, 2048);
+        queued = spinlockTestRun(&lock, threads, ops);
+
+        lock.acquire = tasAcquire;
+        lock.release = tasRelease;
+        tas = spinlockTestRun(&lock, threads, ops);
+        printf("%2d threads x %ld ops: queued %6lld ms, test-and-set %6lld ms\n",
+            threads, ops, queued, tas);
+    }
+    return 0;
+}
+#endif
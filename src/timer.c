@@ -11,24 +11,241 @@
 
 #include <assert.h>
 #include <internal.h>
+#include <errno.h>
+#include <time.h>
 #include <unistd.h>
 #include "mem.h"
 #include "timer.h"
 
-static dlcTimer_t timerDummy;
+/**
+ * @note Timers are kept in a hierarchical timing wheel driven by the monotonic clock.
+ *       Level 0 has one slot per millisecond, every upper level is TIMER_WHEEL_SLOTS
+ *       times coarser, and timers of an upper slot are cascaded downwards when the
+ *       lower level wraps around. Insert and cancel are O(1), finding the nearest
+ *       deadline is O(TIMER_WHEEL_LEVELS) by means of the occupancy bitmaps.
+ *
+ * @attention All timers are owned by the checker thread, no locking is done here.
+ */
+#define TIMER_WHEEL_BITS        (6)
+#define TIMER_WHEEL_SLOTS       (1 << TIMER_WHEEL_BITS)         //! aka 64
+#define TIMER_WHEEL_MASK        (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS      (4)                             //! covers 2^24 ms, about 4.6 hours.
+#define TIMER_WHEEL_RANGE       (1ULL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+
+#define TIMER_SLOT_EXPIRED      (0xfffe)    //! linked into the list of expired timers.
+#define TIMER_SLOT_DETACHED     (0xffff)    //! not linked anywhere.
+
+#define TIMER_FLAG_DESTROYED    (1 << 0)    //! destroyed by its own callback.
+#define TIMER_FLAG_RESET        (1 << 1)    //! rescheduled by its own callback.
+
+struct timerWheel{
+    uint64_t current;       //! the next tick to be processed, uint:ms.
+    uint64_t bitmap[TIMER_WHEEL_LEVELS];
+    dlcTimer_t slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];   //! dummy heads.
+    dlcTimer_t *running;    //! the timer whose callback is executing.
+    bool initialised;
+};
+
+static struct timerWheel wheel;
 
 long long timeInMilliseconds(void) {
-    struct timeval tv;
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (((long long)ts.tv_sec) * 1000) + (ts.tv_nsec / 1000000);
+}
+
+static inline void timerListInit(dlcTimer_t *head){
+    head->prev = head;
+    head->next = head;
+}
+
+static inline bool timerListIsEmpty(dlcTimer_t *head){
+    return head->next == head;
+}
+
+static inline void timerListAddTail(dlcTimer_t *head, dlcTimer_t *timer){
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+static inline void timerListDel(dlcTimer_t *timer){
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = timer->next = NULL;
+}
+
+/**
+ * @brief   move all timers of the list {@code from} to the tail of the list {@code to}.
+ */
+static inline void timerListSplice(dlcTimer_t *from, dlcTimer_t *to){
+    if(timerListIsEmpty(from)) return;
+
+    from->next->prev = to->prev;
+    to->prev->next = from->next;
+    from->prev->next = to;
+    to->prev = from->prev;
+    timerListInit(from);
+}
+
+static void timerWheelInit(void){
+    int level, idx;
+
+    for(level = 0; level < TIMER_WHEEL_LEVELS; ++level){
+        wheel.bitmap[level] = 0;
+        for(idx = 0; idx < TIMER_WHEEL_SLOTS; ++idx){
+            timerListInit(&wheel.slots[level][idx]);
+        }
+    }
+    wheel.current = timeInMilliseconds();
+    wheel.running = NULL;
+    wheel.initialised = true;
+}
+
+static void timerWheelAdd(dlcTimer_t *timer){
+    uint64_t expires, delta;
+    int level, idx;
+
+    expires = timer->whenMs < wheel.current ? wheel.current : timer->whenMs;
+    delta = expires - wheel.current;
+
+    //! a timer beyond the range of the wheel parks in the farthest slot,
+    //! it will be placed again with its real expiry on cascading.
+    if(delta >= TIMER_WHEEL_RANGE){
+        delta = TIMER_WHEEL_RANGE - 1;
+        expires = wheel.current + delta;
+    }
+
+    for(level = 0; level < TIMER_WHEEL_LEVELS - 1; ++level){
+        if(delta < (1ULL << ((level + 1) * TIMER_WHEEL_BITS))){
+            break;
+        }
+    }
+    idx = (expires >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK;
+
+    timerListAddTail(&wheel.slots[level][idx], timer);
+    wheel.bitmap[level] |= (1ULL << idx);
+    timer->slot = level * TIMER_WHEEL_SLOTS + idx;
+}
+
+static void timerWheelDel(dlcTimer_t *timer){
+    int level, idx;
+
+    if(timer->slot == TIMER_SLOT_DETACHED) return;
+
+    timerListDel(timer);
+    if(timer->slot != TIMER_SLOT_EXPIRED){
+        level = timer->slot / TIMER_WHEEL_SLOTS;
+        idx = timer->slot % TIMER_WHEEL_SLOTS;
+        if(timerListIsEmpty(&wheel.slots[level][idx])){
+            wheel.bitmap[level] &= ~(1ULL << idx);
+        }
+    }
+    timer->slot = TIMER_SLOT_DETACHED;
+}
+
+/**
+ * @brief   re-add all timers of a upper slot, so that they move to a finer level.
+ */
+static void timerWheelCascade(int level, int idx){
+    dlcTimer_t pending, *timer;
+
+    if(!(wheel.bitmap[level] & (1ULL << idx))) return;
+
+    timerListInit(&pending);
+    timerListSplice(&wheel.slots[level][idx], &pending);
+    wheel.bitmap[level] &= ~(1ULL << idx);
+
+    while(!timerListIsEmpty(&pending)){
+        timer = pending.next;
+        timerListDel(timer);
+        timerWheelAdd(timer);
+    }
+}
+
+/**
+ * @brief   the earliest tick at which some work is due, that is either the
+ *          expiry of a level 0 timer or the cascading of a occupied upper slot.
+ */
+static uint64_t timerWheelNextTick(void){
+    uint64_t nearest = UINT64_MAX;
+    uint64_t start, rotated, when;
+    int level, shift;
+
+    for(level = 0; level < TIMER_WHEEL_LEVELS; ++level){
+        if(wheel.bitmap[level] == 0) continue;
+
+        shift = level * TIMER_WHEEL_BITS;
+        //! the first slot boundary of this level at or after current.
+        start = (wheel.current + (1ULL << shift) - 1) >> shift;
+        rotated = wheel.bitmap[level] >> (start & TIMER_WHEEL_MASK);
+        if((start & TIMER_WHEEL_MASK) != 0){
+            rotated |= wheel.bitmap[level] << (TIMER_WHEEL_SLOTS - (start & TIMER_WHEEL_MASK));
+        }
+
+        when = (start + __builtin_ctzll(rotated)) << shift;
+        nearest = DLC_MIN(nearest, when);
+    }
+
+    return nearest;
+}
+
+/**
+ * @brief   advance the wheel up to {@code now}, all timers expired meanwhile
+ *          are moved to the list {@code expired}.
+ */
+static void timerWheelAdvance(uint64_t now, dlcTimer_t *expired){
+    dlcTimer_t *head;
+    uint64_t pending, next;
+    int level, idx;
+
+    while(wheel.current <= now){
+        idx = wheel.current & TIMER_WHEEL_MASK;
+        if(idx == 0){
+            for(level = 1; level < TIMER_WHEEL_LEVELS; ++level){
+                int upper = (wheel.current >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK;
+                timerWheelCascade(level, upper);
+                if(upper != 0) break;
+            }
+        }
+
+        pending = wheel.bitmap[0] >> idx;
+        if(pending == 0){
+            //! nothing left in this round of level 0, jump to the next work.
+            next = timerWheelNextTick();
+            wheel.current = DLC_MAX(wheel.current + 1, DLC_MIN(next, now + 1));
+            continue;
+        }
+
+        next = wheel.current + __builtin_ctzll(pending);
+        if(next > now){
+            wheel.current = now + 1;
+            break;
+        }
 
-    gettimeofday(&tv, NULL);
-    return (((long long)tv.tv_sec) * 1000) + (tv.tv_usec / 1000);
+        idx = next & TIMER_WHEEL_MASK;
+        head = &wheel.slots[0][idx];
+        for(dlcTimer_t *t = head->next; t != head; t = t->next){
+            t->slot = TIMER_SLOT_EXPIRED;
+        }
+        timerListSplice(head, expired);
+        wheel.bitmap[0] &= ~(1ULL << idx);
+        wheel.current = next + 1;
+    }
 }
 
 dlcTimer_t *dlcTimerCreate(dlcTimerConfig_t *config){
-    dlcTimer_t *ret, *head, *prev;
+    dlcTimer_t *ret;
     assert(config != NULL);
     assert(config->timerFunc != NULL);
     assert(config->whenMs != 0);
+    assert(config->cycle != TIMER_CYCLE || config->period != 0);
+
+    if(!wheel.initialised){
+        timerWheelInit();
+    }
 
     ret = (dlcTimer_t *)zmalloc(sizeof(dlcTimer_t));
     assert(ret != NULL);
@@ -38,90 +255,314 @@ dlcTimer_t *dlcTimerCreate(dlcTimerConfig_t *config){
     ret->timerFunc = config->timerFunc;
     ret->args = config->args;
     ret->cycle = config->cycle;
-    ret->next = NULL;
+    ret->flags = 0;
+    ret->slot = TIMER_SLOT_DETACHED;
 
-    head = timerDummy.next;
-    prev = &timerDummy;
-    while(head){
-        head = head->next;
-        prev = prev->next;
-    }
-    //! insert timer to the tail of timer list.
-    prev->next = ret;
-    dlc_dbg("ret %p, prev %p\n", ret, prev);
+    timerWheelAdd(ret);
+    dlc_dbg("ret %p, slot %u\n", ret, ret->slot);
     return ret;
 }
 
+/**
+ * @brief   cancel a timer and release it.
+ * @note    it is safe to be called by any timer callback, even for the timer itself.
+ */
 void dlcTimerDestroy(dlcTimer_t *timer){
-    dlcTimer_t *head, *prev;
     assert(timer != NULL);
 
-    head = timerDummy.next;
-    prev = &timerDummy;
-    assert(head != NULL);
-
-    //! remove timer from timer list.
-    while (head) {
-        if(head == timer){
-            prev->next = head->next;
-            break;
-        }
-        prev = prev->next;
-        head = head->next;
+    if(timer == wheel.running){
+        //! released by dlcTimerProc once the callback returns.
+        timer->flags |= TIMER_FLAG_DESTROYED;
+        return;
     }
 
+    //! remove timer from timer wheel.
+    timerWheelDel(timer);
+
     //! free memory.
-    zfree(timer); 
+    zfree(timer);
 }
 
-static void dlcTimerUpdate(dlcTimer_t *timer){
+/**
+ * @brief   move a timer to a new expiry and change its period.
+ * @param   timer is the timer to be rescheduled.
+ * @param   whenMs is the new expiry on the monotonic clock, uint:ms.
+ * @param   period is the new period, uint:ms.
+ * @note    it is safe to be called by any timer callback, even for the timer itself.
+ */
+void dlcTimerReset(dlcTimer_t *timer, uint64_t whenMs, uint64_t period){
+    assert(timer != NULL);
+    assert(timer->cycle != TIMER_CYCLE || period != 0);
+
+    timer->whenMs = whenMs;
+    timer->period = period;
+
+    if(timer == wheel.running){
+        //! re-added by dlcTimerProc once the callback returns.
+        timer->flags |= TIMER_FLAG_RESET;
+        return;
+    }
+
+    timerWheelDel(timer);
+    timerWheelAdd(timer);
+}
+
+static void dlcTimerUpdate(dlcTimer_t *timer, uint64_t now){
     assert(timer);
     assert(timer->cycle == TIMER_CYCLE);
 
     timer->whenMs += timer->period;
+    //! skip the periods missed while the checker was stalled.
+    if(timer->whenMs <= now){
+        timer->whenMs = now + timer->period;
+    }
 }
 
 /**
- * @brief  find the first timer will fire. 
+ * @brief  find the deadline of the first timer will fire.
  *
- * @param   void  
- * @return  the timer will fire.    
+ * @param   void
+ * @return  the deadline on the monotonic clock, or UINT64_MAX if there is no timer.
+ * @note    for a timer still in an upper level the time of cascading is returned,
+ *          which is never later than its expiry.
  */
-static dlcTimer_t *dlcTimerNearest(void){
-    dlcTimer_t *timer = timerDummy.next;
-    dlcTimer_t *nearest = NULL;
-    
-    while(timer){
-        if(nearest == NULL || timer->whenMs < nearest->whenMs){
-            nearest = timer;
+uint64_t dlcTimerNearest(void){
+    if(!wheel.initialised) return UINT64_MAX;
+    return timerWheelNextTick();
+}
+
+/**
+ * @brief   fire all timers expired by {@code now}.
+ */
+static void timerProcAt(uint64_t now){
+    dlcTimer_t expired, *timer;
+
+    timerListInit(&expired);
+    timerWheelAdvance(now, &expired);
+
+    while(!timerListIsEmpty(&expired)){
+        timer = expired.next;
+        timerListDel(timer);
+        timer->slot = TIMER_SLOT_DETACHED;
+
+        wheel.running = timer;
+        timer->timerFunc(timer->args);
+        wheel.running = NULL;
+
+        if(timer->flags & TIMER_FLAG_DESTROYED){
+            zfree(timer);
+            continue;
         }
-        timer = timer->next;
-    }
 
-    return nearest;
+        if(timer->flags & TIMER_FLAG_RESET){
+            timer->flags &= ~TIMER_FLAG_RESET;
+        }else if(timer->cycle == TIMER_CYCLE){
+            dlcTimerUpdate(timer, now);
+        }else{
+            zfree(timer);
+            continue;
+        }
+        timerWheelAdd(timer);
+    }
 }
 
+/**
+ * @brief   fire all expired timers.
+ */
 void dlcTimerProc(void){
-    dlcTimer_t *timer = timerDummy.next;
-    long long now;
+    if(!wheel.initialised) return;
+
+    timerProcAt(timeInMilliseconds());
+}
+
+/**
+ * @brief   sleep until the nearest timer is due, but no longer than {@code maxWaitMs}.
+ * @param   maxWaitMs is the upper bound of sleeping, uint:ms.
+ */
+void dlcTimerWait(uint64_t maxWaitMs){
+    struct timespec deadline;
+    uint64_t now, until;
 
     now = timeInMilliseconds();
-    while(timer){
-        if(timer->whenMs <= now){
-            timer->timerFunc(timer->args);
-            // dlc_warn("timer period %lu\n", timer->period);
-
-            if(timer->cycle == TIMER_CYCLE){
-                dlcTimerUpdate(timer);
-            } else{
-                dlcTimerDestroy(timer);
-            }
-        }
-        timer = timer->next;
+    until = DLC_MIN(dlcTimerNearest(), now + maxWaitMs);
+    if(until <= now) return;
+
+    deadline.tv_sec = until / 1000;
+    deadline.tv_nsec = (until % 1000) * 1000000;
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+}
+
+// #define DLC_TEST
+#ifdef DLC_TEST
+#include <stdio.h>
+#include "testhelp.h"
+
+#define TIMER_TEST_BASE         (1ULL << 40)    //! a fake clock far from the real one.
+
+enum{
+    TIMER_TEST_NONE,
+    TIMER_TEST_DESTROY,     //! the callback destroys its own timer.
+    TIMER_TEST_RESET,       //! the callback moves its own timer 1000ms later.
+};
+
+struct timerTestCase{
+    dlcTimer_t *timer;
+    uint64_t whenMs;        //! the expiry expected.
+    uint64_t firedMs;       //! the tick the callback ran at.
+    int fired;
+    int action;
+};
+
+static uint64_t timerTestNow;
+
+static void timerTestCallback(void *args){
+    struct timerTestCase *tc = (struct timerTestCase *)args;
+
+    assert(wheel.running == tc->timer);
+    tc->fired++;
+    tc->firedMs = timerTestNow;
+    if(tc->action == TIMER_TEST_DESTROY){
+        dlcTimerDestroy(tc->timer);
+        tc->timer = NULL;
+    }else if(tc->action == TIMER_TEST_RESET){
+        tc->action = TIMER_TEST_NONE;
+        tc->whenMs = timerTestNow + 1000;
+        dlcTimerReset(tc->timer, tc->whenMs, 7);
     }
+}
 
-    dlcTimer_t *nearest = dlcTimerNearest();
-    assert(nearest != NULL);
-    now = timeInMilliseconds();
-    usleep((nearest->whenMs <= now ? 0 : nearest->whenMs - now));
+static dlcTimer_t *timerTestCreate(struct timerTestCase *tc, uint64_t delta,
+    timerCycle_t cycle, uint64_t period){
+    dlcTimerConfig_t config = {
+        .period = period,
+        .whenMs = timerTestNow + delta,
+        .timerFunc = timerTestCallback,
+        .args = tc,
+        .cycle = cycle,
+    };
+
+    tc->whenMs = config.whenMs;
+    tc->fired = 0;
+    tc->timer = dlcTimerCreate(&config);
+    return tc->timer;
+}
+
+/**
+ * @brief   run the fake clock from one tick of work to the next, up to {@code until}.
+ */
+static void timerTestRun(uint64_t until){
+    uint64_t next;
+
+    while((next = dlcTimerNearest()) <= until){
+        assert(next >= timerTestNow);
+        timerTestNow = next;
+        timerProcAt(timerTestNow);
+    }
+    timerTestNow = until;
+    timerProcAt(timerTestNow);
+}
+
+/* ./demo test timer, the wheel is driven by a fake clock, timers expiring on each side of
+   the level boundaries must fire at their very tick, after cascading as many levels. */
+int timerTest(int argc, char **argv, int flags){
+    static const uint64_t deltas[] = {
+        0, 1, 63, 64, 65, 127, 4095, 4096, 4097, 262143, 262144, 262145,
+        TIMER_WHEEL_RANGE - 1, TIMER_WHEEL_RANGE, TIMER_WHEEL_RANGE + 4097,
+    };
+    const int num = sizeof(deltas) / sizeof(deltas[0]);
+    struct timerTestCase cases[sizeof(deltas) / sizeof(deltas[0])], tc, self;
+    uint64_t base;
+
+    //! the test owns the wheel, the checker thread isn't running in test mode.
+    assert(!wheel.initialised);
+    memInit();
+    timerWheelInit();
+    //! start off the middle of every level, so that the first cascade is partial.
+    base = TIMER_TEST_BASE + 0x2a5a5 * 7;
+    timerTestNow = wheel.current = base;
+
+    //! cascading, each timer fires once at its expiry.
+    for(int i = 0; i < num; i++){
+        timerTestCreate(&cases[i], deltas[i], TIMER_ONCE, 0);
+    }
+    assert(dlcTimerNearest() == base);
+    timerTestRun(base + TIMER_WHEEL_RANGE + 5000);
+    for(int i = 0; i < num; i++){
+        assert(cases[i].fired == 1);
+        assert(cases[i].firedMs == cases[i].whenMs);
+    }
+    assert(dlcTimerNearest() == UINT64_MAX);
+    printf("cascading of %d timers across %d levels: ok\n", num, TIMER_WHEEL_LEVELS);
+
+    //! a cancelled timer never fires and leaves no occupied slot behind.
+    base = timerTestNow;
+    timerTestCreate(&tc, 5000, TIMER_ONCE, 0);
+    assert(dlcTimerNearest() != UINT64_MAX);
+    dlcTimerDestroy(tc.timer);
+    assert(dlcTimerNearest() == UINT64_MAX);
+    timerTestRun(base + 10000);
+    assert(tc.fired == 0);
+
+    //! reset moves a timer both to a finer and to a coarser level.
+    base = timerTestNow;
+    timerTestCreate(&tc, 300000, TIMER_ONCE, 0);
+    tc.whenMs = base + 50;
+    dlcTimerReset(tc.timer, tc.whenMs, 0);
+    timerTestRun(base + 49);
+    assert(tc.fired == 0);
+    timerTestRun(base + 50);
+    assert(tc.fired == 1 && tc.firedMs == base + 50);
+
+    base = timerTestNow;
+    timerTestCreate(&tc, 10, TIMER_CYCLE, 10);
+    tc.whenMs = base + 70000;
+    dlcTimerReset(tc.timer, tc.whenMs, 100);
+    timerTestRun(base + 69999);
+    assert(tc.fired == 0);
+    timerTestRun(base + 70000);
+    assert(tc.fired == 1 && tc.firedMs == base + 70000);
+    assert(tc.timer->whenMs == base + 70100);
+    dlcTimerDestroy(tc.timer);
+    printf("reset: ok\n");
+
+    //! a cyclic timer destroyed by its own callback fires once and is released.
+    base = timerTestNow;
+    timerTestCreate(&self, 100, TIMER_CYCLE, 10);
+    self.action = TIMER_TEST_DESTROY;
+    timerTestRun(base + 1000);
+    assert(self.fired == 1 && self.timer == NULL);
+    assert(dlcTimerNearest() == UINT64_MAX);
+
+    //! a timer reset by its own callback fires again at the new expiry and period.
+    base = timerTestNow;
+    timerTestCreate(&self, 100, TIMER_CYCLE, 10);
+    self.action = TIMER_TEST_RESET;
+    timerTestRun(base + 100);
+    assert(self.fired == 1 && self.whenMs == base + 1100);
+    timerTestRun(base + 1099);
+    assert(self.fired == 1);
+    timerTestRun(base + 1100);
+    assert(self.fired == 2 && self.firedMs == base + 1100);
+    assert(self.timer->whenMs == base + 1107);
+    dlcTimerDestroy(self.timer);
+    printf("destroy and reset from its own callback: ok\n");
+
+    //! the periods missed by a stalled checker are skipped, not fired in a burst.
+    base = timerTestNow;
+    timerTestCreate(&tc, 10, TIMER_CYCLE, 10);
+    timerTestNow = base + 105;
+    timerProcAt(timerTestNow);
+    assert(tc.fired == 1);
+    assert(tc.timer->whenMs == base + 115);
+    timerTestRun(base + 115);
+    assert(tc.fired == 2 && tc.firedMs == base + 115);
+    assert(tc.timer->whenMs == base + 125);
+    dlcTimerDestroy(tc.timer);
+    assert(dlcTimerNearest() == UINT64_MAX);
+    printf("missed periods skipped: ok\n");
+
+    //! hand the wheel back, it restarts on the real clock.
+    wheel.initialised = false;
+    return 0;
 }
+#endif
@@ -1,12 +1,13 @@
 #ifndef __APPLE__
 #define _GNU_SOURCE
-#include "hashMap.h"
+#include "flatMap.h"
 #include "timer.h"
 #include <pthread.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <sys/prctl.h>
 #endif
+#include <dirent.h>
 #include <dlfcn.h>
 #include <string.h>
 #include <sys/syscall.h>
@@ -14,17 +15,16 @@
 #include "common.h"
 #include "interface.h"
 #include "dlcDef.h"
+#include "heldSet.h"
 #include "internal.h"
 
 
-extern __thread dispatcher_t dispatcher;
-
 int log_ctrl_level = 0; //! indicates log level.
 
 extern bool isEnabledFilter; //! indicates whether to enable filter.
 
 extern void eventLoopEnter();
-extern void strongConnectedComponent();
+extern int strongConnectedComponent();
 
 void dlcSetTaskName(char *name) {
 #ifdef __APPLE__
@@ -47,17 +47,39 @@ size_t dlcGetThreadId(void){
 
 typedef int (*pthread_mutex_lock_t)(pthread_mutex_t *);
 typedef int (*pthread_mutex_unlock_t)(pthread_mutex_t *);
+typedef int (*pthread_mutex_trylock_t)(pthread_mutex_t *);
+typedef int (*pthread_mutex_timedlock_t)(pthread_mutex_t *, const struct timespec *);
+typedef int (*pthread_mutex_init_t)(pthread_mutex_t *, const pthread_mutexattr_t *);
+typedef int (*pthread_mutex_destroy_t)(pthread_mutex_t *);
 pthread_mutex_lock_t pthread_mutex_lock_f;
 pthread_mutex_unlock_t pthread_mutex_unlock_f;
+pthread_mutex_trylock_t pthread_mutex_trylock_f;
+pthread_mutex_timedlock_t pthread_mutex_timedlock_f;
+pthread_mutex_init_t pthread_mutex_init_f;
+pthread_mutex_destroy_t pthread_mutex_destroy_f;
 
-static void init_hook() {
+/**
+ * @note the functions are resolved before main(), by a constructor, so that the hooks
+ *       don't look them up on the first lock. The hooks are unversioned, see
+ *       dlChecker.map, so they take the calls to any version of the functions, and
+ *       RTLD_NEXT resolves the default version, the one a program linked today calls.
+ *       Mutexes locked by the constructors run before, look them up on demand.
+ */
+__attribute__((constructor(101))) static void init_hook() {
     pthread_mutex_lock_f = dlsym(RTLD_NEXT, "pthread_mutex_lock");
     pthread_mutex_unlock_f = dlsym(RTLD_NEXT, "pthread_mutex_unlock");
+    pthread_mutex_trylock_f = dlsym(RTLD_NEXT, "pthread_mutex_trylock");
+    pthread_mutex_timedlock_f = dlsym(RTLD_NEXT, "pthread_mutex_timedlock");
+    pthread_mutex_init_f = dlsym(RTLD_NEXT, "pthread_mutex_init");
+    pthread_mutex_destroy_f = dlsym(RTLD_NEXT, "pthread_mutex_destroy");
 }
 
-void generateWaitEvent(void *arg);
-void generateHoldEvent(void *arg);
-void generateReleaseEvent(void *arg);
+//! the events are generated inline, the hooks make no call but the one to libc.
+static inline void generateWaitEvent(void *arg);
+static inline void generateHoldEvent(void *arg);
+static inline void generateReleaseEvent(void *arg);
+static inline void generateDestroyEvent(void *arg);
+static inline void generateOrderEvent(void *arg);
 
 #if !IS_USER_OVERWRITE_BACKTRACE
 #include <execinfo.h>
@@ -112,24 +134,188 @@ static int backtrace(void **array, int size) {
 }
 #endif
 
+/**
+ * @note the mutexes held by a thread are kept by its hooks, from its first lock on, so
+ *       that a relock, an unlock of a mutex not held, and an unlock out of order are
+ *       found by the thread itself. A relock is reported before the thread blocks, and
+ *       isn't sent to the checker, the cycle it would find is already known. They are
+ *       only reported once the checker is initialised, as the other deadlocks.
+ */
+static __thread heldSet_t heldSet __tlsInitialExec;
+
+extern void reportRelock(threadInfo_t *ti, size_t mid, const heldSet_t *set);
+extern void reportUnheldUnlock(threadInfo_t *ti, size_t mid, const heldSet_t *set);
+extern void reportUnlockOrder(threadInfo_t *ti, size_t mid, const heldSet_t *set);
+
+typedef void (*reportHeld_t)(threadInfo_t *ti, size_t mid, const heldSet_t *set);
+
+//! whether locking a mutex held by the thread blocks it, rather than returns an error.
+static inline bool mutexRelockBlocks(pthread_mutex_t *mutex) {
+#ifdef __GLIBC__
+    int kind = mutex->__data.__kind & 3;
+
+    return kind != PTHREAD_MUTEX_RECURSIVE && kind != PTHREAD_MUTEX_ERRORCHECK;
+#else
+    return true;
+#endif
+}
+
+#ifdef DLC_TEST
+static __thread uint32_t heldSetReports;    //! reports made by the thread.
+#endif
+
+__attribute__((noinline, cold)) static void reportHeldSet(reportHeld_t report,
+    pthread_mutex_t *mutex) {
+    threadInfo_t ti = {.name = {0}};
+
+#ifdef DLC_TEST
+    heldSetReports++;
+#endif
+    if (eventQueueMemPools[0] == NULL) {
+        return;
+    }
+    backtrace(ti.backtrace, DEPTH_BACKTRACE);
+    ti.tid = dlcGetThreadId();
+    #ifdef __APPLE__
+    pthread_getname_np(pthread_self(), ti.name, sizeof(ti.name));
+    #else
+    prctl(PR_GET_NAME, (unsigned long)ti.name);
+    #endif
+    report(&ti, (size_t)mutex, &heldSet);
+}
+
+/**
+ * @brief whether a mutex of the held set is relocked by the thread, which blocks it.
+ * @note  the entry is stale if another thread unlocked the mutex meanwhile, it's dropped
+ *        then and the mutex is locked as any other one. Without the owner of a mutex,
+ *        outside glibc, every entry is taken for stale and a relock is left to the graph,
+ *        which finds the thread waiting for a mutex it holds.
+ */
+__attribute__((noinline, cold)) static bool heldSetRelock(pthread_mutex_t *mutex) {
+    int slot;
+
+    if (!mutexRelockBlocks(mutex)) {
+        return false;
+    }
+#ifdef __GLIBC__
+    if (mutex->__data.__owner == (int)dlcGetThreadId()) {
+        return true;
+    }
+#endif
+    while ((slot = heldSetFind(&heldSet, (size_t)mutex)) >= 0) {
+        heldSetRemove(&heldSet, slot);
+    }
+    return false;
+}
+
+//! the unlock of a mutex which isn't the last one locked, or isn't held.
+__attribute__((noinline, cold)) static void heldSetUnlock(pthread_mutex_t *mutex, int slot) {
+    if (slot >= 0) {
+        if (log_ctrl_level >= LOG_CTRL_LEVEL_INFO) {
+            reportHeldSet(reportUnlockOrder, mutex);
+        }
+        heldSetRemove(&heldSet, slot);
+    } else if (heldSet.overflow != 0) {
+        //! it's taken for a mutex held beyond the set.
+        heldSet.overflow--;
+    } else {
+        reportHeldSet(reportUnheldUnlock, mutex);
+    }
+}
+
 int pthread_mutex_lock(pthread_mutex_t *mutex) {
+    if (__builtin_expect(pthread_mutex_lock_f == NULL, 0)) {
+        init_hook();
+    }
+    if (__builtin_expect(heldSetFind(&heldSet, (size_t)mutex) >= 0, 0) &&
+        heldSetRelock(mutex)) {
+        reportHeldSet(reportRelock, mutex);
+        return pthread_mutex_lock_f(mutex);
+    }
     generateWaitEvent((void *)mutex);
     int ret = pthread_mutex_lock_f(mutex);
+    if (ret == 0) {
+        heldSetPush(&heldSet, (size_t)mutex);
+    }
     generateHoldEvent((void *)mutex);
+    if (isEnabledLockOrder && ret == 0) {
+        generateOrderEvent((void *)mutex);
+    }
     return ret;
 }
 
 int pthread_mutex_unlock(pthread_mutex_t *mutex) {
+    if (__builtin_expect(pthread_mutex_unlock_f == NULL, 0)) {
+        init_hook();
+    }
+    int slot = heldSetFind(&heldSet, (size_t)mutex);
+    if (__builtin_expect(slot >= 0 && slot == (int)heldSet.count - 1, 1)) {
+        heldSet.count--;
+    } else {
+        heldSetUnlock(mutex, slot);
+    }
     int ret = pthread_mutex_unlock_f(mutex);
     generateReleaseEvent((void *)mutex);
     return ret;
 }
 
+/**
+ * @note a mutex taken without waiting for it is only kept in the held set, so that its
+ *       unlock isn't taken for the unlock of a mutex not held.
+ */
+int pthread_mutex_trylock(pthread_mutex_t *mutex) {
+    if (__builtin_expect(pthread_mutex_trylock_f == NULL, 0)) {
+        init_hook();
+    }
+    int ret = pthread_mutex_trylock_f(mutex);
+    if (ret == 0) {
+        heldSetPush(&heldSet, (size_t)mutex);
+    }
+    return ret;
+}
+
+int pthread_mutex_timedlock(pthread_mutex_t *mutex, const struct timespec *abstime) {
+    if (__builtin_expect(pthread_mutex_timedlock_f == NULL, 0)) {
+        init_hook();
+    }
+    int ret = pthread_mutex_timedlock_f(mutex, abstime);
+    if (ret == 0) {
+        heldSetPush(&heldSet, (size_t)mutex);
+    }
+    return ret;
+}
+
+/**
+ * @note mutexes are initialised and destroyed before the checker is, e.g. by static
+ *       constructors, so the functions are looked up on demand, and nothing is tracked
+ *       until the checker is initialised.
+ */
+int pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr) {
+    if (pthread_mutex_init_f == NULL) {
+        init_hook();
+    }
+    //! a new life of the mutex at the address, whatever lived there before.
+    shadowMapNextGeneration(&mutexShadowMap, (size_t)mutex);
+    return pthread_mutex_init_f(mutex, attr);
+}
+
+int pthread_mutex_destroy(pthread_mutex_t *mutex) {
+    if (pthread_mutex_destroy_f == NULL) {
+        init_hook();
+    }
+    int ret = pthread_mutex_destroy_f(mutex);
+    if (ret == 0) {
+        generateDestroyEvent((void *)mutex);
+    }
+    return ret;
+}
+
 void gcTimerProc(void *args);
 void checkTimerProc(void *args);
 
 void *checker(void *arg) {
     long long now;
+    dlcTimer_t *checkTimer, *gcTimer;
 
     dlcSetTaskName("checker");
     usleep(100 * 1000);
@@ -143,20 +329,25 @@ void *checker(void *arg) {
         .args = NULL,
         .cycle = TIMER_CYCLE
     };
-    dlcTimerCreate(&config);
+    checkTimer = dlcTimerCreate(&config);
 
     //! garbage collection procedure.
-    config.period = 100 * PERIOD_OF_DLCHECKER;
+    config.period = FACTOR_OF_GC_PERIOD * PERIOD_OF_DLCHECKER;
     config.whenMs = now + config.period;
     config.timerFunc = gcTimerProc;
-    config.args = NULL;
+    config.args = (void *)gcForThread;
     config.cycle = TIMER_CYCLE;
-    dlcTimerCreate(&config);
+    gcTimer = dlcTimerCreate(&config);
+
+    //! both periods adapt to the load from now on.
+    checkPeriodInit(checkTimer, gcTimer);
 
     while (1) {
         //! process all event.
         eventLoopEnter();
         dlcTimerProc();
+        //! sleep until the nearest timer, but keep draining the event queues.
+        dlcTimerWait(checkPeriodDrainWait());
     }
     return NULL;
 }
@@ -164,35 +355,84 @@ void *checker(void *arg) {
 /**
  * @brief initialise the dlchecker...
  * @param int level[in]  Set log level. [1:error 2:warn 3:info: 4:debug]
+ * @note the graph is kept for dlc-inspect in the directory $DLC_PERSIST_DIR, if it is set,
+ *       and the lock order is checked if $DLC_LOCK_ORDER is 1.
  */
 void initDeadlockChecker(int level) {
-    log_ctrl_level = level;
+    const char *lockOrder = getenv("DLC_LOCK_ORDER");
+    dlcConfig_t config = {
+        .level = level,
+        .persistDir = getenv("DLC_PERSIST_DIR"),
+        .lockOrder = lockOrder != NULL ? atoi(lockOrder) : 0
+    };
+
+    initDeadlockCheckerEx(&config);
+}
+
+/**
+ * @brief initialise the dlchecker with a configuration.
+ * @param config[in] the configuration, a field of 0 takes the default.
+ * @note  only the log level is taken once the checker is initialised.
+ */
+void initDeadlockCheckerEx(const dlcConfig_t *config) {
+    assert(config != NULL);
+    log_ctrl_level = config->level;
+    //! preloaded, the checker was initialised before the program calls it.
+    if (eventQueueMemPools[0] != NULL) {
+        return;
+    }
+    //! the messages of the hooks are queued from now on.
+    dlcLogStart();
     #if !IS_USE_MEM_LIBC_MALLOC
+    memConfigure(config->heapSize, config->hugePages);
     memInit();
     #endif
+    memPoolConfigure(config->poolArenaSize, config->hugePages);
+    if (config->persistDir != NULL) {
+        graphPersist(config->persistDir);
+    }
+    isEnabledLockOrder = config->lockOrder != 0;
     init_hook();
     mapAllInit();
     memPoolAllInit();
+    memPoolAllLimit(config);
+    sscParallelConfigure(config->checkWorkers, config->parallelVertices);
 
     pthread_t tid;
     pthread_create(&tid, NULL, checker, NULL);
 }
 
-void generateWaitEvent(void *arg) {
+#ifdef DLC_PRELOAD
+/**
+ * @brief initialise the dlchecker preloaded into a program, LD_PRELOAD=libdlChecker.so.
+ * @note  the log level is taken from $DLC_LOG_LEVEL, 1 by default.
+ */
+__attribute__((constructor(102))) static void preloadDeadlockChecker(void) {
+    const char *level = getenv("DLC_LOG_LEVEL");
+
+    initDeadlockChecker(level != NULL ? atoi(level) : 1);
+}
+#endif
+
+static inline void generateWaitEvent(void *arg) {
     if (dispatcher.threadCount == -1) {
+        //! the checker isn't initialised yet, e.g. by the constructors of the program.
+        if (eventQueueMemPools[0] == NULL) {
+            return;
+        }
         dispatcherInit(&dispatcher);
     }
 
     pthread_mutex_t *mutex = (pthread_mutex_t *)arg;
     //! filter logic.
     if (isEnabledFilter && isFilter(arg)) {
-        dlc_err("arg %p\n", arg);
         return;
     }
 
     event_t *ev = &dispatcher.ev;
     ev->type = EVENT_WAITLOCK;
     ev->mutexInfo.mid = (size_t)mutex;
+    ev->mutexInfo.generation = shadowMapGeneration(&mutexShadowMap, (size_t)mutex);
 
     //! tracker logic.
     void **bts = ev->threadInfo.backtrace;
@@ -234,18 +474,20 @@ void generateWaitEvent(void *arg) {
     dlc_info("[%s %ld]tid: %ld waits mid: %p\n", ev->threadInfo.name, dispatcher.threadCount,
             ev->threadInfo.tid, (void *)ev->mutexInfo.mid);
 
-    dispatcher.invoke(&dispatcher);
+    dispatcherInvoke(&dispatcher);
 }
 
-void generateHoldEvent(void *arg) {
+static inline void generateHoldEvent(void *arg) {
     pthread_mutex_t *mutex = (pthread_mutex_t *)arg;
     //! filter logic.
     if (isEnabledFilter && isFilter(arg)) {
-        dlc_err("arg %p\n", arg);
         return;
     }
 
-    assert(dispatcher.invoke);
+    //! the thread isn't dispatched, e.g. it waited before the checker was initialised.
+    if (dispatcher.eq == NULL) {
+        return;
+    }
 
     event_t *ev = &dispatcher.ev;
     ev->type = EVENT_HOLDLOCK;
@@ -254,22 +496,25 @@ void generateHoldEvent(void *arg) {
     dlc_info("[%s %ld]tid: %ld holds mid: %p\n", ev->threadInfo.name, dispatcher.threadCount,
             ev->threadInfo.tid, (void *)ev->mutexInfo.mid);
 
-    dispatcher.invoke(&dispatcher);
+    dispatcherInvoke(&dispatcher);
 }
 
-void generateReleaseEvent(void *arg) {
-    assert(dispatcher.invoke);
+static inline void generateReleaseEvent(void *arg) {
+    //! the thread isn't dispatched, it hasn't locked any mutex since the checker was up.
+    if (dispatcher.eq == NULL) {
+        return;
+    }
 
     pthread_mutex_t *mutex = (pthread_mutex_t *)arg;
     //! filter logic.
     if (isEnabledFilter && isFilter(arg)) {
-        dlc_err("arg %p\n", arg);
         return;
     }
 
     event_t *ev = &dispatcher.ev;
     ev->type = EVENT_RELEASELOCK;
     ev->mutexInfo.mid = (size_t)mutex;
+    ev->mutexInfo.generation = shadowMapGeneration(&mutexShadowMap, (size_t)mutex);
 
     void **bts = ev->threadInfo.backtrace;
     __unused int n;
@@ -295,7 +540,100 @@ void generateReleaseEvent(void *arg) {
     dlc_info("[%s %ld]tid: %ld release mid: %p\n", ev->threadInfo.name, dispatcher.threadCount,
         ev->threadInfo.tid, (void *)ev->mutexInfo.mid);
 
-    dispatcher.invoke(&dispatcher);
+    dispatcherInvoke(&dispatcher);
+}
+
+static inline void generateDestroyEvent(void *arg) {
+    pthread_mutex_t *mutex = (pthread_mutex_t *)arg;
+    //! the checker isn't initialised yet.
+    if (eventQueueMemPools[0] == NULL) {
+        return;
+    }
+    //! filter logic.
+    if (isEnabledFilter && isFilter(arg)) {
+        return;
+    }
+
+    if (dispatcher.threadCount == -1) {
+        dispatcherInit(&dispatcher);
+    }
+
+    event_t *ev = &dispatcher.ev;
+    ev->type = EVENT_DESTROYLOCK;
+    ev->mutexInfo.mid = (size_t)mutex;
+    //! the events of the mutex from now on belong to its next life.
+    ev->mutexInfo.generation = shadowMapNextGeneration(&mutexShadowMap, (size_t)mutex);
+
+    dlc_info("[%s %ld]tid: %ld destroys mid: %p\n", ev->threadInfo.name, dispatcher.threadCount,
+        ev->threadInfo.tid, (void *)ev->mutexInfo.mid);
+
+    dispatcherInvoke(&dispatcher);
+}
+
+/**
+ * @note an arc is sent from every mutex held to the mutex locked, so that the order of two
+ *       mutexes outlives the mutexes locked between them. A thread caches the arcs it sent
+ *       in a small table indexed by a hash of the pair, an arc pushed out of it is sent
+ *       again and dropped by the checker, so a workload locking the same mutexes over and
+ *       over stops sending them once it settles. The lives of both mutexes are cached
+ *       along, the arcs of a mutex created again at an address are new.
+ */
+#define ORDER_CACHE_BITS        (6)
+
+struct orderCacheEntry{
+    size_t held;
+    size_t mid;
+    uint32_t heldGeneration;
+    uint32_t generation;
+};
+static __thread struct orderCacheEntry orderCache[1 << ORDER_CACHE_BITS] __tlsInitialExec;
+
+static inline void generateOrderEvent(void *arg) {
+    size_t held, mid = (size_t)arg;
+    uint32_t heldGeneration, generation;
+    struct orderCacheEntry *entry;
+
+    if (heldSet.count < 2 || heldSet.mid[heldSet.count - 1] != mid || dispatcher.eq == NULL) {
+        return;
+    }
+    //! filter logic.
+    if (isEnabledFilter && isFilter(arg)) {
+        return;
+    }
+
+    //! the thread, its backtrace and the life of the mutex are those of the wait for it.
+    event_t *ev = &dispatcher.ev;
+    assert(mid == ev->mutexInfo.mid);
+    generation = ev->mutexInfo.generation;
+    for (uint32_t i = 0; i < heldSet.count - 1; i++) {
+        held = heldSet.mid[i];
+        if (held == mid) {
+            continue;
+        }
+        heldGeneration = shadowMapGeneration(&mutexShadowMap, held);
+        entry = &orderCache[((held ^ (mid << 1)) * 0x9e3779b97f4a7c15ULL)
+            >> (64 - ORDER_CACHE_BITS)];
+        if (entry->held == held && entry->mid == mid && entry->heldGeneration == heldGeneration
+            && entry->generation == generation) {
+            continue;
+        }
+        if (isEnabledFilter && isFilter((void *)held)) {
+            continue;
+        }
+        entry->held = held;
+        entry->mid = mid;
+        entry->heldGeneration = heldGeneration;
+        entry->generation = generation;
+
+        ev->type = EVENT_LOCKORDER;
+        ev->heldInfo.mid = held;
+        ev->heldInfo.generation = heldGeneration;
+
+        dlc_info("[%s %ld]tid: %ld locks mid: %p after mid: %p\n", ev->threadInfo.name,
+            dispatcher.threadCount, ev->threadInfo.tid, (void *)mid, (void *)held);
+
+        dispatcherInvoke(&dispatcher);
+    }
 }
 
 /**
@@ -303,43 +641,56 @@ void generateReleaseEvent(void *arg) {
  
  * @param  pid is process id of the process.
  * @param  cb is callback to be executed.
+ * @note   a thread is destroyed if it owns a event queue but is no longer listed
+ *         in /proc/$pid/task. Every scan stamps the resident threads with a new
+ *         generation, so that threads of earlier scans do not look resident.
  */
 void gcDestroyedThreads(const pid_t pid, gcCallback_t cb){
-    FILE *file;
+    static long generation = 0;
+    DIR *dir;
+    struct dirent *dirent;
     long tid;
-    hashMap_t *oldThreadMap;
-    hashMapIterator_t iter;
-    entry_t *entry;
+    flatMapIterator_t iter;
+    flatMapEntry_t *entry;
+    size_t *destroyed;
+    int count = 0, capacity;
     char path[40];
     assert(residentThreadMap != NULL);
     assert(cb != NULL);
 
-    if(hashMapSize(residentThreadMap) == 0){
-        oldThreadMap = vertexThreadMap;
-    }else {
-        oldThreadMap = residentThreadMap;
-    }
+    generation++;
+    sprintf(path, "/proc/%d/task", (int)pid);
 
-    sprintf(path, "ls /proc/%d/task -l", (int)pid);
-
-    file = popen(path, "r");
-    if(NULL != file){
-        fscanf(file, "%*[^\n]%*c");
-        while(EOF != fscanf(file, "%*[^:]%*c%*d%ld\n", &tid)){
-            dlc_dbg("tid :%ld\n", tid);
-            hashMapPut(residentThreadMap, (void *)tid, NULL);
+    dir = opendir(path);
+    if(NULL == dir){
+        return;
+    }
+    while((dirent = readdir(dir)) != NULL){
+        tid = strtol(dirent->d_name, NULL, 10);
+        if(tid <= 0) continue;
+        dlc_dbg("tid :%ld\n", tid);
+        flatMapPut(residentThreadMap, tid, (void *)generation);
+    }
+    closedir(dir);
+
+    //! obtain all threads that have been destroyed, the callback may
+    //! modify the maps, so collect them before collecting garbage.
+    spinlockAcquire(&eventQueueMapLock);
+    capacity = flatMapSize(eventQueueMap);
+    destroyed = capacity > 0 ? zmalloc(capacity * sizeof(size_t)) : NULL;
+    flatMapIteratorInit(&iter, eventQueueMap);
+    while((entry = flatMapNext(&iter)) != NULL && count < capacity){  
+        if((long)flatMapGet(residentThreadMap, entry->key) != generation){
+            destroyed[count++] = entry->key;
         }
     }
-    pclose(file);
+    spinlockRelease(&eventQueueMapLock);
 
-    //! obtain all threads that have been destroyed.
-    hashMapIteratorInit(&iter, oldThreadMap);
-    while((entry = hashMapNext(&iter)) != NULL){  
-        if(hashMapFind(residentThreadMap, entry->key) == NULL){
-            //! gc.
-            cb(entry->key);
-        }
+    for(int i = 0; i < count; ++i){
+        //! gc.
+        cb((void *)destroyed[i]);
     }
+    zfree(destroyed);
 }
 
 void gcTimerProc(void *args){
@@ -350,6 +701,47 @@ void gcTimerProc(void *args){
 }
 
 void checkTimerProc(void *args){
+    int deadlocks;
     (void)args; 
-    strongConnectedComponent(); 
-}
\ No newline at end of file
+    deadlocks = strongConnectedComponent(); 
+    checkPeriodAdjust(deadlocks);
+}
+// #define DLC_TEST
+#ifdef DLC_TEST
+#include "testhelp.h"
+
+static void *relockTestUnlock(void *arg){
+    //! the mutex isn't held by this thread, the unlock is reported as such.
+    pthread_mutex_unlock((pthread_mutex_t *)arg);
+    assert(heldSetReports == 1);
+    return NULL;
+}
+
+/* ./demo test relock, a thread locks a mutex, another thread unlocks it, and the first
+   thread locks it again, which is no relock, the entry of its held set is stale. */
+int relockTest(int argc, char **argv, int flags){
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_t tid;
+
+    heldSetReports = 0;
+    assert(pthread_mutex_lock(&mutex) == 0);
+    assert(heldSetFind(&heldSet, (size_t)&mutex) == (int)heldSet.count - 1);
+#ifdef __GLIBC__
+    assert(mutexRelockBlocks(&mutex) && mutex.__data.__owner == (int)dlcGetThreadId());
+#endif
+
+    assert(pthread_create(&tid, NULL, relockTestUnlock, &mutex) == 0);
+    pthread_join(tid, NULL);
+    //! the entry is still there until the thread locks the mutex again.
+    assert(heldSetFind(&heldSet, (size_t)&mutex) >= 0);
+
+    assert(pthread_mutex_lock(&mutex) == 0);
+    assert(heldSetReports == 0);
+    assert(heldSet.count == 1 && heldSet.mid[0] == (size_t)&mutex);
+
+    assert(pthread_mutex_unlock(&mutex) == 0);
+    assert(heldSetReports == 0 && heldSet.count == 0);
+    printf("a stale entry of the held set isn't taken for a relock: ok\n");
+    return 0;
+}
+#endif
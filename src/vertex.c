@@ -8,233 +8,792 @@
  */
 
 /* Includes --------------------------------------------------------------------------------*/
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "mempool.h"
 #include "vertex.h"
 #include "internal.h"
 
+/**
+ * @note The graph keeps a vertex set for each type of vertex. A vertex is a slot of
+ *       the arrays of its set, each field has an array of its own:
+ *
+ *       epoch     | - | t1 | t2 | t3 | ...      the pass dfn, low and inStack belong to
+ *       dfn       | - | t1 | t2 | t3 | ...
+ *       low       | - | t1 | t2 | t3 | ...
+ *       waitingOn | - | t1 | t2 | t3 | ...      threads only
+ *       owner     | - | m1 | m2 | m3 | ...      mutexes only
+ *       adj       | - | m1 | m2 | m3 | ...      mutexes only, arcs inline, or on the heap
+ *       clock     | - | m1 | m2 | m3 | ...      mutexes only, the state for eviction
+ *       order     | - | m1 | m2 | m3 | ...      mutexes only, arcs of the lock order
+ *       orderIn   | - | m1 | m2 | m3 | ...      mutexes only, the same arcs reversed
+ *       info      | - | t1 | t2 | t3 | ...      threadInfo_t or mutexInfo_t
+ *
+ *       The arrays are mapped, and remapped to twice the size when the slots run out,
+ *       so a slot keeps its id while the arrays move.
+ */
+graph_t graph;
 
-/*--------------------internal methods --------------------*/
-static vertexType_t getType(struct vertex* ver){
-    assert(ver);
-    return ver->type;
-}
+struct vertexArray{
+    void **array;
+    size_t elemSize;
+};
 
-static int getIndegree(struct vertex* ver){
-    assert(ver);
-    return ver->indegree;
+#define SIZE_OF_VERTEX_ARRAY(count, elemSize) \
+    MEM_ALIGN_UP((size_t)(count) * (elemSize), (size_t)getpagesize())
+
+//! the size of an element of a field of a type, 0 for the other type.
+#define VERTEX_FIELD_SIZE(set, t, size)  ((set)->type == (t) ? (size) : 0)
+
+#define VERTEX_SET_ARRAYS(set) { \
+    {(void **)&(set)->epoch, sizeof(uint32_t)}, \
+    {(void **)&(set)->dfn, sizeof(uint32_t)}, \
+    {(void **)&(set)->low, sizeof(uint32_t)}, \
+    {(void **)&(set)->inStack, sizeof(bool)}, \
+    {(void **)&(set)->indegree, sizeof(uint32_t)}, \
+    {(void **)&(set)->waitingOn, VERTEX_FIELD_SIZE(set, VERTEX_THREAD, sizeof(vid_t))}, \
+    {(void **)&(set)->held, VERTEX_FIELD_SIZE(set, VERTEX_THREAD, sizeof(vid_t))}, \
+    {(void **)&(set)->owner, VERTEX_FIELD_SIZE(set, VERTEX_MUTEX, sizeof(vid_t))}, \
+    {(void **)&(set)->heldNext, VERTEX_FIELD_SIZE(set, VERTEX_MUTEX, sizeof(vid_t))}, \
+    {(void **)&(set)->heldPrev, VERTEX_FIELD_SIZE(set, VERTEX_MUTEX, sizeof(vid_t))}, \
+    {(void **)&(set)->adj, VERTEX_FIELD_SIZE(set, VERTEX_MUTEX, sizeof(adjacency_t))}, \
+    {(void **)&(set)->clock, VERTEX_FIELD_SIZE(set, VERTEX_MUTEX, sizeof(uint8_t))}, \
+    {(void **)&(set)->order, VERTEX_FIELD_SIZE(set, VERTEX_MUTEX, sizeof(adjacency_t))}, \
+    {(void **)&(set)->orderIn, VERTEX_FIELD_SIZE(set, VERTEX_MUTEX, sizeof(adjacency_t))}, \
+    {(void **)&(set)->info, (set)->infoSize}, \
 }
 
-static int getOutdegree(struct vertex* ver){
-    assert(ver);
-    return ver->outdegree;
+//! memory of a vertex in the arrays of its set.
+static size_t vertexSlotSize(vertexSet_t *set){
+    struct vertexArray arrays[] = VERTEX_SET_ARRAYS(set);
+    size_t size = 0;
+
+    for(int i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++){
+        size += arrays[i].elemSize;
+    }
+    return size;
 }
 
-static void addEdge(vertex_t *u, vertex_t *v){
-    assert(u && v);
-    
-    arc_t *head = u->arcList;
-    while(head){
-        assert(head->tail != v);
-        head = head->next;
+/**
+ * @note The arrays may be mapped from a file instead, see graphPersist(), so that the
+ *       graph of a process killed while hanging is analysed by dlc-inspect:
+ *
+ *       | header | array | array | ... | array grown | ...
+ *
+ *       The header records the offset of each array from the start of the file, and a
+ *       copy of the vertex sets taken by graphSync(). An array grows into a new region
+ *       at the end of the file, and the old region is punched out of the file.
+ */
+#define GRAPH_FILE_MAGIC        (0x48504152474344ULL)   //! "DCGRAPH"
+#define GRAPH_FILE_VERSION      (4)
+#define VERTEX_ARRAYS           (15)
+
+struct graphFileHeader{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t graphSize;     //! sizeof(graph_t) of the writer.
+    int32_t pid;
+    uint32_t syncs;         //! count of graphSync().
+    uint64_t syncTimeMs;
+    uint64_t offsets[VERTEX_BUTT][VERTEX_ARRAYS];
+    graph_t graph;          //! the graph at the last graphSync(), its pointers are stale.
+};
+
+static struct{
+    int fd;
+    size_t end;             //! size of the file.
+    struct graphFileHeader *header;
+    char path[256];
+}graphFile = {.fd = -1};
+
+#define SIZE_OF_GRAPH_FILE_HEADER \
+    MEM_ALIGN_UP(sizeof(struct graphFileHeader), (size_t)getpagesize())
+
+//! grow an array into a new region of the file.
+static void *vertexArrayResizeFile(vertexSet_t *set, int i, void *array, size_t oldSize, size_t newSize){
+    void *res;
+
+    if(ftruncate(graphFile.fd, graphFile.end + newSize) != 0) return NULL;
+    res = mmap(NULL, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, graphFile.fd, graphFile.end);
+    if(res == MAP_FAILED){
+        if(ftruncate(graphFile.fd, graphFile.end) != 0) return NULL;
+        return NULL;
     }
 
-    arc_t *newArc = arcCreate(v, NULL);
-    newArc->next = u->arcList;
-    u->arcList = newArc;
+    if(array != NULL){
+        memcpy(res, array, oldSize);
+        munmap(array, oldSize);
+        fallocate(graphFile.fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+            graphFile.header->offsets[set->type][i], oldSize);
+    }
+    graphFile.header->offsets[set->type][i] = graphFile.end;
+    graphFile.end += newSize;
+    return res;
+}
+
+static void *vertexArrayResize(vertexSet_t *set, int i, void *array, size_t oldSize, size_t newSize){
+    void *res;
 
-    u->outdegree++;
-    v->indegree++;
+    if(oldSize == newSize) return array;
+    //! shrinking is done in place, a shrunk array keeps its region of the file.
+    if(graphFile.header != NULL && newSize > oldSize){
+        return vertexArrayResizeFile(set, i, array, oldSize, newSize);
+    }
+    if(array == NULL){
+        res = mmap(NULL, newSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }else{
+        res = mremap(array, oldSize, newSize, MREMAP_MAYMOVE);
+    }
+    return res == MAP_FAILED ? NULL : res;
 }
 
-static void deleteEdge(vertex_t *u, vertex_t *v){
-    arc_t *head, dummy = {0};
-    assert(u && v);
+/**
+ * @brief   grow all arrays of a vertex set.
+ * @param   set is the vertex set.
+ * @param   capacity is the new count of slots.
+ * @return  DLC_OK, or DLC_ERR if the limit of memory is reached or mremap fails,
+ *          the set is left as it was then.
+ */
+static err_t vertexSetGrow(vertexSet_t *set, uint32_t capacity){
+    struct vertexArray arrays[] = VERTEX_SET_ARRAYS(set);
+    size_t oldSize, newSize, size = 0;
+    void *array;
+    int i, num = sizeof(arrays) / sizeof(arrays[0]);
+
+    assert(num == VERTEX_ARRAYS);
+    if(capacity > VID_INDEX_MASK) return DLC_ERR;
+
+    for(i = 0; i < num; i++){
+        size += SIZE_OF_VERTEX_ARRAY(capacity, arrays[i].elemSize)
+            - SIZE_OF_VERTEX_ARRAY(set->capacity, arrays[i].elemSize);
+    }
+    if(memPoolCharge(size) != DLC_OK){
+        return DLC_ERR;
+    }
 
-    //! A thread can request only one lock at any time, 
-    //！and a lock can only be occupied by one thread at any time.
-    //! so, from a vertex, there is only one edge pointing to a fixed 
-    //! vertex at any time. 
-    
-    dummy.next = u->arcList;
-    head = &dummy;
+    for(i = 0; i < num; i++){
+        if(arrays[i].elemSize == 0) continue;
+        oldSize = SIZE_OF_VERTEX_ARRAY(set->capacity, arrays[i].elemSize);
+        newSize = SIZE_OF_VERTEX_ARRAY(capacity, arrays[i].elemSize);
+        array = vertexArrayResize(set, i, *arrays[i].array, oldSize, newSize);
+        if(array == NULL) break;
+        *arrays[i].array = array;
+    }
 
-    //! find the arc whose tail is v.
-    while(head->next){
-        if(head->next->tail == v){
-            break;
+    if(i < num){
+        //! shrinking in place never fails, undo the arrays grown.
+        while(--i >= 0){
+            if(arrays[i].elemSize == 0) continue;
+            oldSize = SIZE_OF_VERTEX_ARRAY(set->capacity, arrays[i].elemSize);
+            newSize = SIZE_OF_VERTEX_ARRAY(capacity, arrays[i].elemSize);
+            if(oldSize == 0){
+                munmap(*arrays[i].array, newSize);
+                *arrays[i].array = NULL;
+            }else{
+                *arrays[i].array = vertexArrayResize(set, i, *arrays[i].array, newSize, oldSize);
+            }
         }
-        head = head->next;
+        memPoolRefund(size);
+        return DLC_ERR;
     }
 
-    assert(head->next != NULL);
+    set->capacity = capacity;
+    set->size += size;
+    return DLC_OK;
+}
 
-    //! remove the edge. 
-    arc_t *target = head->next;
-    head->next = head->next->next;
-    target->next = NULL;
-    target->tail = NULL;
-    arcDestroy(target);
-    target = NULL;
+static void graphUnpersist(void){
+    if(graphFile.header == NULL) return;
+    unlink(graphFile.path);
+}
 
-    u->arcList = dummy.next;
+/**
+ * @brief   map the arrays of the graph from a file, so that the graph of the process is
+ *          kept when it's killed, for dlc-inspect.
+ * @param   dir is the directory of the file, e.g. /dev/shm. The file is named
+ *          dlc-<pid>.graph, and is removed when the process exits normally.
+ * @return  DLC_OK, or DLC_ERR if the file can't be created, the arrays are anonymous then.
+ * @note    it must be called before graphInit().
+ */
+err_t graphPersist(const char *dir){
+    struct graphFileHeader *header;
+    size_t size = SIZE_OF_GRAPH_FILE_HEADER;
+    int fd;
+
+    assert(dir != NULL);
+    assert(graph.set[VERTEX_THREAD].capacity == 0 && graphFile.header == NULL);
+
+    snprintf(graphFile.path, sizeof(graphFile.path), "%s/dlc-%d.graph", dir, (int)getpid());
+    fd = open(graphFile.path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if(fd < 0){
+        dlc_warn("the graph can't be kept in %s\n", graphFile.path);
+        return DLC_ERR;
+    }
+
+    header = MAP_FAILED;
+    if(ftruncate(fd, size) == 0){
+        header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if(header == MAP_FAILED){
+        close(fd);
+        unlink(graphFile.path);
+        dlc_warn("the graph can't be kept in %s\n", graphFile.path);
+        return DLC_ERR;
+    }
 
-    //! update the outdegree and indegree. 
-    u->outdegree--;
-    v->indegree--;
+    header->magic = GRAPH_FILE_MAGIC;
+    header->version = GRAPH_FILE_VERSION;
+    header->graphSize = sizeof(graph_t);
+    header->pid = (int32_t)getpid();
+    graphFile.fd = fd;
+    graphFile.end = size;
+    graphFile.header = header;
+    atexit(graphUnpersist);
+    return DLC_OK;
 }
 
-vertexOperation_t ops = {
-    .getType = getType,
-    .getIndegree = getIndegree,
-    .getOutdegree = getOutdegree,
-    .addEdge = addEdge,
-    .deleteEdge = deleteEdge
+/**
+ * @brief   copy the vertex sets to the file of the graph, if any.
+ * @note    it's called by the checker once the event queues are drained, the arrays
+ *          themselves are always up to date in the file.
+ */
+void graphSync(void){
+    struct graphFileHeader *header = graphFile.header;
 
-};
+    if(header == NULL) return;
+    memcpy(&header->graph, &graph, sizeof(graph_t));
+    header->syncTimeMs = (uint64_t)timeInMilliseconds();
+    header->syncs++;
+}
 
-static vertex_t *threadVertexConstructor(vertexOperation_t *ops){
-    vertex_t *tv;
-    assert(ops != NULL);
-    assert(threadVertexMemPool != NULL);
+/**
+ * @brief   load the graph kept in a file by another process, see graphPersist().
+ * @param   path is the file.
+ * @return  DLC_OK, or DLC_ERR if the file isn't a graph of this version.
+ * @note    the file is mapped privately, the traversal state written by a search
+ *          doesn't go back to it. The generic and order arcs which were on the heap
+ *          of the process are lost, they are dropped. A thread vertex waiting for a mutex
+ *          is in use, the free slots are cleared.
+ */
+err_t graphLoad(const char *path){
+    struct graphFileHeader *header;
+    struct stat st;
+    uint8_t *base;
+    uint64_t offset;
+    uint32_t lost = 0;
+    int fd;
+
+    assert(path != NULL);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) return DLC_ERR;
+
+    base = MAP_FAILED;
+    if(fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(struct graphFileHeader)){
+        base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if(base == MAP_FAILED) return DLC_ERR;
+
+    header = (struct graphFileHeader *)base;
+    if(header->magic != GRAPH_FILE_MAGIC || header->version != GRAPH_FILE_VERSION
+        || header->graphSize != sizeof(graph_t)){
+        munmap(base, st.st_size);
+        return DLC_ERR;
+    }
 
-    tv = (vertex_t *)memPoolAlloc(threadVertexMemPool);
-    if(tv == NULL){
-        memPoolInfo(threadVertexMemPool);
+    memcpy(&graph, &header->graph, sizeof(graph_t));
+    for(int type = VERTEX_THREAD; type < VERTEX_BUTT; type++){
+        vertexSet_t *set = &graph.set[type];
+        struct vertexArray arrays[] = VERTEX_SET_ARRAYS(set);
+
+        for(int i = 0; i < VERTEX_ARRAYS; i++){
+            offset = header->offsets[type][i];
+            if(arrays[i].elemSize == 0) continue;
+            if(offset == 0 || offset + SIZE_OF_VERTEX_ARRAY(set->capacity, arrays[i].elemSize)
+                > (uint64_t)st.st_size){
+                munmap(base, st.st_size);
+                return DLC_ERR;
+            }
+            *arrays[i].array = base + offset;
+        }
     }
-    memset(tv, 0, sizeof(vertex_t) + sizeof(struct threadInfo));
 
-    tv->type = VERTEX_THREAD;
-    tv->ops = ops;
+    //! the free slots have no arc, so that only the vertices in use are searched.
+    for(int type = VERTEX_THREAD; type < VERTEX_BUTT; type++){
+        vertexSet_t *set = &graph.set[type];
+        uint32_t index = set->freeList;
+
+        for(uint32_t steps = 0; index != 0 && index < set->top && steps < set->top; steps++){
+            if(type == VERTEX_THREAD){
+                set->waitingOn[index] = VID_NONE;
+            }else{
+                set->owner[index] = VID_NONE;
+                set->adj[index].count = set->adj[index].capacity = 0;
+                set->order[index].count = set->order[index].capacity = 0;
+                set->orderIn[index].count = set->orderIn[index].capacity = 0;
+            }
+            index = set->dfn[index];
+        }
+    }
+
+    for(uint32_t index = 1; index < graph.set[VERTEX_MUTEX].top; index++){
+        adjacency_t *adj = &graph.set[VERTEX_MUTEX].adj[index];
+        if(adj->capacity != 0){
+            lost += adj->count;
+            adj->count = adj->capacity = 0;
+        }
+        adj = &graph.set[VERTEX_MUTEX].order[index];
+        if(adj->capacity != 0){
+            lost += adj->count;
+            adj->count = adj->capacity = 0;
+        }
+        adj = &graph.set[VERTEX_MUTEX].orderIn[index];
+        if(adj->capacity != 0){
+            adj->count = adj->capacity = 0;
+        }
+    }
+    if(lost != 0){
+        dlc_warn("%u generic and order arcs on the heap of process %d are lost\n", lost, header->pid);
+    }
+    return DLC_OK;
+}
+
+/**
+ * @brief   map the arrays of both vertex sets.
+ * @param   threads is the count of thread vertices the arrays start with.
+ * @param   mutexes is the count of mutex vertices the arrays start with.
+ * @note    this function must be called in the initial phase of program.
+ */
+err_t graphInit(uint32_t threads, uint32_t mutexes){
+    static const char *names[VERTEX_BUTT] = {"tv", "mv"};
+    static const size_t infoSizes[VERTEX_BUTT] = {sizeof(threadInfo_t), sizeof(mutexInfo_t)};
+    uint32_t counts[VERTEX_BUTT] = {threads, mutexes};
+    vertexSet_t *set;
+
+    for(int type = VERTEX_THREAD; type < VERTEX_BUTT; type++){
+        set = &graph.set[type];
+        if(set->capacity != 0) continue;
+
+        strncpy(set->name, names[type], DLC_NAME_SIZE - 1);
+        set->type = type;
+        set->infoSize = infoSizes[type];
+        set->limit = counts[type];
+        set->top = 1;   //! slot 0 stands for no vertex.
+        if(vertexSetGrow(set, counts[type] + 1) != DLC_OK){
+            return DLC_ERR;
+        }
+    }
+    return DLC_OK;
+}
+
+/**
+ * @brief   set the soft limit of a vertex set.
+ * @param   count is the count of vertices beyond which a warning is issued.
+ */
+void graphSetLimit(vertexType_t type, uint32_t count){
+    assert(type < VERTEX_BUTT);
+    graph.set[type].limit = count;
+}
+
+/**
+ * @brief   set the hard limit of the memory of a vertex set.
+ * @param   size is the memory of the vertices, 0 for no limit. The vertices never
+ *          exceed it, vertexCreate() fails beyond it.
+ * @note    the limit is rounded to a count of vertices, a vertex takes vertexSlotSize().
+ */
+void graphSetMemoryLimit(vertexType_t type, size_t size){
+    vertexSet_t *set;
+
+    assert(type < VERTEX_BUTT);
+    set = &graph.set[type];
+    set->cap = size == 0 ? 0 : DLC_MIN(DLC_MAX(size / vertexSlotSize(set), 1), VID_INDEX_MASK - 1);
+}
+
+void graphPrint(vertexType_t type){
+    vertexSet_t *set;
+    size_t slotSize;
+
+    assert(type < VERTEX_BUTT);
+    set = &graph.set[type];
+    slotSize = vertexSlotSize(set);
+    memPoolPrintStats(set->name, set->err, 1, set->size,
+        (set->capacity - 1 - set->live) * slotSize, set->live * slotSize, set->max * slotSize);
+    if(set->cap != 0 || set->evicted != 0){
+        printf("resident %u of cap %u vertices, evicted %lu\n", set->live, set->cap, set->evicted);
+    }
+}
 
-    return tv;
+/**
+ * @brief   start a new pass of traversal.
+ * @return  the epoch of the pass.
+ * @note    the traversal state of all vertices turns stale at once, and only the 
+ *          vertices visited by the pass are written. The stamps are cleared once
+ *          the epoch wraps around.
+ */
+uint32_t graphNextEpoch(void){
+    vertexSet_t *set;
+
+    if(++graph.epoch == 0){
+        for(int type = VERTEX_THREAD; type < VERTEX_BUTT; type++){
+            set = &graph.set[type];
+            memset(set->epoch, 0, set->top * sizeof(uint32_t));
+        }
+        graph.epoch = 1;
+    }
+    return graph.epoch;
 }
 
-static vertex_t *mutexVertexConstructor(vertexOperation_t *ops){
-    vertex_t *mv;
-    assert(ops != NULL);
-    assert(mutexVertexMemPool != NULL);
+/**
+ * @brief   Create a vertex based on the vertex type.
+
+ * @param   type is the type of vertex.
+ * @return  the vertex, VID_NONE if the arrays can't grow any more.
+ */
+vid_t vertexCreate(vertexType_t type){
+    vertexSet_t *set;
+    uint32_t index, capacity;
+
+    assert(type < VERTEX_BUTT);
+    set = &graph.set[type];
 
-    mv = (vertex_t *)memPoolAlloc(mutexVertexMemPool);
-    if(mv == NULL){
-        memPoolInfo(mutexVertexMemPool);
+    //! the cap is reached, it isn't an error, the caller may evict a vertex.
+    if(set->cap != 0 && set->live >= set->cap){
+        return VID_NONE;
     }
-    memset(mv, 0, sizeof(vertex_t) + sizeof(struct mutexInfo));
 
-    mv->type = VERTEX_MUTEX;
-    // mv->arcList = NULL;
-    mv->ops = ops;
+    if(set->freeList != 0){
+        index = set->freeList;
+        set->freeList = set->dfn[index];
+    }else{
+        //! below the cap, the arrays never grow beyond it.
+        capacity = set->cap != 0 ? DLC_MIN(set->capacity * 2, set->cap + 1) : set->capacity * 2;
+        if(set->top == set->capacity && vertexSetGrow(set, capacity) != DLC_OK){
+            if(set->err++ == 0) graphPrint(type);
+            return VID_NONE;
+        }
+        index = set->top++;
+    }
+
+    set->epoch[index] = 0;
+    set->dfn[index] = 0;
+    set->low[index] = 0;
+    set->inStack[index] = false;
+    set->indegree[index] = 0;
+    if(type == VERTEX_THREAD){
+        set->waitingOn[index] = VID_NONE;
+        set->held[index] = VID_NONE;
+    }else{
+        set->owner[index] = VID_NONE;
+        set->heldNext[index] = VID_NONE;
+        set->heldPrev[index] = VID_NONE;
+        memset(&set->adj[index], 0, sizeof(adjacency_t));
+        set->clock[index] = CLOCK_REFERENCED;
+        memset(&set->order[index], 0, sizeof(adjacency_t));
+        memset(&set->orderIn[index], 0, sizeof(adjacency_t));
+    }
+    memset(set->info + index * set->infoSize, 0, set->infoSize);
 
-    return mv;
+    if(++set->live > set->max){
+        //! warn once, when the high-water mark crosses the soft limit.
+        if(set->max == set->limit){
+            dlc_warn("vertex set [%s] exceeds its soft limit of %u vertices\n",
+                set->name, set->limit);
+        }
+        set->max = set->live;
+    }
+    return vidMake(type, index);
 }
 
-static void threadVertexDestructor(vertex_t *tv){
-    assert(tv != NULL);
-    assert(threadVertexMemPool != NULL);
+/**
+ * @brief   Destroy a vertex.
 
-    memPoolFree(threadVertexMemPool, tv);
+ * @param   vertex is the vertex, which must have no arc.
+ * @note    The method is rarely called because a vertex is rarely destroyed.
+ */
+void vertexDestroy(vid_t vertex){
+    vertexSet_t *set = &graph.set[vidType(vertex)];
+    uint32_t index = vidIndex(vertex);
+
+    assert(index != 0 && index < set->top);
+    assert(vertexOutdegree(vertex) == 0 && set->indegree[index] == 0);
+
+    if(set->type == VERTEX_THREAD){
+        assert(set->held[index] == VID_NONE);
+    }else{
+        assert(set->order[index].count == 0 && set->orderIn[index].count == 0);
+        if(set->adj[index].capacity != 0){
+            zfree(set->adj[index].heap);
+            set->adj[index].capacity = 0;
+        }
+        if(set->order[index].capacity != 0){
+            zfree(set->order[index].heap);
+            set->order[index].capacity = 0;
+        }
+        if(set->orderIn[index].capacity != 0){
+            zfree(set->orderIn[index].heap);
+            set->orderIn[index].capacity = 0;
+        }
+        set->clock[index] = CLOCK_FREE;
+    }
+
+    //! link the slot to the free list.
+    set->dfn[index] = set->freeList;
+    set->freeList = index;
+    set->live--;
 }
 
-static void mutexVertexDestructor(vertex_t *mv){
-    assert(mv != NULL);
-    assert(mutexVertexMemPool != NULL);
+void vertexSetInfo(vid_t vertex, void *info){
+    vertexSet_t *set = &graph.set[vidType(vertex)];
 
-    memPoolFree(mutexVertexMemPool, mv);
+    assert(info != NULL);
+    memcpy(set->info + vidIndex(vertex) * set->infoSize, info, set->infoSize);
 }
 
-static void threadVertexSetInfoImpl(vertex_t *tv, void *info){
-    threadInfo_t *res;
-    assert(tv != NULL && info != NULL);
+/**
+ * @brief   sweep the clock hand for a vertex to evict.
+ * @param   type is the type of vertex, only mutexes are on the clock.
+ * @return  the first cold vertex without any arc past the hand, VID_NONE if every
+ *          vertex takes part in the graph. The caller evicts it, its order arcs along.
+ * @note    the hand turns referenced vertices cold as it passes them, two rounds at
+ *          most, so a vertex touched since the last sweep survives this one.
+ */
+vid_t vertexClockVictim(vertexType_t type){
+    vertexSet_t *set = &graph.set[type];
+    uint32_t index, steps = 2 * set->top;
+    vid_t vertex;
+
+    assert(type == VERTEX_MUTEX);
+    while(steps-- > 0){
+        index = set->hand;
+        set->hand = index + 1 < set->top ? index + 1 : 1;
+        if(index == 0 || set->clock[index] == CLOCK_FREE) continue;
+
+        vertex = vidMake(type, index);
+        if(vertexOutdegree(vertex) != 0 || set->indegree[index] != 0) continue;
+
+        if(set->clock[index] == CLOCK_REFERENCED){
+            set->clock[index] = CLOCK_COLD;
+            continue;
+        }
+        return vertex;
+    }
+    return VID_NONE;
+}
 
-    res = (threadInfo_t *)&tv->private[0];
-    *res = *(threadInfo_t *)info;
+/**
+ * @brief   let a thread wait for a mutex.
+ * @note    a thread waits for one mutex at most, a wait left by a lost event is replaced.
+ */
+void vertexWait(vid_t thread, vid_t mutex){
+    vid_t *waitingOn = &vertexField(thread, waitingOn);
+
+    assert(vidType(thread) == VERTEX_THREAD && vidType(mutex) == VERTEX_MUTEX);
+    if(*waitingOn != VID_NONE){
+        vertexField(*waitingOn, indegree)--;
+    }
+    *waitingOn = mutex;
+    vertexField(mutex, indegree)++;
 }
 
-static void mutexVertexSetInfoImpl(vertex_t *mv, void *info){
-    mutexInfo_t *res;
-    assert(mv != NULL && info != NULL);
+/**
+ * @brief   end the wait of a thread for a mutex.
+ * @return  DLC_OK, or DLC_ERR if the thread isn't waiting for the mutex.
+ */
+err_t vertexUnwait(vid_t thread, vid_t mutex){
+    vid_t *waitingOn = &vertexField(thread, waitingOn);
 
-    res = (mutexInfo_t *)&mv->private[0];
-    *res = *(mutexInfo_t *)info;
+    if(*waitingOn != mutex) return DLC_ERR;
+
+    *waitingOn = VID_NONE;
+    vertexField(mutex, indegree)--;
+    return DLC_OK;
 }
 
-//! global constructor array for all vertex.
-static vertex_t *(*vertexConstructor[])(vertexOperation_t *) = {
-    threadVertexConstructor, 
-    mutexVertexConstructor
-};
+//! link a mutex to the front of the mutexes owned by a thread.
+static inline void vertexHeldLink(vid_t mutex, vid_t thread){
+    vid_t first = vertexField(thread, held);
 
-//! global destructor array for all vertex.
-static void (*vertexDestructor[])(vertex_t *) = {
-    threadVertexDestructor, 
-    mutexVertexDestructor
-};
+    vertexField(mutex, heldPrev) = VID_NONE;
+    vertexField(mutex, heldNext) = first;
+    if(first != VID_NONE){
+        vertexField(first, heldPrev) = mutex;
+    }
+    vertexField(thread, held) = mutex;
+}
 
-//! global vertex's setInfo.  
-static void (*vertexSetInfoImpl[])(vertex_t *, void *) = {
-    threadVertexSetInfoImpl,
-    mutexVertexSetInfoImpl
-};
+static inline void vertexHeldUnlink(vid_t mutex, vid_t thread){
+    vid_t prev = vertexField(mutex, heldPrev), next = vertexField(mutex, heldNext);
+
+    if(prev != VID_NONE){
+        vertexField(prev, heldNext) = next;
+    }else{
+        vertexField(thread, held) = next;
+    }
+    if(next != VID_NONE){
+        vertexField(next, heldPrev) = prev;
+    }
+}
 
 /**
- * @brief   Create a vertex object based on the vertex type.
- 
- * @param   type is the type of vertex.
- * @param   ops is pointer to the opretion sets of a vertex.
- * @return  the concrete vertex object.
- * @note    
- * @see     
+ * @brief   let a thread hold a mutex.
+ * @return  DLC_OK, or DLC_ERR if the mutex has an owner and its generic arcs can't grow.
+ * @note    a mutex held while it has an owner takes a generic arc to the thread.
  */
-vertex_t *vertexCreate(vertexType_t type, vertexOperation_t *ops){
-    vertex_t *ret;
-    
-    assert(ops);
-    assert(vertexConstructor != NULL);
-    ret = vertexConstructor[type](ops);
-    return ret;
+err_t vertexHold(vid_t mutex, vid_t thread){
+    vid_t *owner = &vertexField(mutex, owner);
+
+    assert(vidType(thread) == VERTEX_THREAD && vidType(mutex) == VERTEX_MUTEX);
+    if(*owner == thread){
+        return DLC_OK;  //! held again, e.g. a recursive mutex.
+    }
+    if(*owner != VID_NONE){
+        return vertexAddEdge(mutex, thread);
+    }
+
+    *owner = thread;
+    vertexField(thread, indegree)++;
+    vertexHeldLink(mutex, thread);
+    return DLC_OK;
 }
 
 /**
- * @brief   Destroy a vertex object based on the vertex type.
- 
- * @param   type is the type of vertex.
- * @param   vertex is pointer to the concrete vertex object.
- * @note    The method is rarely called because a vertex object is rarely destroyed.
+ * @brief   let a thread release a mutex.
+ * @return  DLC_OK, or DLC_ERR if the mutex isn't held by the thread.
+ * @note    the ownership passes to a holder left in the generic arcs.
  */
-void vertexDestroy(vertexType_t type, vertex_t *vertex){
-    assert(vertex != NULL);
-    assert(vertexDestructor != NULL);
+err_t vertexRelease(vid_t mutex, vid_t thread){
+    vid_t *owner = &vertexField(mutex, owner), *arcs, next;
+    int count;
 
-    vertexDestructor[type](vertex);
+    if(*owner != thread){
+        return vertexDeleteEdge(mutex, thread);
+    }
+
+    vertexHeldUnlink(mutex, thread);
+    vertexField(thread, indegree)--;
+    *owner = VID_NONE;
+
+    arcs = vertexArcs(mutex, &count);
+    if(count > 0){
+        next = arcs[count - 1];
+        vertexDeleteEdge(mutex, next);
+        vertexHold(mutex, next);
+    }
+    return DLC_OK;
 }
 
-void vertexSetInfo(vertex_t *vertex, void *info){
-    assert(info != NULL);
-    assert(vertexSetInfoImpl != NULL);
+//! append an arc to a small vector of arcs.
+static err_t adjacencyAdd(adjacency_t *adj, vid_t v){
+    vid_t *arcs, *heap;
+    int count = adj->count, capacity;
+
+    arcs = adj->capacity == 0 ? adj->inlined : adj->heap;
+    for(int i = 0; i < count; i++){
+        assert(arcs[i] != v);
+    }
 
-    vertexSetInfoImpl[vertex->type](vertex, info);
+    capacity = adj->capacity == 0 ? SIZE_OF_ADJACENCY_INLINE : adj->capacity;
+    if(count == capacity){
+        //! spill to the heap, or double the arcs on the heap.
+        if(capacity * 2 > UINT16_MAX) return DLC_ERR;
+        heap = ztrymalloc(capacity * 2 * sizeof(vid_t));
+        if(heap == NULL) return DLC_ERR;
+
+        memcpy(heap, arcs, count * sizeof(vid_t));
+        if(adj->capacity != 0){
+            zfree(adj->heap);
+        }
+        adj->heap = heap;
+        adj->capacity = capacity * 2;
+        arcs = heap;
+    }
+
+    arcs[adj->count++] = v;
+    return DLC_OK;
 }
 
-arc_t *arcCreate(vertex_t *tail, arc_t *next){
-    arc_t *ret;
+//! remove an arc from a small vector of arcs, keeping the order of the others.
+static err_t adjacencyDelete(adjacency_t *adj, vid_t v){
+    vid_t *arcs, *heap;
+    int count = adj->count, i;
 
-    assert(tail);
-    ret = memPoolAlloc(arcMemPool);
-    if(ret == NULL){
-        memPoolInfo(arcMemPool);
+    arcs = adj->capacity == 0 ? adj->inlined : adj->heap;
+    for(i = 0; i < count; i++){
+        if(arcs[i] == v) break;
     }
+    if(i == count){
+        return DLC_ERR;
+    }
+
+    memmove(&arcs[i], &arcs[i + 1], (count - i - 1) * sizeof(vid_t));
+    adj->count--;
 
-    assert(ret != NULL);
-    memset(ret, 0, sizeof(arc_t));
+    //! move back inline once the arcs fit.
+    if(adj->capacity != 0 && adj->count <= SIZE_OF_ADJACENCY_INLINE){
+        heap = adj->heap;
+        memcpy(adj->inlined, heap, adj->count * sizeof(vid_t));
+        adj->capacity = 0;
+        zfree(heap);
+    }
+    return DLC_OK;
+}
 
-    ret->tail = tail;
-    ret->next = next;
+/**
+ * @brief   add a generic edge from the mutex u to the thread v.
+ * @return  DLC_OK, or DLC_ERR if the arcs of u can't grow.
+ */
+int vertexAddEdge(vid_t u, vid_t v){
+    assert(vidType(u) == VERTEX_MUTEX);
+    if(adjacencyAdd(&vertexField(u, adj), v) != DLC_OK){
+        return DLC_ERR;
+    }
+    vertexField(v, indegree)++;
+    return DLC_OK;
+}
 
-    return ret;
+/**
+ * @brief   delete the generic edge from the mutex u to the thread v.
+ * @return  DLC_OK, or DLC_ERR if there is no such edge.
+ * @note    a thread holds a lock once at any time, so there is one edge to it at most.
+ *          The edge is missing if it was never added, as the arcs couldn't grow.
+ */
+int vertexDeleteEdge(vid_t u, vid_t v){
+    if(adjacencyDelete(&vertexField(u, adj), v) != DLC_OK){
+        return DLC_ERR;
+    }
+    vertexField(v, indegree)--;
+    return DLC_OK;
 }
 
-void arcDestroy(arc_t *arc){
-    assert(arc);
+/**
+ * @brief   add an order arc from the mutex u to the mutex v, v was locked while u was held.
+ * @return  DLC_OK, or DLC_ERR if the arcs of u, or the arcs into v, can't grow.
+ */
+err_t vertexAddOrder(vid_t u, vid_t v){
+    assert(vidType(u) == VERTEX_MUTEX && vidType(v) == VERTEX_MUTEX && u != v);
+    if(adjacencyAdd(&vertexField(u, order), v) != DLC_OK){
+        return DLC_ERR;
+    }
+    if(adjacencyAdd(&vertexField(v, orderIn), u) != DLC_OK){
+        adjacencyDelete(&vertexField(u, order), v);
+        return DLC_ERR;
+    }
+    return DLC_OK;
+}
 
-    memPoolFree(arcMemPool, arc);
-}
\ No newline at end of file
+/**
+ * @brief   delete the order arc from the mutex u to the mutex v.
+ * @return  DLC_OK, or DLC_ERR if there is no such arc.
+ */
+err_t vertexDeleteOrder(vid_t u, vid_t v){
+    if(adjacencyDelete(&vertexField(u, order), v) != DLC_OK){
+        return DLC_ERR;
+    }
+    adjacencyDelete(&vertexField(v, orderIn), u);
+    return DLC_OK;
+}
@@ -0,0 +1,206 @@
+/**
+ * @file    workPool.c
+ * @author  qufeiyan
+ * @brief   small pool of worker threads running parallel loops with work stealing.
+ * @version 1.0.0
+ * @date    2026/10/18 21:40:12
+ * @version Copyright (c) 2026
+ */
+
+/* Includes --------------------------------------------------------------------------------*/
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#include "common.h"
+#include "mem.h"
+#include "workPool.h"
+
+void dlcSetTaskName(char *name);
+
+/**
+ * @note The workers sleep on the generation of the pool between two loops, as the
+ *       checker only runs a parallel loop once a detection pass. They never take a
+ *       pthread mutex, which would be tracked by the checker itself.
+ */
+static void workPoolWait(_Atomic uint32_t *word, uint32_t value){
+#ifdef __linux__
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+#else
+    (void)word;
+    (void)value;
+    usleep(1000);
+#endif
+}
+
+static void workPoolWake(_Atomic uint32_t *word){
+#ifdef __linux__
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, NUMBER_OF_WORKER_MAX, NULL, NULL, 0);
+#else
+    (void)word;
+#endif
+}
+
+#define workDequePack(head, tail)   ((uint64_t)(head) | ((uint64_t)(tail) << 32))
+
+/**
+ * @brief   take a chunk from a deque.
+ * @param   steal is whether to take it from the tail, as a thief.
+ * @return  true if a chunk is taken.
+ */
+static bool workDequeTake(workDeque_t *deque, bool steal, uint32_t *chunk){
+    uint64_t range, next;
+    uint32_t head, tail;
+
+    range = atomic_load_explicit(&deque->range, memory_order_acquire);
+    do{
+        head = (uint32_t)range;
+        tail = (uint32_t)(range >> 32);
+        if(head >= tail) return false;
+
+        if(steal){
+            *chunk = tail - 1;
+            next = workDequePack(head, tail - 1);
+        }else{
+            *chunk = head;
+            next = workDequePack(head + 1, tail);
+        }
+    }while(!atomic_compare_exchange_weak_explicit(&deque->range, &range, next,
+        memory_order_acq_rel, memory_order_acquire));
+    return true;
+}
+
+static void workPoolRunChunk(workPool_t *pool, uint32_t chunk){
+    uint32_t begin = chunk * pool->grain;
+    uint32_t end = DLC_MIN(begin + pool->grain, pool->count);
+
+    pool->func(pool->arg, begin, end);
+}
+
+/**
+ * @brief   run the chunks of a worker, then steal from the others until no chunk is left.
+ * @note    no chunk is added while a loop runs, so the loop is over for a worker once
+ *          all deques are found empty.
+ */
+static void workPoolRunWorker(workPool_t *pool, int id){
+    uint32_t chunk = 0;     //! set whenever a chunk is taken, gcc -O2 can't tell.
+    int i;
+
+    for(;;){
+        if(workDequeTake(&pool->deques[id], false, &chunk)){
+            workPoolRunChunk(pool, chunk);
+            continue;
+        }
+
+        for(i = 1; i < pool->workers; i++){
+            if(workDequeTake(&pool->deques[(id + i) % pool->workers], true, &chunk)){
+                break;
+            }
+        }
+        if(i == pool->workers) break;
+        workPoolRunChunk(pool, chunk);
+    }
+}
+
+static void *workPoolThread(void *arg){
+    workPool_t *pool = ((workDeque_t *)arg)->pool;
+    int id = ((workDeque_t *)arg)->id;
+    uint32_t seen = 0, generation;
+
+    dlcSetTaskName("dlcWorker");
+    for(;;){
+        generation = atomic_load_explicit(&pool->generation, memory_order_acquire);
+        if(generation == seen){
+            workPoolWait(&pool->generation, seen);
+            continue;
+        }
+        seen = generation;
+        if(atomic_load_explicit(&pool->quit, memory_order_acquire)) break;
+
+        workPoolRunWorker(pool, id);
+        atomic_fetch_sub_explicit(&pool->running, 1, memory_order_release);
+    }
+    return NULL;
+}
+
+/**
+ * @brief   create a pool of workers.
+ * @param   workers is the count of workers, including the thread calling workPoolFor().
+ * @return  the pool, NULL if there is no memory or no thread can be created.
+ */
+workPool_t *workPoolCreate(int workers){
+    workPool_t *pool;
+
+    assert(workers > 1 && workers <= NUMBER_OF_WORKER_MAX);
+    pool = ztrymalloc(sizeof(workPool_t));
+    if(pool == NULL) return NULL;
+
+    memset(pool, 0, sizeof(workPool_t));
+    pool->workers = 1;
+    for(int i = 1; i < workers; i++){
+        pool->deques[i].pool = pool;
+        pool->deques[i].id = i;
+        if(pthread_create(&pool->threads[i], NULL, workPoolThread, &pool->deques[i]) != 0){
+            break;
+        }
+        pool->workers++;
+    }
+
+    if(pool->workers == 1){
+        zfree(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void workPoolDestroy(workPool_t *pool){
+    if(pool == NULL) return;
+
+    atomic_store_explicit(&pool->quit, true, memory_order_release);
+    atomic_fetch_add_explicit(&pool->generation, 1, memory_order_release);
+    workPoolWake(&pool->generation);
+    for(int i = 1; i < pool->workers; i++){
+        pthread_join(pool->threads[i], NULL);
+    }
+    zfree(pool);
+}
+
+/**
+ * @brief   run a loop over the items [0, count) on all workers of the pool.
+ * @param   grain is the count of items handed to a worker at a time.
+ * @param   func is the loop body, which is called with the ranges of items.
+ * @note    it returns once all items are done, and the writes of all workers are
+ *          visible to the caller then. A loop must not be started by a loop body.
+ */
+void workPoolFor(workPool_t *pool, uint32_t count, uint32_t grain, workPoolFunc_t func, void *arg){
+    uint32_t chunks;
+    int workers;
+
+    assert(pool != NULL && grain > 0 && func != NULL);
+    if(count == 0) return;
+
+    workers = pool->workers;
+    chunks = (count - 1) / grain + 1;
+    pool->func = func;
+    pool->arg = arg;
+    pool->count = count;
+    pool->grain = grain;
+
+    //! deal the chunks out evenly, stealing balances the rest.
+    for(int i = 0; i < workers; i++){
+        atomic_store_explicit(&pool->deques[i].range, workDequePack(
+            (uint64_t)chunks * i / workers, (uint64_t)chunks * (i + 1) / workers),
+            memory_order_relaxed);
+    }
+    atomic_store_explicit(&pool->running, workers - 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&pool->generation, 1, memory_order_release);
+    workPoolWake(&pool->generation);
+
+    workPoolRunWorker(pool, 0);
+    while(atomic_load_explicit(&pool->running, memory_order_acquire) > 0){
+        sched_yield();
+    }
+}